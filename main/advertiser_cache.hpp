@@ -0,0 +1,208 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+#include "scan_mode.hpp"
+
+/** What we know of the advertisers in range, in a fixed amount of memory.
+ *
+ *  Scanning forever, NimBLE would keep a heap allocated result for every
+ *  advertiser it ever heard, which a busy place (a trade show) turns into
+ *  heap exhaustion; it is told to keep none instead (setMaxResults(0)) and
+ *  every advertising report updates an entry here: address, the last PDU
+ *  type, PHYs and RSSI, the AD flags, up to MAX_UUIDS 16-bit service UUIDs, the
+ *  appearance, what that makes of it and when it was last heard. When
+ *  full, the least recently heard advertiser makes room, and prune() drops
+ *  the ones not heard for a while.
+ *
+ *  The controller reports an advertiser once per scan while its duplicate
+ *  filter is on, so the last heard time is the last scan that heard it;
+ *  scans are restarted on the prune schedule for that reason too.
+ *
+ *  Updated from the BLE host task and read from the others, under a mutex.
+ *  print() keeps a second copy of the entries, so that it does not hold
+ *  the mutex while it sorts and prints.
+ */
+template <size_t CAPACITY> class AdvertiserCache {
+public:
+  static constexpr size_t MAX_ENTRIES = CAPACITY;
+  static constexpr size_t MAX_UUIDS = 4;
+
+  struct Entry {
+    uint8_t address[6];
+    uint8_t address_type;
+    uint8_t adv_type;    /**< Last advertising PDU type (not scan response). */
+    int8_t rssi;
+    uint8_t flags;       /**< AD flags, 0 if it sends none. */
+    AdvertiserIdentity identity;
+    uint8_t phys;        /**< Primary PHY << 4 | secondary PHY (0: legacy). */
+    uint8_t num_uuids;
+    uint16_t uuids[MAX_UUIDS];
+    uint16_t appearance;
+    uint16_t reports;    /**< Saturates. */
+    uint32_t last_seen_ms;
+  };
+
+  struct Stats {
+    uint32_t inserts;
+    uint32_t evictions;
+    uint32_t pruned;
+    uint32_t size_max;
+  };
+
+  /** PHY numbers, as HCI gives them. */
+  static constexpr uint8_t PHY_1M = 1;
+  static constexpr uint8_t PHY_2M = 2;
+  static constexpr uint8_t PHY_CODED = 3;
+  /** What a legacy advertisement goes out on. */
+  static constexpr uint8_t LEGACY_PHYS = PHY_1M << 4;
+
+  /** One advertising report (or scan response) from an advertiser. */
+  void update(const uint8_t address[6], uint8_t address_type, uint8_t adv_type, bool scan_response, int8_t rssi,
+              uint8_t phys, const uint8_t *data, size_t length, uint32_t now_ms) {
+    std::lock_guard<std::mutex> lk(mutex_);
+    Entry *e = find(address, address_type);
+    if (!e) {
+      e = insert(now_ms);
+      memset(e, 0, sizeof(*e));
+      memcpy(e->address, address, sizeof(e->address));
+      e->address_type = address_type;
+      e->identity = AdvertiserIdentity::UNKNOWN;
+    }
+    if (!scan_response) e->adv_type = adv_type;
+    e->phys = phys;
+    e->rssi = rssi;
+    e->last_seen_ms = now_ms;
+    if (e->reports != UINT16_MAX) e->reports++;
+    forEachAdStructure(data, length, [e](uint8_t type, const uint8_t *value, size_t value_length) {
+      if (type == AD_FLAGS && value_length) {
+        e->flags = value[0];
+      } else if (type == AD_APPEARANCE && value_length >= 2) {
+        e->appearance = value[0] | value[1] << 8;
+      } else if (type == AD_UUID16_INCOMPLETE || type == AD_UUID16_COMPLETE) {
+        for (size_t i = 0; i + 1 < value_length; i += 2) addUuid(*e, value[i] | value[i + 1] << 8);
+      }
+    });
+    // the advertisement and scan response each tell part of it; a definite answer wins
+    auto identity = identifyAdvertiser(data, length);
+    if (identity == AdvertiserIdentity::HID || e->identity == AdvertiserIdentity::UNKNOWN) e->identity = identity;
+  }
+
+  /** A copy of an advertiser's entry; false if it is not in the cache. */
+  bool get(const uint8_t address[6], uint8_t address_type, Entry &out) {
+    std::lock_guard<std::mutex> lk(mutex_);
+    Entry *e = find(address, address_type);
+    if (e) out = *e;
+    return e != nullptr;
+  }
+
+  /** Drops the advertisers not heard for max_age_ms; returns how many. */
+  size_t prune(uint32_t max_age_ms, uint32_t now_ms) {
+    std::lock_guard<std::mutex> lk(mutex_);
+    size_t kept = 0;
+    for (size_t i = 0; i < size_; i++) {
+      if (now_ms - entries_[i].last_seen_ms > max_age_ms) continue;
+      entries_[kept++] = entries_[i];
+    }
+    size_t removed = size_ - kept;
+    size_ = kept;
+    stats_.pruned += removed;
+    return removed;
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lk(mutex_);
+    stats_.pruned += size_;
+    size_ = 0;
+  }
+
+  size_t size() {
+    std::lock_guard<std::mutex> lk(mutex_);
+    return size_;
+  }
+
+  Stats stats() {
+    std::lock_guard<std::mutex> lk(mutex_);
+    return stats_;
+  }
+
+  void printStats() {
+    std::lock_guard<std::mutex> lk(mutex_);
+    printf("  advertiser cache: %u of %u (max %lu, %u B), %lu added, %lu evicted, %lu pruned\n", (unsigned)size_,
+           (unsigned)CAPACITY, (unsigned long)stats_.size_max, (unsigned)(sizeof(entries_) + sizeof(snapshot_)),
+           (unsigned long)stats_.inserts, (unsigned long)stats_.evictions, (unsigned long)stats_.pruned);
+  }
+
+  /** Every entry, most recently heard first. The entries are copied out
+   *  under the lock and sorted and printed without it, so the BLE host's
+   *  update() only waits for the copy. */
+  void print(uint32_t now_ms) {
+    std::lock_guard<std::mutex> print_lk(print_mutex_);
+    size_t n;
+    {
+      std::lock_guard<std::mutex> lk(mutex_);
+      n = size_;
+      std::copy(entries_, entries_ + n, snapshot_);
+    }
+    std::sort(snapshot_, snapshot_ + n, [now_ms](const Entry &a, const Entry &b) {
+      return now_ms - a.last_seen_ms < now_ms - b.last_seen_ms;
+    });
+    printf("Advertisers (%u):\n", (unsigned)n);
+    for (size_t i = 0; i < n; i++) {
+      auto &e = snapshot_[i];
+      static constexpr const char *IDENTITY[] = {"hid", "-", "?"};
+      static constexpr const char *PHY[] = {"-", "1M", "2M", "Coded"};
+      printf("  %02x:%02x:%02x:%02x:%02x:%02x/%u %4d dBm type %02x %s/%s flags %02x %-3s %6.1f s ago %5u reports",
+             e.address[5], e.address[4], e.address[3], e.address[2], e.address[1], e.address[0], e.address_type,
+             e.rssi, e.adv_type, PHY[(e.phys >> 4) & 3], PHY[e.phys & 3], e.flags, IDENTITY[(size_t)e.identity],
+             (now_ms - e.last_seen_ms) / 1000.0f, e.reports);
+      if (e.appearance) printf(" appearance %04x", e.appearance);
+      for (size_t u = 0; u < e.num_uuids; u++) printf(" %04x", e.uuids[u]);
+      printf("\n");
+    }
+  }
+
+protected:
+  Entry *find(const uint8_t address[6], uint8_t address_type) {
+    for (size_t i = 0; i < size_; i++) {
+      auto &e = entries_[i];
+      if (e.address_type == address_type && !memcmp(e.address, address, sizeof(e.address))) return &e;
+    }
+    return nullptr;
+  }
+
+  /** A slot for a new advertiser: a free one, else the least recently heard. */
+  Entry *insert(uint32_t now_ms) {
+    stats_.inserts++;
+    if (size_ < CAPACITY) {
+      if (++size_ > stats_.size_max) stats_.size_max = size_;
+      return &entries_[size_ - 1];
+    }
+    size_t oldest = 0;
+    for (size_t i = 1; i < CAPACITY; i++) {
+      if (now_ms - entries_[i].last_seen_ms > now_ms - entries_[oldest].last_seen_ms) oldest = i;
+    }
+    stats_.evictions++;
+    return &entries_[oldest];
+  }
+
+  static void addUuid(Entry &e, uint16_t uuid) {
+    for (size_t i = 0; i < e.num_uuids; i++) {
+      if (e.uuids[i] == uuid) return;
+    }
+    if (e.num_uuids < MAX_UUIDS) e.uuids[e.num_uuids++] = uuid;
+  }
+
+  std::mutex mutex_;
+  Entry entries_[CAPACITY];
+  size_t size_{0};
+  Stats stats_{};
+  /** print()'s copy, too big for a console task's stack. */
+  std::mutex print_mutex_;
+  Entry snapshot_[CAPACITY];
+};
@@ -0,0 +1,49 @@
+#include "sdkconfig.h"
+
+#if CONFIG_HID_HOST_STATIC_ALLOCATION
+
+#include <cstdlib>
+#include <new>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "allocation_guard.hpp"
+
+#if CONFIG_HEAP_USE_HOOKS
+
+#include "esp_heap_caps.h"
+
+extern "C" void esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps) {
+  AllocationGuard::onAllocation(size, __builtin_return_address(0), xTaskGetCurrentTaskHandle());
+}
+
+extern "C" void esp_heap_trace_free_hook(void *ptr) {}
+
+#else // no heap hooks, watch the C++ allocations
+
+static void *allocate(size_t size, void *caller) {
+  AllocationGuard::onAllocation(size, caller, xTaskGetCurrentTaskHandle());
+  void *p = malloc(size ? size : 1);
+  if (!p) abort();
+  return p;
+}
+
+void *operator new(size_t size) { return allocate(size, __builtin_return_address(0)); }
+void *operator new[](size_t size) { return allocate(size, __builtin_return_address(0)); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  AllocationGuard::onAllocation(size, __builtin_return_address(0), xTaskGetCurrentTaskHandle());
+  return malloc(size ? size : 1);
+}
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  AllocationGuard::onAllocation(size, __builtin_return_address(0), xTaskGetCurrentTaskHandle());
+  return malloc(size ? size : 1);
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+#endif // CONFIG_HEAP_USE_HOOKS
+
+#endif // CONFIG_HID_HOST_STATIC_ALLOCATION
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include "sdkconfig.h"
+
+/** Flags heap allocations made once the system is up and streaming input.
+ *
+ *  Every allocation is counted. Before arm() they are init allocations;
+ *  afterwards they are allowed only from the tasks given to permitTask()
+ *  (the BLE host and connect tasks, which scan and set devices up), and
+ *  anything else is a violation: its size and caller are recorded and,
+ *  with CONFIG_HID_HOST_ALLOC_GUARD_ABORT, the system aborts right there so
+ *  the backtrace shows the culprit. The caller of the hook says which task
+ *  allocates, so this header needs nothing from the OS.
+ *
+ *  Allocations are seen through the IDF heap hooks when the IDF has them
+ *  (CONFIG_HEAP_USE_HOOKS, IDF 5.1 on), which catches malloc as well, and
+ *  otherwise through a replacement of the global operator new, which only
+ *  catches what the C++ layers (NimBLE-cpp, std::) allocate. The hook runs
+ *  in whatever context allocates, so it only touches atomics.
+ */
+class AllocationGuard {
+public:
+  static constexpr size_t MAX_RECORDED = 8;
+  static constexpr size_t MAX_PERMITTED_TASKS = 4;
+
+  struct Violation {
+    size_t size;
+    void *caller;
+  };
+
+  /** Allocations from task stay allowed once armed. False if the table
+   *  is full or task is null (e.g. a task that was not found). */
+  static bool permitTask(const void *task) {
+    if (!task) return false;
+    for (auto &t : permitted_tasks_) {
+      const void *expected = nullptr;
+      if (t.compare_exchange_strong(expected, task, std::memory_order_release) || expected == task) return true;
+    }
+    return false;
+  }
+
+  /** From now on, allocations outside the permitted tasks are violations. */
+  static void arm() { armed_.store(true, std::memory_order_release); }
+
+  /** task is the allocating task's handle. */
+  static void onAllocation(size_t size, void *caller, const void *task) {
+    if (!armed_.load(std::memory_order_acquire)) {
+      init_allocations_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    for (auto &t : permitted_tasks_) {
+      if (task && t.load(std::memory_order_acquire) == task) {
+        permitted_allocations_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+    }
+    uint32_t n = violations_.fetch_add(1, std::memory_order_relaxed);
+    if (n < MAX_RECORDED) recorded_[n] = {size, caller};
+#if CONFIG_HID_HOST_ALLOC_GUARD_ABORT
+    abort();
+#endif
+  }
+
+  static uint32_t violations() { return violations_.load(std::memory_order_relaxed); }
+  static uint32_t permittedAllocations() { return permitted_allocations_.load(std::memory_order_relaxed); }
+
+  static void printStats() {
+    printf("Allocation guard: %lu at init, %lu by scanning / connecting tasks, %lu violations\n",
+           (unsigned long)init_allocations_.load(), (unsigned long)permitted_allocations_.load(),
+           (unsigned long)violations_.load());
+    uint32_t n = violations_.load();
+    for (uint32_t i = 0; i < n && i < MAX_RECORDED; i++) {
+      printf("  %lu B from %p\n", (unsigned long)recorded_[i].size, recorded_[i].caller);
+    }
+  }
+
+protected:
+  static inline std::atomic<bool> armed_{false};
+  static inline std::array<std::atomic<const void *>, MAX_PERMITTED_TASKS> permitted_tasks_{};
+  static inline std::atomic<uint32_t> init_allocations_{0};
+  static inline std::atomic<uint32_t> permitted_allocations_{0};
+  static inline std::atomic<uint32_t> violations_{0};
+  static inline std::array<Violation, MAX_RECORDED> recorded_{};
+};
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+
+#include "input_state.hpp"
+
+/** Fixed-point processing of a device's analog axes.
+ *
+ *  Calibration and the axial deadzone of each axis are linear, so they are
+ *  folded into a fixed-point scale per side of center that maps what is
+ *  past the deadzone edge onto 0..full scale; the response curve is a
+ *  lookup table over that magnitude, and each stick's radial deadzone a
+ *  gain table indexed by stick magnitude. The tables are only rebuilt when
+ *  a configuration changes; the report path is then integer only:
+ *   - per axis: a compare against the deadzone edges, one multiply, one
+ *     table lookup and a linear interpolation,
+ *   - per stick: an integer square root (fixed 16 steps, no data dependent
+ *     branches), a compare against the deadzone radius, one gain lookup /
+ *     interpolation and two multiplies.
+ *  Since the curve table starts at the deadzone edge, an axis' output
+ *  starts from exactly 0 there, not from an interpolation across the edge;
+ *  a stick is 0 up to its deadzone radius.
+ *
+ *  Tables have 65 entries, interpolated in between. Rebuilding writes the
+ *  inactive of two table banks and then flips to it, so the report path
+ *  never sees a half built table; the report path counts itself in on the
+ *  bank it reads, and a rebuild waits until the bank it is about to write
+ *  has no readers left from before the previous flip.
+ */
+class AxisProcessor {
+public:
+  static constexpr size_t NUM_STICKS = 2;
+  static constexpr size_t LUT_SIZE = 65;
+  static constexpr int32_t FULL_SCALE = 32767;
+
+  struct AxisConfig {
+    int16_t min{-32768};   /**< Raw value at full negative deflection. */
+    int16_t center{0};     /**< Raw value at rest. */
+    int16_t max{32767};    /**< Raw value at full positive deflection. */
+    uint16_t deadzone{0};  /**< Axial deadzone, as a fraction of full scale (0..32767). */
+    float exponent{1.0f};  /**< Response curve, out = in ^ exponent (only used to build the table). */
+  };
+
+  struct StickConfig {
+    bool enabled{false};
+    uint8_t x{InputState::X};
+    uint8_t y{InputState::Y};
+    uint16_t deadzone{0};  /**< Radial deadzone, as a fraction of full scale (0..32767). */
+  };
+
+  AxisProcessor() { reset(); }
+
+  /** Back to pass-through: full range calibration, no deadzones, linear. */
+  void reset() {
+    auto &next = startUpdate();
+    for (size_t i = 0; i < InputState::NUM_AXES; i++) buildAxis(next, i, AxisConfig());
+    for (size_t i = 0; i < NUM_STICKS; i++) buildStick(next, i, StickConfig());
+    finishUpdate();
+  }
+
+  /** Change one axis' calibration / deadzone / curve. Not for the report path. */
+  void configureAxis(size_t axis, const AxisConfig &config) {
+    if (axis >= InputState::NUM_AXES) return;
+    auto &next = startUpdate();
+    buildAxis(next, axis, config);
+    finishUpdate();
+  }
+
+  /** Change one stick's radial deadzone. Not for the report path. */
+  void configureStick(size_t stick, const StickConfig &config) {
+    if (stick >= NUM_STICKS) return;
+    auto &next = startUpdate();
+    buildStick(next, stick, config);
+    finishUpdate();
+  }
+
+  /** Process all axes of a report in one pass. */
+  void apply(std::array<int16_t, InputState::NUM_AXES> &axes) const {
+    uint8_t b = enter();
+    auto &bank = banks_[b];
+    for (size_t i = 0; i < InputState::NUM_AXES; i++) {
+      auto &axis = bank.axes[i];
+      int32_t d = axes[i] - axis.center;
+      int32_t t = 0;
+      if (d > axis.edge_pos) {
+        t = ((int64_t)(d - axis.edge_pos) * axis.gain_pos) >> 16;
+      } else if (d < -axis.edge_neg) {
+        t = ((int64_t)(-axis.edge_neg - d) * axis.gain_neg) >> 16;
+      }
+      int32_t out = lookup(axis.curve, std::min(t, FULL_SCALE) << 1);
+      axes[i] = d < 0 ? -out : out;
+    }
+    for (size_t s = 0; s < NUM_STICKS; s++) {
+      auto &stick = bank.sticks[s];
+      if (!stick.enabled) continue;
+      int32_t x = axes[stick.x];
+      int32_t y = axes[stick.y];
+      uint32_t r = isqrt((uint32_t)(x * x) + (uint32_t)(y * y));
+      // inside the deadzone without interpolating across its edge
+      int32_t gain = r > stick.deadzone ? lookup(bank.stick_gain[s], std::min<uint32_t>(r, 65535)) : 0;
+      axes[stick.x] = (x * gain) >> 15;
+      axes[stick.y] = (y * gain) >> 15;
+    }
+    readers_[b].fetch_sub(1);
+  }
+
+  /** Integer square root in a fixed 16 steps. */
+  static uint32_t isqrt(uint32_t n) {
+    uint32_t root = 0;
+    for (uint32_t bit = 1u << 30; bit; bit >>= 2) {
+      uint32_t trial = root + bit;
+      uint32_t mask = -(uint32_t)(n >= trial);
+      n -= trial & mask;
+      root = (root >> 1) + (bit & mask);
+    }
+    return root;
+  }
+
+protected:
+  struct Axis {
+    int32_t center;
+    /** Deadzone edges, as distances from center. */
+    int32_t edge_pos;
+    int32_t edge_neg;
+    /** 16.16 scale from past the edge to 0..full scale, 0 if the side has no range. */
+    int32_t gain_pos;
+    int32_t gain_neg;
+    /** Output magnitude over 0..full scale past the edge. */
+    std::array<int16_t, LUT_SIZE> curve;
+  };
+
+  struct Bank {
+    std::array<Axis, InputState::NUM_AXES> axes;
+    std::array<std::array<int16_t, LUT_SIZE>, NUM_STICKS> stick_gain;
+    std::array<StickConfig, NUM_STICKS> sticks;
+  };
+
+  /** Interpolated lookup of a 0..65535 index into a 65 entry table. */
+  static int16_t lookup(const std::array<int16_t, LUT_SIZE> &lut, uint32_t index) {
+    uint32_t i = index >> 10;
+    int32_t frac = index & 0x3FF;
+    int32_t a = lut[i];
+    int32_t b = lut[std::min<uint32_t>(i + 1, LUT_SIZE - 1)];
+    return a + (((b - a) * frac) >> 10);
+  }
+
+  /** The active bank, counted as read until the caller decrements
+   *  readers_. A reader that finds the banks flipped under it backs off,
+   *  since the bank it counted itself in on may be being rebuilt. */
+  uint8_t enter() const {
+    for (;;) {
+      uint8_t b = active_.load();
+      readers_[b].fetch_add(1);
+      if (active_.load() == b) return b;
+      readers_[b].fetch_sub(1);
+    }
+  }
+
+  Bank &startUpdate() {
+    uint8_t next = active_.load(std::memory_order_relaxed) ^ 1;
+    // a report may still be on the bank the last update flipped away from
+    while (readers_[next].load()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    banks_[next] = banks_[next ^ 1];
+    return banks_[next];
+  }
+
+  void finishUpdate() {
+    active_.store(active_.load(std::memory_order_relaxed) ^ 1, std::memory_order_release);
+  }
+
+  static void buildAxis(Bank &bank, size_t index, const AxisConfig &config) {
+    auto &axis = bank.axes[index];
+    float deadzone = std::min(config.deadzone / (float)FULL_SCALE, 1.0f);
+    axis.center = config.center;
+    buildSide(config.max - config.center, deadzone, axis.edge_pos, axis.gain_pos);
+    buildSide(config.center - config.min, deadzone, axis.edge_neg, axis.gain_neg);
+    for (size_t i = 0; i < LUT_SIZE; i++) {
+      // entry i is at magnitude i * 512 (index = magnitude << 1)
+      float magnitude = std::min(i * 512.0f / FULL_SCALE, 1.0f);
+      axis.curve[i] = (int16_t)std::lround(std::pow(magnitude, config.exponent) * FULL_SCALE);
+    }
+  }
+
+  /** One side of center spanning span raw counts: where its deadzone ends
+   *  and the scale from there to full scale. */
+  static void buildSide(int32_t span, float deadzone, int32_t &edge, int32_t &gain) {
+    if (span <= 0) {
+      edge = 0;
+      gain = 0;
+      return;
+    }
+    edge = std::lround(span * deadzone);
+    int32_t live = span - edge;
+    gain = live > 0 ? (int32_t)std::lround(FULL_SCALE * 65536.0 / live) : 0;
+  }
+
+  static void buildStick(Bank &bank, size_t stick, const StickConfig &config) {
+    bank.sticks[stick] = config;
+    float deadzone = config.deadzone;
+    for (size_t i = 0; i < LUT_SIZE; i++) {
+      float r = i * 1024.0f;
+      float gain;
+      if (deadzone > 0 && r <= deadzone) {
+        gain = 0;
+      } else if (r == 0) {
+        gain = 1;
+      } else {
+        // rescale (deadzone, full scale] onto (0, full scale], never past full scale
+        float scaled = std::min((r - deadzone) / (FULL_SCALE - deadzone), 1.0f) * FULL_SCALE;
+        gain = scaled / r;
+      }
+      bank.stick_gain[stick][i] = (int16_t)std::min<long>(std::lround(gain * 32768), 32767);
+    }
+  }
+
+  std::array<Bank, 2> banks_;
+  std::atomic<uint8_t> active_{0};
+  mutable std::array<std::atomic<uint32_t>, 2> readers_{};
+};
@@ -0,0 +1,295 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <initializer_list>
+#include <thread>
+
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "axis_processor.hpp"
+#include "hid_report_map.hpp"
+#include "input_remapper.hpp"
+#include "key_event_diff.hpp"
+#include "motion_accumulator.hpp"
+#include "perf_profiles.hpp"
+#include "power_control.hpp"
+#include "remap_profiles.hpp"
+#include "sc_crypto.hpp"
+
+/** On-target micro benchmarks of the report path, run once at boot when
+ *  CONFIG_HID_HOST_BENCHMARKS is set. Results are in CPU cycles so they
+ *  can be compared across CPU frequency settings. */
+namespace benchmarks {
+
+static constexpr size_t ITERATIONS = 10000;
+
+/** Build a report map for a report of `size` bytes: 32 buttons followed by
+ *  16-bit absolute axes. Returns the descriptor length. */
+static inline size_t buildReportMap(size_t size, uint8_t *out) {
+  size_t n = 0;
+  auto put = [&](std::initializer_list<uint8_t> bytes) { for (auto b : bytes) out[n++] = b; };
+  put({0x05, 0x01, 0x09, 0x05, 0xA1, 0x01});
+  put({0x05, 0x09, 0x19, 0x01, 0x29, 0x20, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x20, 0x81, 0x02});
+  size_t num_axes = (size - 4) / 2;
+  if (num_axes) {
+    put({0x05, 0x01});
+    for (size_t i = 0; i < num_axes; i++) put({0x09, (uint8_t)(0x30 + i % 8)});
+    put({0x16, 0x00, 0x80, 0x26, 0xFF, 0x7F, 0x75, 0x10, 0x95, (uint8_t)num_axes, 0x81, 0x02});
+  }
+  put({0xC0});
+  return n;
+}
+
+/** Decode and remap cost for growing report sizes. The remap works on the
+ *  decoded state, so its cost should stay flat while decode grows. */
+static inline void benchmarkRemap() {
+  static constexpr size_t SIZES[] = {4, 8, 16, 32, 64};
+  static uint8_t map[256];
+  static HidReportMap report_map;
+  static CompiledRemap remap;
+  // a profile that exercises every stage: permutation, inversion, turbo, toggle
+  RemapProfile profile = REMAP_PROFILES[0];
+  profile.invert_axes = 0x3;
+  profile.turbo = 1 << 4;
+  profile.toggle = 1 << 5;
+  remap.compile(profile);
+
+  printf("Remap benchmark (%d iterations, cycles per report):\n", (int)ITERATIONS);
+  for (auto size : SIZES) {
+    report_map.parse(map, buildReportMap(size, map));
+    uint8_t report[64];
+    for (size_t i = 0; i < size; i++) report[i] = i * 37;
+    InputState state;
+
+    uint32_t start = esp_cpu_get_cycle_count();
+    for (size_t i = 0; i < ITERATIONS; i++) {
+      report[0] = i;
+      report_map.decode(0, report, size, state);
+    }
+    uint32_t decode_cycles = esp_cpu_get_cycle_count() - start;
+
+    start = esp_cpu_get_cycle_count();
+    for (size_t i = 0; i < ITERATIONS; i++) {
+      state.buttons = i;
+      remap.apply(state);
+    }
+    uint32_t remap_cycles = esp_cpu_get_cycle_count() - start;
+
+    printf("  %2d B report: decode %5lu, remap %4lu\n", (int)size,
+           (unsigned long)(decode_cycles / ITERATIONS), (unsigned long)(remap_cycles / ITERATIONS));
+  }
+}
+
+/** Cost of processing all axes of one report: calibration, deadzones and
+ *  curve on every axis plus the radial deadzone of two sticks. */
+static inline void benchmarkAxisProcessing() {
+  static AxisProcessor processor;
+  AxisProcessor::AxisConfig axis;
+  axis.center = 512;
+  axis.deadzone = 3276;
+  axis.exponent = 2.0f;
+  for (size_t i = 0; i < InputState::NUM_AXES; i++) processor.configureAxis(i, axis);
+  processor.configureStick(0, {.enabled = true, .x = InputState::X, .y = InputState::Y, .deadzone = 3276});
+  processor.configureStick(1, {.enabled = true, .x = InputState::Z, .y = InputState::RZ, .deadzone = 3276});
+
+  std::array<int16_t, InputState::NUM_AXES> axes{};
+  uint32_t seed = 1;
+  uint32_t start = esp_cpu_get_cycle_count();
+  for (size_t i = 0; i < ITERATIONS; i++) {
+    for (auto &a : axes) {
+      seed = seed * 1664525u + 1013904223u;
+      a = seed >> 16;
+    }
+    processor.apply(axes);
+  }
+  uint32_t total = esp_cpu_get_cycle_count() - start;
+  // same loop without apply() to take out the input generation
+  start = esp_cpu_get_cycle_count();
+  for (size_t i = 0; i < ITERATIONS; i++) {
+    for (auto &a : axes) {
+      seed = seed * 1664525u + 1013904223u;
+      a = seed >> 16;
+    }
+    asm volatile("" : : "r"(axes.data()) : "memory");
+  }
+  uint32_t overhead = esp_cpu_get_cycle_count() - start;
+  printf("Axis processing benchmark: %lu cycles per report (%d axes, %d sticks)\n",
+         (unsigned long)((total - overhead) / ITERATIONS), (int)InputState::NUM_AXES,
+         (int)AxisProcessor::NUM_STICKS);
+}
+
+/** Key event throughput in the worst case: full rollover, every key of
+ *  the 256-bit bitmap going down and then up again on every report. */
+static inline void benchmarkKeyDiff() {
+  static KeyEventDiff diff;
+  static KeyEvent events[KeyEventDiff::MAX_EVENTS];
+  static constexpr KeyEventDiff::Bitmap ALL_DOWN = {~0ull, ~0ull, ~0ull, ~0ull};
+  static constexpr KeyEventDiff::Bitmap ALL_UP = {};
+  size_t num_events = 0;
+  int64_t start_us = esp_timer_get_time();
+  uint32_t start = esp_cpu_get_cycle_count();
+  for (size_t i = 0; i < ITERATIONS; i++) {
+    num_events += diff.update(i & 1 ? ALL_UP : ALL_DOWN, events);
+  }
+  uint32_t cycles = esp_cpu_get_cycle_count() - start;
+  int64_t elapsed_us = esp_timer_get_time() - start_us;
+  printf("Key diff benchmark: %lu events, %lu cycles per report, %.1f cycles per event, %lld events/s\n",
+         (unsigned long)num_events, (unsigned long)(cycles / ITERATIONS), (float)cycles / num_events,
+         elapsed_us ? (long long)(num_events * 1000000ll / elapsed_us) : 0ll);
+}
+
+/** Motion accumulator under a concurrent producer and consumer: a thread
+ *  adds reports as fast as it can while another drains boot mouse sized
+ *  steps. Checks that every count arrives, and how fast add() is. */
+static inline void benchmarkMotionAccumulator() {
+  static constexpr size_t REPORTS = ITERATIONS * 10;
+  static constexpr int32_t SCALE = MotionAccumulator::ONE * 3 / 2;
+  static MotionAccumulator accumulator;
+  accumulator.reset();
+  accumulator.setScale(SCALE);
+  std::atomic<bool> producing{true};
+  int64_t sent[InputState::NUM_MOTION] = {};
+  int64_t received[InputState::NUM_MOTION] = {};
+  uint32_t add_cycles = 0;
+
+  std::thread producer([&] {
+    uint32_t seed = 1;
+    uint32_t start = esp_cpu_get_cycle_count();
+    for (size_t i = 0; i < REPORTS; i++) {
+      std::array<int16_t, InputState::NUM_MOTION> motion;
+      for (size_t a = 0; a < InputState::NUM_MOTION; a++) {
+        seed = seed * 1664525u + 1013904223u;
+        motion[a] = (int16_t)(seed >> 16) >> 6; // +-512 counts
+        sent[a] += motion[a];
+      }
+      accumulator.add(motion);
+    }
+    add_cycles = esp_cpu_get_cycle_count() - start;
+    producing = false;
+  });
+  auto drainInto = [&] {
+    auto motion = accumulator.drain(127);
+    for (size_t a = 0; a < InputState::NUM_MOTION; a++) received[a] += motion[a];
+  };
+  while (producing) drainInto();
+  producer.join();
+  // empty it; what is left after that is the sub-count carry
+  for (bool pending = true; pending;) {
+    drainInto();
+    pending = false;
+    for (size_t a = 0; a < InputState::NUM_MOTION; a++) pending |= accumulator.pending(a) != 0;
+  }
+  bool ok = true;
+  for (size_t a = 0; a < InputState::NUM_MOTION; a++) {
+    // floor division, as the accumulator rounds down to whole counts
+    int64_t scaled = sent[a] * SCALE;
+    int64_t expected = scaled >= 0 ? scaled / MotionAccumulator::ONE
+                                   : -((-scaled + MotionAccumulator::ONE - 1) / MotionAccumulator::ONE);
+    ok &= received[a] == expected;
+  }
+  printf("Motion accumulator benchmark: %lu cycles per add, %s\n",
+         (unsigned long)(add_cycles / REPORTS), ok ? "no motion lost" : "MOTION LOST");
+}
+
+/** LE Secure Connections pairing crypto, step by step: what a pairing
+ *  costs with and without the local key pair generated ahead of time. */
+static inline void benchmarkScCrypto() {
+  static constexpr size_t ROUNDS = 8;
+  static ScCrypto crypto;
+  if (!crypto.ok()) {
+    printf("SC crypto benchmark: could not set up mbedTLS\n");
+    return;
+  }
+  static ScCrypto::KeyPair local, peer;
+  uint8_t dhkey[32], out[16], mac_key[16], ltk[16];
+  static constexpr uint8_t NONCE[16] = {1}, ADDRESS[7] = {0}, IO_CAP[3] = {0};
+  int64_t keygen_us = 0, dhkey_us = 0, f4_us = 0, f5_us = 0, f6_us = 0;
+  bool ok = crypto.generateKeyPair(peer);
+  for (size_t i = 0; ok && i < ROUNDS; i++) {
+    int64_t t0 = esp_timer_get_time();
+    ok &= crypto.generateKeyPair(local);
+    int64_t t1 = esp_timer_get_time();
+    ok &= crypto.dhkey(peer.pub, local.priv, dhkey);
+    int64_t t2 = esp_timer_get_time();
+    ok &= ScCrypto::f4(local.pub, peer.pub, NONCE, 0, out);
+    int64_t t3 = esp_timer_get_time();
+    ok &= ScCrypto::f5(dhkey, NONCE, NONCE, ADDRESS, ADDRESS, mac_key, ltk);
+    int64_t t4 = esp_timer_get_time();
+    ok &= ScCrypto::f6(mac_key, NONCE, NONCE, NONCE, IO_CAP, ADDRESS, ADDRESS, out);
+    int64_t t5 = esp_timer_get_time();
+    keygen_us += t1 - t0;
+    dhkey_us += t2 - t1;
+    f4_us += t3 - t2;
+    f5_us += t4 - t3;
+    f6_us += t5 - t4;
+  }
+  if (!ok) {
+    printf("SC crypto benchmark: FAILED\n");
+    return;
+  }
+  // Just Works as initiator: f4 to check the peer's confirm value, f5 once, f6 for both DHKey checks
+  int64_t per_pairing = (dhkey_us + f4_us + f5_us + 2 * f6_us) / ROUNDS;
+  printf("SC crypto benchmark (us): key pair %lld, DHKey %lld, f4 %lld, f5 %lld, f6 %lld; "
+         "pairing crypto %lld with the key pair ready, %lld without\n",
+         (long long)(keygen_us / ROUNDS), (long long)(dhkey_us / ROUNDS), (long long)(f4_us / ROUNDS),
+         (long long)(f5_us / ROUNDS), (long long)(f6_us / ROUNDS), (long long)per_pairing,
+         (long long)(per_pairing + keygen_us / ROUNDS));
+}
+
+/** Each performance profile's CPU side: the clock it runs the report path
+ *  at and what a 20 byte report's decode + remap takes in wall time. The
+ *  radio side (scan duty, connection events) is listed for reference;
+ *  current draw needs a meter on the supply while the console switches
+ *  profiles, and the live report latency per profile is with the latency
+ *  stats. */
+static inline void benchmarkPerfProfiles() {
+  static constexpr size_t SIZE = 20;
+  static uint8_t map[128];
+  static HidReportMap report_map;
+  static CompiledRemap remap;
+  static PowerControl power;
+  report_map.parse(map, buildReportMap(SIZE, map));
+  remap.compile(REMAP_PROFILES[0]);
+  uint8_t report[SIZE] = {};
+  InputState state;
+  printf("Performance profile benchmark (%d iterations):\n", (int)ITERATIONS);
+  for (auto &profile : PERF_PROFILES) {
+    if (!power.apply(profile.cpu_max_mhz, profile.cpu_min_mhz, profile.light_sleep)) {
+      printf("  %s: power management unavailable (CONFIG_PM_ENABLE), CPU side not measured\n", profile.name);
+      continue;
+    }
+    // let the clock switch settle
+    vTaskDelay(pdMS_TO_TICKS(10));
+    int64_t start_us = esp_timer_get_time();
+    uint32_t mhz = PowerControl::cpuMhz();
+    for (size_t i = 0; i < ITERATIONS; i++) {
+      report[0] = i;
+      report_map.decode(0, report, SIZE, state);
+      remap.apply(state);
+    }
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    printf("  %-12s CPU %lu MHz: %.2f us per report; scan %u%% duty (%s), "
+           "connection interval %.2f - %.2f ms, latency %u, TX power level %d, light sleep %s\n",
+           profile.name, (unsigned long)mhz, (float)elapsed_us / ITERATIONS,
+           profile.scan_window_ms * 100 / profile.scan_interval_ms, scanModeName(profile.scan_mode),
+           profile.conn_interval_min * 1.25f, profile.conn_interval_max * 1.25f, profile.conn_latency,
+           (int)profile.tx_power, profile.light_sleep ? "on" : "off");
+  }
+  // app_main applies the selected profile with locks of its own
+  power.release();
+}
+
+static inline void runAll() {
+  benchmarkRemap();
+  benchmarkAxisProcessing();
+  benchmarkKeyDiff();
+  benchmarkMotionAccumulator();
+  benchmarkScCrypto();
+  benchmarkPerfProfiles();
+}
+
+} // namespace benchmarks
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#include "nvs.h"
+
+/** Most recently used order of the bonded peers, kept in NVS next to
+ *  NimBLE's own bond store.
+ *
+ *  NimBLE evicts its oldest bond when the store is full, i.e. the peer that
+ *  bonded first, however often it is used. Touching a peer every time its
+ *  link is encrypted gives the least recently used one instead, which the
+ *  connect task deletes before pairing with a new peer. Bonds NimBLE has
+ *  that are not in this list rank as least recently used.
+ */
+class BondLru {
+public:
+  static constexpr size_t MAX_ENTRIES = 16;
+  /** rank() of a peer that is not in the list. */
+  static constexpr size_t UNKNOWN = MAX_ENTRIES;
+
+  /** 48-bit address and its type, as in ble_addr_t. */
+  struct Peer {
+    uint8_t type;
+    uint8_t val[6];
+    bool operator==(const Peer &other) const {
+      return type == other.type && !memcmp(val, other.val, sizeof(val));
+    }
+  };
+
+  /** Load the order saved by save(); an empty list if there is none. */
+  void load() {
+    num_entries_ = 0;
+    nvs_handle_t nvs;
+    if (nvs_open(NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) return;
+    size_t length = sizeof(entries_);
+    if (nvs_get_blob(nvs, KEY, entries_.data(), &length) == ESP_OK) {
+      num_entries_ = length / sizeof(Peer);
+    }
+    nvs_close(nvs);
+  }
+
+  bool save() const {
+    nvs_handle_t nvs;
+    if (nvs_open(NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) return false;
+    bool ok = nvs_set_blob(nvs, KEY, entries_.data(), num_entries_ * sizeof(Peer)) == ESP_OK &&
+              nvs_commit(nvs) == ESP_OK;
+    nvs_close(nvs);
+    return ok;
+  }
+
+  /** The peer was just used: move it to the front. */
+  void touch(const Peer &peer) {
+    size_t i = rank(peer);
+    if (i == UNKNOWN) i = num_entries_ < MAX_ENTRIES ? num_entries_++ : MAX_ENTRIES - 1;
+    for (; i > 0; i--) entries_[i] = entries_[i - 1];
+    entries_[0] = peer;
+  }
+
+  void remove(const Peer &peer) {
+    size_t i = rank(peer);
+    if (i == UNKNOWN) return;
+    for (; i + 1 < num_entries_; i++) entries_[i] = entries_[i + 1];
+    num_entries_--;
+  }
+
+  /** 0 for the most recently used peer, UNKNOWN if not in the list. */
+  size_t rank(const Peer &peer) const {
+    for (size_t i = 0; i < num_entries_; i++) {
+      if (entries_[i] == peer) return i;
+    }
+    return UNKNOWN;
+  }
+
+  size_t size() const { return num_entries_; }
+
+protected:
+  static constexpr const char *NAMESPACE = "hid_host";
+  static constexpr const char *KEY = "bond_lru";
+
+  std::array<Peer, MAX_ENTRIES> entries_{};
+  size_t num_entries_{0};
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+/** The last few connection attempts and how they ended.
+ *
+ *  Written by the connect task only. Readers take a snapshot without
+ *  locking, in the same way as the input event bus: each entry carries a
+ *  sequence word that is odd while the entry is being written, and an
+ *  entry whose sequence changed while it was copied is left out.
+ */
+class ConnectionHistory {
+public:
+  static constexpr size_t CAPACITY = 16;
+
+  enum class Result : uint8_t {
+    CONNECTED,
+    CONNECT_FAILED,   /**< The link did not come up. */
+    NO_CLIENT,        /**< Every NimBLE client is in use. */
+    SECURITY_FAILED,  /**< Pairing / encryption restart failed. */
+    NO_DEVICE_SLOT,   /**< Every HidDevice slot is in use. */
+    INJECTED_FAULT,   /**< The fault injector failed or dropped it. */
+  };
+
+  struct Entry {
+    int64_t start_us;
+    uint32_t duration_ms;
+    uint8_t address[6];
+    Result result;
+  };
+
+  static const char *resultName(Result result) {
+    switch (result) {
+    case Result::CONNECTED: return "connected";
+    case Result::CONNECT_FAILED: return "connect failed";
+    case Result::NO_CLIENT: return "no free client";
+    case Result::SECURITY_FAILED: return "security failed";
+    case Result::NO_DEVICE_SLOT: return "no free device slot";
+    case Result::INJECTED_FAULT: return "injected fault";
+    }
+    return "?";
+  }
+
+  void add(const Entry &entry) {
+    uint32_t index = count_.load(std::memory_order_relaxed);
+    auto &slot = slots_[index % CAPACITY];
+    uint32_t seq = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.entry = entry;
+    slot.sequence.store(seq + 2, std::memory_order_release);
+    count_.store(index + 1, std::memory_order_release);
+    if (entry.result != Result::CONNECTED) failures_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /** Copy up to max entries into out, newest first. Returns how many. */
+  size_t snapshot(Entry *out, size_t max) const {
+    uint32_t count = count_.load(std::memory_order_acquire);
+    size_t n = 0;
+    for (uint32_t i = 0; i < CAPACITY && i < count && n < max; i++) {
+      auto &slot = slots_[(count - 1 - i) % CAPACITY];
+      uint32_t before = slot.sequence.load(std::memory_order_acquire);
+      if (before & 1) continue;
+      out[n] = slot.entry;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.sequence.load(std::memory_order_relaxed) == before) n++;
+    }
+    return n;
+  }
+
+  /** Total number of attempts recorded. */
+  uint32_t count() const { return count_.load(std::memory_order_relaxed); }
+
+  /** Attempts that did not end up CONNECTED. */
+  uint32_t failures() const { return failures_.load(std::memory_order_relaxed); }
+
+  void print(int64_t now_us) const {
+    std::array<Entry, CAPACITY> entries;
+    size_t n = snapshot(entries.data(), entries.size());
+    printf("Connection attempts: %lu total, last %d:\n", (unsigned long)count(), (int)n);
+    for (size_t i = 0; i < n; i++) {
+      auto &e = entries[i];
+      printf("  %6lld s ago  %02x:%02x:%02x:%02x:%02x:%02x  %5lu ms  %s\n",
+             (long long)((now_us - e.start_us) / 1000000), e.address[5], e.address[4], e.address[3],
+             e.address[2], e.address[1], e.address[0], (unsigned long)e.duration_ms, resultName(e.result));
+    }
+  }
+
+protected:
+  struct Slot {
+    std::atomic<uint32_t> sequence{0};
+    Entry entry{};
+  };
+
+  std::array<Slot, CAPACITY> slots_;
+  std::atomic<uint32_t> count_{0};
+  std::atomic<uint32_t> failures_{0};
+};
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+
+/** Separates radio timing from host stack timing for one connection.
+ *
+ *  Reports can only leave the peripheral at connection events, which are
+ *  exactly one connection interval apart. The ESP32 controller does not
+ *  tell the host when an event took place, so the event grid is estimated
+ *  from the receive times: each receive time is placed on the grid, and
+ *  once per window the grid is moved onto the earliest arrival of the
+ *  window. That is, the least delayed report of a window is taken as
+ *  having no host stack delay; this also follows the slow drift between
+ *  the two sides' clocks. When an anchor is known (a controller that
+ *  reports it), onReport() takes it instead.
+ *
+ *  Per report this gives:
+ *   - radio: how many connection events passed since the previous report
+ *     (more than one means events without a report, counted as missed),
+ *   - host: the delay from the estimated event to our receive time,
+ *   - jitter: the RFC 3550 style smoothed deviation of inter-arrival times
+ *     from a whole number of intervals, which radio timing cannot cause.
+ *  Host delays of more than half an interval are indistinguishable from a
+ *  report that arrived early for the next event, and are counted that way.
+ */
+class ConnectionTiming {
+public:
+  static constexpr size_t WINDOW = 64;
+  static constexpr size_t NUM_BUCKETS = 8;
+
+  void reset() {
+    std::lock_guard<std::mutex> lk(mutex_);
+    interval_us_ = 0;
+    has_anchor_ = false;
+    stats_ = Stats();
+  }
+
+  /** The negotiated connection interval changed (or is first known). */
+  void setInterval(uint32_t interval_us) {
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (interval_us == interval_us_) return;
+    interval_us_ = interval_us;
+    // the old grid no longer applies
+    has_anchor_ = false;
+    stats_.interval_changes++;
+  }
+
+  /** What one report showed: its host delay and the connection events
+   *  missed before it. host_us is negative while the interval is unknown. */
+  struct Sample {
+    int64_t host_us;
+    uint32_t missed_events;
+  };
+
+  /** A report was received at rx_us; anchor_us is the connection event it
+   *  arrived in if the controller reported it, or negative to estimate. */
+  Sample onReport(int64_t rx_us, int64_t anchor_us = -1) {
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (!interval_us_) return {-1, 0};
+    int64_t interval = interval_us_;
+    if (anchor_us >= 0) {
+      anchor_us_ = anchor_us;
+      has_anchor_ = true;
+    } else if (!has_anchor_) {
+      anchor_us_ = rx_us;
+      has_anchor_ = true;
+      window_min_ = INT64_MAX;
+      window_count_ = 0;
+    }
+    // nearest grid point at or before rx_us (half an interval of slack for early arrivals)
+    int64_t since = rx_us - anchor_us_;
+    int64_t events = floorDiv(since + interval / 2, interval);
+    int64_t event_us = anchor_us_ + events * interval;
+    int64_t delay = rx_us - event_us;
+
+    int64_t prev_event_us = last_event_us_;
+    // keep the anchor recent, then move the grid onto the window's earliest arrival
+    anchor_us_ = event_us;
+    last_event_us_ = event_us;
+    if (anchor_us < 0) {
+      if (delay < window_min_) window_min_ = delay;
+      if (++window_count_ == WINDOW) {
+        anchor_us_ += window_min_;
+        window_min_ = INT64_MAX;
+        window_count_ = 0;
+      }
+    }
+
+    auto &s = stats_;
+    uint32_t missed = 0;
+    if (s.reports) {
+      // radio: whole connection events between the two reports
+      int64_t gap_events = (event_us - prev_event_us + interval / 2) / interval;
+      if (gap_events > 1) missed = gap_events - 1;
+      s.missed_events += missed;
+      // host: deviation of the arrival gap from those whole events
+      int64_t deviation = std::llabs(rx_us - last_rx_us_ - gap_events * interval);
+      s.jitter_us16 += (deviation * 16 - s.jitter_us16) / 16;
+    }
+    last_rx_us_ = rx_us;
+    s.reports++;
+    int64_t host = delay < 0 ? 0 : delay;
+    s.host_sum_us += host;
+    if (host > s.host_max_us) s.host_max_us = host;
+    size_t bucket = 0;
+    while (bucket + 1 < NUM_BUCKETS && host >= (250ll << bucket)) bucket++;
+    s.host_buckets[bucket]++;
+    return {host, missed};
+  }
+
+  /** Estimated connection event of the most recent report. */
+  int64_t lastEventUs() {
+    std::lock_guard<std::mutex> lk(mutex_);
+    return last_event_us_;
+  }
+
+  /** The figures the telemetry snapshot carries. Host delay percentiles
+   *  are the upper edge of their histogram bucket. */
+  struct Summary {
+    uint32_t interval_us;
+    uint32_t reports;
+    uint32_t missed_events;
+    uint32_t jitter_us;
+    uint32_t host_p50_us;
+    uint32_t host_p99_us;
+  };
+
+  Summary summary() {
+    Stats s;
+    Summary summary = {};
+    {
+      std::lock_guard<std::mutex> lk(mutex_);
+      s = stats_;
+      summary.interval_us = interval_us_;
+    }
+    summary.reports = s.reports;
+    summary.missed_events = s.missed_events;
+    summary.jitter_us = s.jitter_us16 / 16;
+    summary.host_p50_us = hostPercentile(s, 50);
+    summary.host_p99_us = hostPercentile(s, 99);
+    return summary;
+  }
+
+  void printStats(uint16_t conn_handle) {
+    /** print from a copy, so the report side never waits for the console */
+    Stats s;
+    uint32_t interval_us;
+    {
+      std::lock_guard<std::mutex> lk(mutex_);
+      s = stats_;
+      interval_us = interval_us_;
+    }
+    if (!s.reports) return;
+    printf("  timing (device %d): interval %lu us, %lu reports, %lu missed events, jitter %lu us, "
+           "host delay avg %lu us max %lu us\n",
+           conn_handle, (unsigned long)interval_us, (unsigned long)s.reports,
+           (unsigned long)s.missed_events, (unsigned long)(s.jitter_us16 / 16),
+           (unsigned long)(s.host_sum_us / s.reports), (unsigned long)s.host_max_us);
+    printf("    host delay hist:");
+    for (size_t b = 0; b < NUM_BUCKETS; b++) {
+      if (s.host_buckets[b]) printf(" <%lu:%lu", 250ul << b, (unsigned long)s.host_buckets[b]);
+    }
+    printf("\n");
+  }
+
+protected:
+  struct Stats {
+    uint32_t reports{0};
+    uint32_t missed_events{0};
+    uint32_t interval_changes{0};
+    int64_t jitter_us16{0};  /**< Smoothed jitter, in 1/16 us. */
+    int64_t host_sum_us{0};
+    int64_t host_max_us{0};
+    uint32_t host_buckets[NUM_BUCKETS]{}; /**< < 250 us, < 500 us, ... */
+  };
+
+  static uint32_t hostPercentile(const Stats &s, uint32_t percent) {
+    if (!s.reports) return 0;
+    uint64_t rank = ((uint64_t)s.reports * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (size_t b = 0; b + 1 < NUM_BUCKETS; b++) {
+      seen += s.host_buckets[b];
+      if (seen >= rank) return std::min<int64_t>(250ll << b, s.host_max_us);
+    }
+    return s.host_max_us;
+  }
+
+  static int64_t floorDiv(int64_t a, int64_t b) {
+    int64_t q = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+  }
+
+  std::mutex mutex_;
+  uint32_t interval_us_{0};
+  bool has_anchor_{false};
+  int64_t anchor_us_{0};
+  int64_t last_event_us_{0};
+  int64_t last_rx_us_{0};
+  int64_t window_min_{INT64_MAX};
+  size_t window_count_{0};
+  Stats stats_;
+};
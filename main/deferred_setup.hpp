@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+/** Bring-up milestones of one connection, in esp_timer microseconds (0 =
+ *  not reached yet). Time to first report is first_report_us - start_us. */
+struct SetupTimes {
+  int64_t start_us{0};    /**< Connecting started. */
+  int64_t ready_us{0};    /**< Input reports subscribed, pipeline enabled. */
+  std::atomic<int64_t> first_report_us{0};
+  int64_t deferred_done_us{0}; /**< All deferred reads finished. */
+
+  void reset(int64_t now_us) {
+    start_us = now_us;
+    ready_us = 0;
+    first_report_us.store(0, std::memory_order_relaxed);
+    deferred_done_us = 0;
+  }
+
+  /** Report side: note the first report, cheap after that. */
+  void onReport(int64_t rx_us) {
+    if (first_report_us.load(std::memory_order_relaxed)) return;
+    int64_t none = 0;
+    first_report_us.compare_exchange_strong(none, rx_us, std::memory_order_relaxed);
+  }
+
+  void printStats(uint16_t conn_handle) const {
+    if (!start_us) return;
+    auto since = [this](int64_t us) { return us ? (long)((us - start_us) / 1000) : -1l; };
+    printf("  setup (device %d): ready after %ld ms, first report after %ld ms, deferred reads done after %ld ms\n",
+           conn_handle, since(ready_us), since(first_report_us.load(std::memory_order_relaxed)),
+           since(deferred_done_us));
+  }
+};
+
+/** Connection setup work that can wait until a device's input is flowing.
+ *
+ *  Only what the pipeline needs to decode input (the HID service, its
+ *  report map and the input report subscriptions) is done before a device
+ *  is marked ready. Everything else - other services, battery level, PnP
+ *  ID, initial report values, freeing the attribute tree - is queued here
+ *  and run by the connect task, one job at a time, once the device has sent
+ *  its first report (or a grace period has passed). Used from the connect
+ *  task only.
+ */
+class DeferredSetup {
+public:
+  static constexpr size_t MAX_JOBS = 32;
+
+  enum class Job : uint8_t {
+    DISCOVER_SERVICES, /**< Discover and set up the services other than HID. */
+    READ_BATTERY,      /**< Battery Level (0x180F / 0x2A19). */
+    READ_PNP_ID,       /**< Device Information PnP ID (0x180A / 0x2A50). */
+    READ_INPUT_REPORT, /**< Initial value of the first input report. */
+    COMPACT,           /**< Free the attribute tree, always last. */
+  };
+
+  struct Item {
+    uint16_t conn_handle;
+    Job job;
+  };
+
+  bool push(uint16_t conn_handle, Job job) {
+    if (num_jobs_ == MAX_JOBS) return false;
+    jobs_[num_jobs_++] = {conn_handle, job};
+    return true;
+  }
+
+  /** Take the oldest job whose device can_run(conn_handle); jobs of other
+   *  devices keep their order. */
+  template <typename F> bool pop(Item &item, F can_run) {
+    for (size_t i = 0; i < num_jobs_; i++) {
+      if (!can_run(jobs_[i].conn_handle)) continue;
+      item = jobs_[i];
+      for (size_t j = i + 1; j < num_jobs_; j++) jobs_[j - 1] = jobs_[j];
+      num_jobs_--;
+      return true;
+    }
+    return false;
+  }
+
+  /** Forget the jobs of a connection, e.g. when its handle is reused. */
+  void drop(uint16_t conn_handle) {
+    size_t kept = 0;
+    for (size_t i = 0; i < num_jobs_; i++) {
+      if (jobs_[i].conn_handle != conn_handle) jobs_[kept++] = jobs_[i];
+    }
+    num_jobs_ = kept;
+  }
+
+  size_t pending(uint16_t conn_handle) const {
+    size_t n = 0;
+    for (size_t i = 0; i < num_jobs_; i++) n += jobs_[i].conn_handle == conn_handle;
+    return n;
+  }
+
+protected:
+  std::array<Item, MAX_JOBS> jobs_{};
+  size_t num_jobs_{0};
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "usb_hid_endpoint.hpp"
+
+/** UsbHidEndpoint that records every report it is sent, for checking the
+ *  passthrough off target. Like the real IN endpoint it is busy from a
+ *  send until complete() is called (the host polling it), which then
+ *  calls the completion callback as the TinyUSB task would. Not for the
+ *  report path: it allocates. */
+class FakeUsbHidEndpoint : public UsbHidEndpoint {
+public:
+  struct Report {
+    uint8_t report_id;
+    std::vector<uint8_t> data;
+  };
+
+  explicit FakeUsbHidEndpoint(std::function<void()> on_complete = nullptr) : on_complete_(on_complete) {}
+
+  bool start(const uint8_t *report_descriptor, size_t length) override {
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (started_) return false;
+    descriptor_.assign(report_descriptor, report_descriptor + length);
+    started_ = true;
+    return true;
+  }
+
+  bool ready() override {
+    std::lock_guard<std::mutex> lk(mutex_);
+    return started_ && !busy_;
+  }
+
+  bool send(uint8_t report_id, const uint8_t *data, size_t length) override {
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (!started_ || busy_) return false;
+    busy_ = true;
+    reports_.push_back({report_id, std::vector<uint8_t>(data, data + length)});
+    return true;
+  }
+
+  /** The host took the report: free the endpoint and say so. Returns
+   *  false if no report was in flight. */
+  bool complete() {
+    {
+      std::lock_guard<std::mutex> lk(mutex_);
+      if (!busy_) return false;
+      busy_ = false;
+    }
+    if (on_complete_) on_complete_();
+    return true;
+  }
+
+  void setCompletion(std::function<void()> on_complete) { on_complete_ = on_complete; }
+
+  std::vector<Report> reports() {
+    std::lock_guard<std::mutex> lk(mutex_);
+    return reports_;
+  }
+
+  const std::vector<uint8_t> &descriptor() const { return descriptor_; }
+
+protected:
+  std::function<void()> on_complete_;
+  std::mutex mutex_;
+  bool started_{false};
+  bool busy_{false};
+  std::vector<uint8_t> descriptor_;
+  std::vector<Report> reports_;
+};
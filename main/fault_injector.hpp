@@ -0,0 +1,308 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+
+#include "esp_random.h"
+#include "esp_timer.h"
+
+/** Radio-impairment fault injection for the transport boundary.
+ *
+ *  Sits between the BLE stack callbacks and the report pipeline. Incoming
+ *  notifications can be dropped, delayed, reordered or duplicated, and the
+ *  connection bring-up can be made to fail or disconnect at a chosen phase.
+ *  Every injected fault starts a recovery timer, so the stats show the
+ *  time-to-recover distribution for each fault type. A dropped report or a
+ *  failed or dropped connection is recovered from by the next report that
+ *  reaches the pipeline; a delayed or reordered report only by reaching it
+ *  itself, timed from when it was held back.
+ */
+class FaultInjector {
+public:
+  /** Faults that can be injected. */
+  enum class Fault : uint8_t {
+    DROP,
+    DELAY,
+    REORDER,
+    DUPLICATE,
+    CONNECT_FAIL,
+    DISCONNECT_AFTER_CONNECT,
+    DISCONNECT_DURING_DISCOVERY,
+    DISCONNECT_AFTER_SUBSCRIBE,
+    COUNT,
+  };
+
+  /** Connection bring-up phases at which a disconnect can be injected. */
+  enum class Phase : uint8_t {
+    AFTER_CONNECT,
+    DURING_DISCOVERY,
+    AFTER_SUBSCRIBE,
+  };
+
+  /** Largest notification payload we will hold on to for delay / reorder. */
+  static constexpr size_t MAX_REPORT_SIZE = 64;
+  /** How many delayed notifications can be in flight at once. */
+  static constexpr size_t MAX_DELAYED = 8;
+  /** Number of log2(ms) buckets in the recovery histogram. */
+  static constexpr size_t NUM_BUCKETS = 16;
+
+  /** Function called to hand a notification to the report pipeline. */
+  typedef std::function<void(uint16_t conn_handle, uint16_t char_handle,
+                             const uint8_t *data, size_t length)> deliver_fn;
+
+  struct Config {
+    deliver_fn deliver; /**< Where surviving notifications are delivered. */
+    uint16_t drop_per_mille{0};
+    uint16_t delay_per_mille{0};
+    uint32_t delay_ms{50};
+    uint16_t reorder_per_mille{0};
+    uint16_t duplicate_per_mille{0};
+    uint16_t connect_fail_per_mille{0};
+    uint16_t disconnect_after_connect_per_mille{0};
+    uint16_t disconnect_during_discovery_per_mille{0};
+    uint16_t disconnect_after_subscribe_per_mille{0};
+  };
+
+  explicit FaultInjector(const Config &config) : config_(config) {}
+
+  /** Entry point for notifications coming from the BLE stack. */
+  void onNotification(uint16_t conn_handle, uint16_t char_handle,
+                      const uint8_t *data, size_t length) {
+    if (roll(config_.drop_per_mille)) {
+      markFault(Fault::DROP);
+      return;
+    }
+    if (length <= MAX_REPORT_SIZE && roll(config_.delay_per_mille)) {
+      std::lock_guard<std::mutex> lk(mutex_);
+      for (auto &d : delayed_) {
+        if (d.in_use) continue;
+        d.report.set(conn_handle, char_handle, data, length);
+        d.report.held_since_us = esp_timer_get_time();
+        d.release_us = d.report.held_since_us + config_.delay_ms * 1000;
+        d.in_use = true;
+        startRecovery(Fault::DELAY);
+        return;
+      }
+      // no free slot, fall through and deliver normally
+    }
+    if (length <= MAX_REPORT_SIZE && roll(config_.reorder_per_mille)) {
+      std::lock_guard<std::mutex> lk(mutex_);
+      if (!held_in_use_) {
+        held_.set(conn_handle, char_handle, data, length);
+        held_.held_since_us = esp_timer_get_time();
+        held_in_use_ = true;
+        startRecovery(Fault::REORDER);
+        return;
+      }
+    }
+    deliver(conn_handle, char_handle, data, length);
+    if (roll(config_.duplicate_per_mille)) {
+      markFault(Fault::DUPLICATE);
+      deliver(conn_handle, char_handle, data, length);
+    }
+    // a report held back for reordering goes out after the one that
+    // overtook it
+    Report held;
+    bool release_held = false;
+    {
+      std::lock_guard<std::mutex> lk(mutex_);
+      if (held_in_use_) {
+        held = held_;
+        held_in_use_ = false;
+        release_held = true;
+      }
+    }
+    if (release_held) {
+      deliver(held.conn_handle, held.char_handle, held.data, held.length, Fault::REORDER, held.held_since_us);
+    }
+  }
+
+  /** Release any delayed notifications whose time has come. Call this
+   *  from the task that runs the pipeline, by nextReleaseUs(), so that
+   *  released reports never race the ones coming in. */
+  void poll() {
+    auto now = esp_timer_get_time();
+    for (size_t i = 0; i < MAX_DELAYED; i++) {
+      Report r;
+      {
+        std::lock_guard<std::mutex> lk(mutex_);
+        auto &d = delayed_[i];
+        if (!d.in_use || d.release_us > now) continue;
+        r = d.report;
+        d.in_use = false;
+      }
+      deliver(r.conn_handle, r.char_handle, r.data, r.length, Fault::DELAY, r.held_since_us);
+    }
+  }
+
+  /** When poll() next has a delayed notification to release, or -1 if
+   *  none is held. */
+  int64_t nextReleaseUs() {
+    std::lock_guard<std::mutex> lk(mutex_);
+    int64_t next = -1;
+    for (auto &d : delayed_) {
+      if (d.in_use && (next < 0 || d.release_us < next)) next = d.release_us;
+    }
+    return next;
+  }
+
+  /** Returns true if the next connection attempt should be failed. */
+  bool shouldFailConnect() {
+    if (!roll(config_.connect_fail_per_mille)) return false;
+    markFault(Fault::CONNECT_FAIL);
+    return true;
+  }
+
+  /** Returns true if the link should be dropped at the given phase. */
+  bool shouldDisconnect(Phase phase) {
+    uint16_t per_mille = 0;
+    Fault fault = Fault::COUNT;
+    switch (phase) {
+    case Phase::AFTER_CONNECT:
+      per_mille = config_.disconnect_after_connect_per_mille;
+      fault = Fault::DISCONNECT_AFTER_CONNECT;
+      break;
+    case Phase::DURING_DISCOVERY:
+      per_mille = config_.disconnect_during_discovery_per_mille;
+      fault = Fault::DISCONNECT_DURING_DISCOVERY;
+      break;
+    case Phase::AFTER_SUBSCRIBE:
+      per_mille = config_.disconnect_after_subscribe_per_mille;
+      fault = Fault::DISCONNECT_AFTER_SUBSCRIBE;
+      break;
+    }
+    if (!roll(per_mille)) return false;
+    markFault(fault);
+    return true;
+  }
+
+  /** Print the time-to-recover distribution for each fault type. */
+  void printStats() {
+    std::lock_guard<std::mutex> lk(mutex_);
+    printf("Fault injection time-to-recover (ms):\n");
+    for (size_t i = 0; i < (size_t)Fault::COUNT; i++) {
+      auto &s = stats_[i];
+      printf("  %-28s injected=%-6lu recovered=%-6lu",
+             faultName((Fault)i), (unsigned long)s.injected, (unsigned long)s.recovered);
+      if (s.recovered) {
+        printf(" min=%lu avg=%lu max=%lu",
+               (unsigned long)(s.min_us / 1000),
+               (unsigned long)(s.sum_us / s.recovered / 1000),
+               (unsigned long)(s.max_us / 1000));
+      }
+      printf("\n");
+      if (!s.recovered) continue;
+      printf("    hist:");
+      for (size_t b = 0; b < NUM_BUCKETS; b++) {
+        if (s.buckets[b]) printf(" <%lu:%lu", 1ul << b, (unsigned long)s.buckets[b]);
+      }
+      printf("\n");
+    }
+  }
+
+  static const char *faultName(Fault fault) {
+    switch (fault) {
+    case Fault::DROP: return "drop";
+    case Fault::DELAY: return "delay";
+    case Fault::REORDER: return "reorder";
+    case Fault::DUPLICATE: return "duplicate";
+    case Fault::CONNECT_FAIL: return "connect_fail";
+    case Fault::DISCONNECT_AFTER_CONNECT: return "disconnect_after_connect";
+    case Fault::DISCONNECT_DURING_DISCOVERY: return "disconnect_during_discovery";
+    case Fault::DISCONNECT_AFTER_SUBSCRIBE: return "disconnect_after_subscribe";
+    default: return "unknown";
+    }
+  }
+
+protected:
+  struct Report {
+    uint16_t conn_handle{0};
+    uint16_t char_handle{0};
+    size_t length{0};
+    int64_t held_since_us{0};
+    uint8_t data[MAX_REPORT_SIZE];
+
+    void set(uint16_t conn, uint16_t chr, const uint8_t *d, size_t len) {
+      conn_handle = conn;
+      char_handle = chr;
+      length = len;
+      memcpy(data, d, len);
+    }
+  };
+
+  struct Delayed {
+    Report report;
+    int64_t release_us{0};
+    bool in_use{false};
+  };
+
+  struct Stats {
+    uint32_t injected{0};
+    uint32_t recovered{0};
+    int64_t pending_since_us{-1};
+    int64_t min_us{INT64_MAX};
+    int64_t max_us{0};
+    int64_t sum_us{0};
+    std::array<uint32_t, NUM_BUCKETS> buckets{};
+  };
+
+  static bool roll(uint16_t per_mille) {
+    return per_mille && (esp_random() % 1000) < per_mille;
+  }
+
+  void markFault(Fault fault) {
+    std::lock_guard<std::mutex> lk(mutex_);
+    startRecovery(fault);
+  }
+
+  /** A delayed or reordered report recovers when it is delivered. */
+  static bool isHeld(Fault fault) { return fault == Fault::DELAY || fault == Fault::REORDER; }
+
+  /** Must be called with mutex_ held. Only the first fault of a kind starts
+   *  the clock, so back-to-back faults measure the full outage; held
+   *  reports carry their own start time instead. */
+  void startRecovery(Fault fault) {
+    auto &s = stats_[(size_t)fault];
+    s.injected++;
+    if (!isHeld(fault) && s.pending_since_us < 0) s.pending_since_us = esp_timer_get_time();
+  }
+
+  /** Must be called with mutex_ held. */
+  static void recordRecovery(Stats &s, int64_t elapsed) {
+    s.recovered++;
+    s.sum_us += elapsed;
+    if (elapsed < s.min_us) s.min_us = elapsed;
+    if (elapsed > s.max_us) s.max_us = elapsed;
+    size_t bucket = 0;
+    for (auto ms = elapsed / 1000; ms && bucket < NUM_BUCKETS - 1; ms >>= 1) bucket++;
+    s.buckets[bucket]++;
+  }
+
+  /** Hands a report to the pipeline; held_for is the fault that held it
+   *  back since held_since_us, if any. */
+  void deliver(uint16_t conn_handle, uint16_t char_handle, const uint8_t *data, size_t length,
+               Fault held_for = Fault::COUNT, int64_t held_since_us = 0) {
+    {
+      std::lock_guard<std::mutex> lk(mutex_);
+      auto now = esp_timer_get_time();
+      for (auto &s : stats_) {
+        if (s.pending_since_us < 0) continue;
+        recordRecovery(s, now - s.pending_since_us);
+        s.pending_since_us = -1;
+      }
+      if (held_for != Fault::COUNT) recordRecovery(stats_[(size_t)held_for], now - held_since_us);
+    }
+    if (config_.deliver) config_.deliver(conn_handle, char_handle, data, length);
+  }
+
+  Config config_;
+  std::mutex mutex_;
+  std::array<Delayed, MAX_DELAYED> delayed_;
+  Report held_;
+  bool held_in_use_{false};
+  std::array<Stats, (size_t)Fault::COUNT> stats_;
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+#include "esp_heap_caps.h"
+#include "sdkconfig.h"
+
+/** Tagged heap accounting.
+ *
+ *  Keeps a current and peak byte count per subsystem. Regions of code that
+ *  run synchronously can be wrapped in a HeapTracker::Scope, which charges
+ *  the net change in free heap across the region to its tag. Allocations we
+ *  cannot wrap (e.g. ones made inside the BLE host on our behalf) are
+ *  charged with add() / sub() using a size estimate instead.
+ *
+ *  Scopes measure the global free heap, so an allocation made by another
+ *  task while a scope is open is charged to that scope. Keep scopes short,
+ *  and off the report path, which does not allocate (see AllocationGuard)
+ *  and should not pay for two free heap walks per report.
+ *  With CONFIG_HID_HOST_HEAP_ACCOUNTING disabled everything compiles away.
+ */
+class HeapTracker {
+public:
+#if CONFIG_HID_HOST_HEAP_ACCOUNTING
+  static constexpr bool ENABLED = true;
+#else
+  static constexpr bool ENABLED = false;
+#endif
+
+  enum class Tag : uint8_t {
+    SCAN,
+    DISCOVERY,
+    LOGGING,
+    COUNT,
+  };
+
+  /** Charges the net heap change across its lifetime to a tag. */
+  class Scope {
+  public:
+    Scope(HeapTracker &tracker, Tag tag)
+      : tracker_(tracker), tag_(tag), free_before_(ENABLED ? freeBytes() : 0) {}
+    ~Scope() {
+      if constexpr (!ENABLED) return;
+      int32_t used = (int32_t)free_before_ - (int32_t)freeBytes();
+      if (used > 0) tracker_.add(tag_, used);
+      else if (used < 0) tracker_.sub(tag_, -used);
+    }
+
+  protected:
+    HeapTracker &tracker_;
+    Tag tag_;
+    size_t free_before_;
+  };
+
+  /** Charge bytes to a tag. */
+  void add(Tag tag, size_t bytes) {
+    if constexpr (!ENABLED) return;
+    auto &c = counters_[(size_t)tag];
+    auto current = c.current.fetch_add((int32_t)bytes) + (int32_t)bytes;
+    auto peak = c.peak.load();
+    while (current > peak && !c.peak.compare_exchange_weak(peak, current)) {}
+  }
+
+  /** Credit bytes back to a tag. */
+  void sub(Tag tag, size_t bytes) {
+    if constexpr (!ENABLED) return;
+    counters_[(size_t)tag].current.fetch_sub((int32_t)bytes);
+  }
+
+  /** Forget everything currently charged to a tag (peak is kept). */
+  void reset(Tag tag) {
+    counters_[(size_t)tag].current = 0;
+  }
+
+  int32_t current(Tag tag) const { return counters_[(size_t)tag].current; }
+  int32_t peak(Tag tag) const { return counters_[(size_t)tag].peak; }
+
+  static size_t freeBytes() { return heap_caps_get_free_size(MALLOC_CAP_DEFAULT); }
+
+  void print() const {
+    printf("Heap: free %u B, min free %u B, largest block %u B\n",
+           (unsigned)freeBytes(),
+           (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT),
+           (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT));
+    for (size_t i = 0; i < (size_t)Tag::COUNT; i++) {
+      printf("  %-10s current %6ld B, peak %6ld B\n", tagName((Tag)i),
+             (long)counters_[i].current.load(), (long)counters_[i].peak.load());
+    }
+  }
+
+  static const char *tagName(Tag tag) {
+    switch (tag) {
+    case Tag::SCAN: return "scan";
+    case Tag::DISCOVERY: return "discovery";
+    case Tag::LOGGING: return "logging";
+    default: return "unknown";
+    }
+  }
+
+protected:
+  struct Counter {
+    std::atomic<int32_t> current{0};
+    std::atomic<int32_t> peak{0};
+  };
+
+  std::array<Counter, (size_t)Tag::COUNT> counters_;
+};
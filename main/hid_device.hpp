@@ -0,0 +1,160 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#include "sdkconfig.h"
+
+#include "axis_processor.hpp"
+#include "connection_timing.hpp"
+#include "deferred_setup.hpp"
+#include "hid_report_map.hpp"
+#include "input_remapper.hpp"
+#include "key_event_diff.hpp"
+#include "motion_accumulator.hpp"
+#include "input_state.hpp"
+#include "output_report_channel.hpp"
+
+/** Everything the report pipeline needs to know about a connected device.
+ *
+ *  Holds a compact table of the subscribed characteristic value handles
+ *  (with the report ID / kind each one carries), the parsed report map and
+ *  the device's current decoded state. Notifications are matched against
+ *  the handle table by value handle, which also lets the discovered
+ *  NimBLERemoteService / Characteristic / Descriptor objects be freed after
+ *  subscription: a device then costs a few bytes of handles instead of a
+ *  tree of heap allocated objects. Output reports go the other way through
+ *  the device's OutputReportChannel.
+ */
+struct HidDevice {
+  static constexpr size_t MAX_HANDLES = 16;
+  static constexpr uint16_t NO_CONNECTION = 0xFFFF;
+
+  /** What a subscribed characteristic carries. */
+  enum class Kind : uint8_t {
+    REPORT,        /**< 0x2A4D input report, decoded with the report map. */
+    BOOT_KEYBOARD, /**< 0x2A22 boot keyboard input report. */
+    BOOT_MOUSE,    /**< 0x2A33 boot mouse input report. */
+    OTHER,         /**< Anything else (battery level, ...), not decoded. */
+  };
+
+  struct Handle {
+    uint16_t value_handle{0};
+    uint8_t report_id{0};
+    Kind kind{Kind::OTHER};
+  };
+
+  uint16_t conn_handle{NO_CONNECTION};
+  uint8_t num_handles{0};
+  std::array<Handle, MAX_HANDLES> handles{};
+  uint32_t sequence{0};
+  HidReportMap report_map;
+  /** Applied to each published state; the device's own state stays unprocessed. */
+  AxisProcessor axis_processor;
+  CompiledRemap remap;
+  InputState state;
+  /** Connection event / host delay model of the link. */
+  ConnectionTiming timing;
+  /** Relative motion summed for consumers that poll slower than reports arrive. */
+  MotionAccumulator motion;
+  /** Key state the console last turned into key events. */
+  KeyEventDiff console_keys;
+  /** Rumble / LED output reports going back to the device. */
+  OutputReportChannel output;
+  /** Connect / ready / first report / deferred reads done times. */
+  SetupTimes setup;
+  /** From the deferred reads: battery level in % (0xFF = unknown) and PnP ID (0 = unknown). */
+  uint8_t battery_level{0xFF};
+  uint16_t vendor_id{0};
+  uint16_t product_id{0};
+  uint16_t product_version{0};
+  /** Reports counted at the last telemetry snapshot, for its report rate. */
+  uint32_t telemetry_reports{0};
+  /** Set once the device is fully described; the pipeline ignores it until then. */
+  std::atomic<bool> ready{false};
+
+  bool addHandle(uint16_t value_handle, uint8_t report_id, Kind kind) {
+    if (num_handles == MAX_HANDLES) return false;
+    handles[num_handles++] = {value_handle, report_id, kind};
+    return true;
+  }
+
+  const Handle *findHandle(uint16_t value_handle) const {
+    for (uint8_t i = 0; i < num_handles; i++) {
+      if (handles[i].value_handle == value_handle) return &handles[i];
+    }
+    return nullptr;
+  }
+
+  /** Bytes of handle table kept per connection. */
+  static constexpr size_t handleTableBytes() { return sizeof(handles) + sizeof(num_handles); }
+};
+
+/** Fixed set of HidDevice slots, one per possible connection.
+ *
+ *  Slots are filled in by the connect task and read by the BLE host task; a
+ *  slot is only read by the pipeline once its ready flag is set.
+ */
+class HidDeviceTable {
+public:
+  static constexpr size_t MAX_DEVICES = CONFIG_BT_NIMBLE_MAX_CONNECTIONS;
+
+  /** Claim (or reset) the slot for a connection. Returns nullptr if full. */
+  HidDevice *claim(uint16_t conn_handle) {
+    auto device = find(conn_handle);
+    if (!device) device = find(HidDevice::NO_CONNECTION);
+    if (!device) return nullptr;
+    device->ready.store(false, std::memory_order_release);
+    device->conn_handle = conn_handle;
+    device->num_handles = 0;
+    device->sequence = 0;
+    device->report_map = HidReportMap();
+    device->axis_processor.reset();
+    device->remap.reset();
+    device->console_keys.reset();
+    device->motion.reset();
+    device->timing.reset();
+    device->state = InputState();
+    device->state.device = conn_handle;
+    device->output.reset(conn_handle);
+    device->setup.reset(0);
+    device->battery_level = 0xFF;
+    device->vendor_id = 0;
+    device->product_id = 0;
+    device->product_version = 0;
+    device->telemetry_reports = 0;
+    return device;
+  }
+
+  /** Find a device that is ready for the pipeline. */
+  HidDevice *findReady(uint16_t conn_handle) {
+    auto device = find(conn_handle);
+    return device && device->ready.load(std::memory_order_acquire) ? device : nullptr;
+  }
+
+  HidDevice *find(uint16_t conn_handle) {
+    for (auto &device : devices_) {
+      if (device.conn_handle == conn_handle) return &device;
+    }
+    return nullptr;
+  }
+
+  void release(uint16_t conn_handle) {
+    auto device = find(conn_handle);
+    if (!device) return;
+    device->ready.store(false, std::memory_order_release);
+    device->output.stop();
+    device->conn_handle = HidDevice::NO_CONNECTION;
+  }
+
+  /** Call fn(HidDevice&) for every device that is ready. */
+  template <typename F> void forEachReady(F fn) {
+    for (auto &device : devices_) {
+      if (device.ready.load(std::memory_order_acquire)) fn(device);
+    }
+  }
+
+protected:
+  std::array<HidDevice, MAX_DEVICES> devices_;
+};
@@ -0,0 +1,328 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#include "input_state.hpp"
+
+/** Parsed HID report map (report descriptor) and report decoder.
+ *
+ *  The report map read from characteristic 0x2A4B is parsed once at
+ *  connect time into a flat list of input fields. Decoding a report is then
+ *  a walk over the fields of its report ID, extracting each bit field and
+ *  folding it into an InputState. Storage is fixed size so a device costs
+ *  the same no matter how its descriptor is written.
+ *
+ *  Over BLE (HOGP) the report ID is not part of the notification payload;
+ *  it comes from the Report Reference descriptor of the characteristic, so
+ *  decode() takes it as a separate argument.
+ */
+class HidReportMap {
+public:
+  static constexpr size_t MAX_FIELDS = 64;
+  static constexpr size_t MAX_REPORTS = 16;
+  static constexpr size_t MAX_USAGES = 16;
+
+  /** Per report ID summary. */
+  struct ReportInfo {
+    uint8_t id{0};
+    uint16_t input_bits{0};
+    uint16_t output_bits{0};
+    uint32_t buttons_mask{0}; /**< Buttons owned by this report. */
+    bool owns_keys{false};    /**< Report carries keyboard keys. */
+  };
+
+  /** Parse a report map. Returns false if it was malformed or did not fit;
+   *  whatever was parsed up to that point is kept. */
+  bool parse(const uint8_t *data, size_t length) {
+    num_fields_ = 0;
+    num_reports_ = 0;
+    Globals globals;
+    Globals stack[2];
+    size_t stack_depth = 0;
+    Locals locals;
+    bool ok = true;
+
+    size_t pos = 0;
+    while (pos < length) {
+      uint8_t prefix = data[pos++];
+      if (prefix == 0xFE) { // long item, skip it
+        if (pos + 2 > length) return false;
+        pos += 2 + data[pos];
+        continue;
+      }
+      size_t size = prefix & 0x3;
+      if (size == 3) size = 4;
+      if (pos + size > length) return false;
+      uint32_t value = 0;
+      for (size_t i = 0; i < size; i++) value |= (uint32_t)data[pos + i] << (8 * i);
+      int32_t svalue = signExtend(value, size * 8);
+      pos += size;
+
+      uint8_t type = (prefix >> 2) & 0x3;
+      uint8_t tag = prefix >> 4;
+      if (type == 0) { // main
+        if (tag == 0x8) {
+          ok &= addInput(globals, locals, value);
+        } else if (tag == 0x9) {
+          auto r = report(globals.report_id);
+          if (r) r->output_bits += globals.report_size * globals.report_count;
+        }
+        locals = Locals();
+      } else if (type == 1) { // global
+        switch (tag) {
+        case 0x0: globals.usage_page = value; break;
+        case 0x1: globals.logical_min = svalue; break;
+        case 0x2: globals.logical_max = svalue; globals.logical_max_raw = value; break;
+        case 0x7: globals.report_size = value; break;
+        case 0x8: globals.report_id = value; break;
+        case 0x9: globals.report_count = value; break;
+        case 0xA: if (stack_depth < 2) stack[stack_depth++] = globals; break;
+        case 0xB: if (stack_depth > 0) globals = stack[--stack_depth]; break;
+        default: break;
+        }
+      } else if (type == 2) { // local
+        uint16_t page = size == 4 ? value >> 16 : 0;
+        switch (tag) {
+        case 0x0:
+          if (locals.num_usages < MAX_USAGES) {
+            locals.usages[locals.num_usages++] = {page, (uint16_t)value};
+          }
+          break;
+        case 0x1: locals.usage_min = {page, (uint16_t)value}; locals.has_range = true; break;
+        case 0x2: locals.usage_max = {page, (uint16_t)value}; locals.has_range = true; break;
+        default: break;
+        }
+      }
+    }
+    return ok;
+  }
+
+  /** Decode an input report into the device's state. Fields the report
+   *  doesn't carry are left untouched; relative motion is per report. */
+  void decode(uint8_t report_id, const uint8_t *data, size_t length, InputState &state) const {
+    state.motion = {};
+    auto r = findReport(report_id);
+    if (r) {
+      state.buttons &= ~r->buttons_mask;
+      if (r->owns_keys) state.keys = {};
+    }
+    size_t hat = 0;
+    size_t bits = length * 8;
+    for (size_t f = 0; f < num_fields_; f++) {
+      auto &field = fields_[f];
+      if (field.report_id != report_id) continue;
+      for (size_t i = 0; i < field.count; i++) {
+        size_t offset = field.bit_offset + i * field.bit_size;
+        if (offset + field.bit_size > bits) break;
+        uint32_t raw = extract(data, offset, field.bit_size);
+        int32_t value = field.logical_min < 0 ? signExtend(raw, field.bit_size) : (int32_t)raw;
+        if (field.is_array) {
+          int32_t usage = field.usage_min + (value - field.logical_min);
+          if (value >= field.logical_min && value <= field.logical_max && usage > 0) {
+            apply(field, usage, 1, hat, state);
+          }
+        } else {
+          apply(field, field.usage_min + i, value, hat, state);
+        }
+      }
+    }
+    state.report_id = report_id;
+  }
+
+  /** Decode a boot protocol keyboard input report (0x2A22). */
+  static void decodeBootKeyboard(const uint8_t *data, size_t length, InputState &state) {
+    state.keys = {};
+    if (length < 1) return;
+    for (int i = 0; i < 8; i++) {
+      if (data[0] & (1 << i)) state.setKey(0xE0 + i);
+    }
+    for (size_t i = 2; i < std::min<size_t>(length, 8); i++) {
+      if (data[i] > 3) state.setKey(data[i]);
+    }
+  }
+
+  /** Decode a boot protocol mouse input report (0x2A33). */
+  static void decodeBootMouse(const uint8_t *data, size_t length, InputState &state) {
+    state.motion = {};
+    if (length < 3) return;
+    state.buttons = (state.buttons & ~0x7u) | (data[0] & 0x7);
+    state.motion[InputState::DX] = (int8_t)data[1];
+    state.motion[InputState::DY] = (int8_t)data[2];
+    if (length > 3) state.motion[InputState::WHEEL] = (int8_t)data[3];
+  }
+
+  size_t numFields() const { return num_fields_; }
+  size_t numReports() const { return num_reports_; }
+  const ReportInfo &reportInfo(size_t index) const { return reports_[index]; }
+
+  const ReportInfo *findReport(uint8_t id) const {
+    for (size_t i = 0; i < num_reports_; i++) {
+      if (reports_[i].id == id) return &reports_[i];
+    }
+    return nullptr;
+  }
+
+protected:
+  struct Usage {
+    uint16_t page{0};
+    uint16_t id{0};
+  };
+
+  struct Globals {
+    uint16_t usage_page{0};
+    int32_t logical_min{0};
+    int32_t logical_max{0};
+    uint32_t logical_max_raw{0};
+    uint32_t report_size{0};
+    uint32_t report_count{0};
+    uint8_t report_id{0};
+  };
+
+  struct Locals {
+    std::array<Usage, MAX_USAGES> usages{};
+    size_t num_usages{0};
+    Usage usage_min;
+    Usage usage_max;
+    bool has_range{false};
+  };
+
+  struct Field {
+    uint8_t report_id;
+    bool is_array;
+    bool is_relative;
+    uint8_t bit_size;
+    uint16_t bit_offset;
+    uint16_t count;
+    uint16_t usage_page;
+    uint16_t usage_min;
+    int32_t logical_min;
+    int32_t logical_max;
+    uint32_t scale_q16; /**< Maps [logical_min, logical_max] onto 0..65535. */
+  };
+
+  static int32_t signExtend(uint32_t value, size_t bits) {
+    if (bits == 0 || bits >= 32) return (int32_t)value;
+    uint32_t sign = 1u << (bits - 1);
+    return (int32_t)((value ^ sign) - sign);
+  }
+
+  static uint32_t extract(const uint8_t *data, size_t bit_offset, size_t bit_size) {
+    uint32_t value = 0;
+    size_t byte = bit_offset >> 3;
+    size_t shift = bit_offset & 7;
+    size_t nbytes = (shift + bit_size + 7) >> 3;
+    uint64_t acc = 0;
+    for (size_t i = 0; i < nbytes; i++) acc |= (uint64_t)data[byte + i] << (8 * i);
+    value = (uint32_t)(acc >> shift);
+    if (bit_size < 32) value &= (1u << bit_size) - 1;
+    return value;
+  }
+
+  ReportInfo *report(uint8_t id) {
+    for (size_t i = 0; i < num_reports_; i++) {
+      if (reports_[i].id == id) return &reports_[i];
+    }
+    if (num_reports_ == MAX_REPORTS) return nullptr;
+    reports_[num_reports_] = ReportInfo();
+    reports_[num_reports_].id = id;
+    return &reports_[num_reports_++];
+  }
+
+  bool addField(const Globals &g, uint16_t page, uint16_t usage, uint16_t bit_offset,
+                uint16_t count, bool is_array, bool is_relative) {
+    if (num_fields_ == MAX_FIELDS) return false;
+    auto &f = fields_[num_fields_++];
+    f.report_id = g.report_id;
+    f.is_array = is_array;
+    f.is_relative = is_relative;
+    f.bit_size = g.report_size;
+    f.bit_offset = bit_offset;
+    f.count = count;
+    f.usage_page = page ? page : g.usage_page;
+    f.usage_min = usage;
+    f.logical_min = g.logical_min;
+    // many descriptors give an unsigned logical max with a signed encoding
+    f.logical_max = g.logical_max < g.logical_min ? (int32_t)g.logical_max_raw : g.logical_max;
+    int64_t range = (int64_t)f.logical_max - f.logical_min;
+    f.scale_q16 = range > 0 ? (uint32_t)((65535ull << 16) / range) : 0;
+
+    auto r = report(g.report_id);
+    if (r && f.usage_page == 0x09 && !is_array) {
+      for (size_t i = 0; i < count && usage + i >= 1 && usage + i <= 32; i++) {
+        r->buttons_mask |= 1u << (usage + i - 1);
+      }
+    }
+    if (r && f.usage_page == 0x07) r->owns_keys = true;
+    return true;
+  }
+
+  bool addInput(const Globals &g, const Locals &l, uint32_t flags) {
+    auto r = report(g.report_id);
+    if (!r || g.report_size == 0 || g.report_size > 32) return r != nullptr;
+    uint16_t offset = r->input_bits;
+    r->input_bits += g.report_size * g.report_count;
+    bool is_constant = flags & 0x1;
+    bool is_variable = flags & 0x2;
+    bool is_relative = flags & 0x4;
+    if (is_constant) return true; // padding
+    if (!is_variable) {
+      Usage min = l.has_range ? l.usage_min : (l.num_usages ? l.usages[0] : Usage());
+      return addField(g, min.page, min.id, offset, g.report_count, true, is_relative);
+    }
+    if (l.has_range) {
+      return addField(g, l.usage_min.page, l.usage_min.id, offset, g.report_count, false, is_relative);
+    }
+    // one field per explicitly listed usage, the last usage repeats
+    bool ok = true;
+    for (size_t i = 0; i < g.report_count; i++) {
+      auto u = l.num_usages ? l.usages[std::min(i, l.num_usages - 1)] : Usage();
+      ok &= addField(g, u.page, u.id, offset + i * g.report_size, 1, false, is_relative);
+    }
+    return ok;
+  }
+
+  static int16_t scale(const Field &f, int32_t value) {
+    int64_t v = (((int64_t)(value - f.logical_min) * f.scale_q16) >> 16) - 32768;
+    return (int16_t)std::clamp<int64_t>(v, INT16_MIN, INT16_MAX);
+  }
+
+  static void apply(const Field &f, uint32_t usage, int32_t value, size_t &hat, InputState &state) {
+    switch (f.usage_page) {
+    case 0x01: // generic desktop
+      if (usage >= 0x30 && usage <= 0x37) {
+        if (f.is_relative) {
+          if (usage == 0x30) state.motion[InputState::DX] = value;
+          else if (usage == 0x31) state.motion[InputState::DY] = value;
+        } else {
+          state.axes[usage - 0x30] = scale(f, value);
+        }
+      } else if (usage == 0x38) {
+        state.motion[InputState::WHEEL] = value;
+      } else if (usage == 0x39 && hat < InputState::NUM_HATS) {
+        int32_t h = value - f.logical_min;
+        state.hats[hat++] = (h >= 0 && h <= 7) ? h : InputState::HAT_CENTERED;
+      }
+      break;
+    case 0x02: // simulation controls
+      if (usage == 0xC4) state.axes[InputState::ACCELERATOR] = scale(f, value);
+      else if (usage == 0xC5) state.axes[InputState::BRAKE] = scale(f, value);
+      break;
+    case 0x07: // keyboard
+      if (value && usage > 3 && usage <= 0xFF) state.setKey(usage);
+      break;
+    case 0x09: // buttons
+      if (value && usage >= 1 && usage <= 32) state.buttons |= 1u << (usage - 1);
+      break;
+    default:
+      break;
+    }
+  }
+
+  std::array<Field, MAX_FIELDS> fields_;
+  size_t num_fields_{0};
+  std::array<ReportInfo, MAX_REPORTS> reports_;
+  size_t num_reports_{0};
+};
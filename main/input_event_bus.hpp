@@ -0,0 +1,132 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+
+#include "input_state.hpp"
+
+/** Publish / subscribe bus for decoded input state.
+ *
+ *  Events live in a fixed ring of slots. Publishing copies the state into
+ *  the next slot once, and any number of sinks read that same ring, each at
+ *  its own rate, with no queue or buffer per sink; a subscriber only takes
+ *  the one stack copy it needs to read a slot safely (below). Every
+ *  subscriber keeps its own cursor, so a slow
+ *  sink only loses its own events (counted as drops) and never holds back
+ *  the publisher or the other sinks.
+ *
+ *  Each slot carries a sequence word that is cleared while the slot is
+ *  being written and set to the event's index + 1 afterwards, which lets a
+ *  reader detect both "not yet written" and "overwritten while I was
+ *  reading it": the reader copies the slot out and only uses the copy if
+ *  the sequence still matches afterwards. Publishers are serialized with a mutex (so priority
+ *  inheritance applies); subscribers never take it.
+ */
+template <size_t CAPACITY>
+class InputEventBus {
+  static_assert((CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+public:
+  /** A reader of the bus with its own cursor and metrics. */
+  class Subscriber {
+  public:
+    Subscriber(InputEventBus &bus, const char *name)
+      : bus_(bus), name_(name), cursor_(bus.head_.load(std::memory_order_acquire)) {}
+
+    /** Hand every pending event to fn(const InputState&), oldest first, up
+     *  to max_events. Returns how many events were delivered. Events that
+     *  were overwritten before or while they were read are counted as drops
+     *  and never reach fn; fn must not keep the reference past its return. */
+    template <typename F>
+    size_t poll(F &&fn, size_t max_events = CAPACITY) {
+      size_t delivered = 0;
+      uint32_t head = bus_.head_.load(std::memory_order_acquire);
+      uint32_t lag = head - cursor_;
+      if (lag > max_lag_) max_lag_ = lag;
+      if (lag > CAPACITY) {
+        // lapped by the publisher, skip to the oldest event still in the ring
+        dropped_ += lag - CAPACITY;
+        cursor_ = head - CAPACITY;
+      }
+      while (delivered < max_events && cursor_ != head) {
+        auto &slot = bus_.slots_[cursor_ & (CAPACITY - 1)];
+        uint32_t expected = cursor_ + 1;
+        uint32_t seq = slot.sequence.load(std::memory_order_acquire);
+        if (seq == 0 || (int32_t)(seq - expected) < 0) break; // still being written
+        if (seq == expected) {
+          InputState state = slot.state;
+          std::atomic_thread_fence(std::memory_order_acquire);
+          if (slot.sequence.load(std::memory_order_relaxed) == expected) {
+            fn(state);
+            delivered++;
+          } else {
+            dropped_++;
+          }
+        } else {
+          dropped_++;
+        }
+        cursor_++;
+      }
+      delivered_ += delivered;
+      return delivered;
+    }
+
+    /** Events published but not yet consumed by this subscriber. */
+    uint32_t lag() const { return bus_.head_.load(std::memory_order_relaxed) - cursor_; }
+    uint32_t maxLag() const { return max_lag_; }
+    uint32_t dropped() const { return dropped_; }
+    uint32_t delivered() const { return delivered_; }
+    const char *name() const { return name_; }
+
+    void printStats() const {
+      printf("  %-10s delivered %lu, dropped %lu, lag %lu (max %lu)\n", name_,
+             (unsigned long)delivered_, (unsigned long)dropped_,
+             (unsigned long)lag(), (unsigned long)max_lag_);
+    }
+
+  protected:
+    InputEventBus &bus_;
+    const char *name_;
+    uint32_t cursor_;
+    uint32_t max_lag_{0};
+    uint32_t dropped_{0};
+    uint32_t delivered_{0};
+  };
+
+  /** Publish a copy of state. Returns the event's bus index. */
+  uint32_t publish(const InputState &state) {
+    return publish(state, [](InputState &) {});
+  }
+
+  /** Publish a copy of state, letting fixup(InputState&) adjust the copy in
+   *  the slot before subscribers can see it. */
+  template <typename F>
+  uint32_t publish(const InputState &state, F &&fixup) {
+    std::lock_guard<std::mutex> lk(publish_mutex_);
+    uint32_t index = head_.load(std::memory_order_relaxed);
+    auto &slot = slots_[index & (CAPACITY - 1)];
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.state = state;
+    fixup(slot.state);
+    slot.sequence.store(index + 1, std::memory_order_release);
+    head_.store(index + 1, std::memory_order_release);
+    return index;
+  }
+
+  /** Total number of events published. */
+  uint32_t published() const { return head_.load(std::memory_order_relaxed); }
+
+protected:
+  struct Slot {
+    std::atomic<uint32_t> sequence{0};
+    InputState state;
+  };
+
+  std::mutex publish_mutex_;
+  std::atomic<uint32_t> head_{0};
+  std::array<Slot, CAPACITY> slots_;
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#include "input_state.hpp"
+
+/** A per controller model remap, as written by hand.
+ *
+ *  Buttons are numbered from 0 (Button page usage 1). Axes use the
+ *  InputState::Axis order.
+ */
+struct RemapProfile {
+  static constexpr uint8_t DROP = 0xFF;
+
+  const char *name;
+  /** Matched against the advertised device name; nullptr matches anything. */
+  const char *name_match;
+  /** Keep buttons where they are; when false, buttons is used instead. */
+  bool identity_buttons{true};
+  /** Destination button of each source button, DROP to discard it. */
+  std::array<uint8_t, 32> buttons{};
+  /** Source axis of each destination axis. */
+  std::array<uint8_t, InputState::NUM_AXES> axes{0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+  uint16_t invert_axes{0};  /**< Bit per destination axis. */
+  uint32_t turbo{0};        /**< Destination buttons that auto-repeat while held. */
+  uint8_t turbo_shift{2};   /**< Turbo toggles every 2^turbo_shift reports. */
+  uint32_t toggle{0};       /**< Destination buttons that latch on each press. */
+};
+
+/** A RemapProfile compiled into lookup tables for the report path.
+ *
+ *  Applying it is the same fixed sequence of operations for every report,
+ *  with no branches on the profile contents:
+ *   - buttons: eight nibble lookups OR'd together (a 32-bit permutation),
+ *   - axes: one gather and one XOR per axis (XOR with -1 is ~x, which
+ *     inverts an int16_t without overflowing at -32768),
+ *   - turbo: AND with a mask derived from the report counter,
+ *   - toggle: edge detect and latch with AND / XOR.
+ *  The nibble tables cost 512 B per device instead of 4 kB for byte tables.
+ */
+class CompiledRemap {
+public:
+  CompiledRemap() { compile(RemapProfile{"identity", nullptr}); }
+
+  void compile(const RemapProfile &profile) {
+    name_ = profile.name;
+    for (size_t nibble = 0; nibble < 8; nibble++) {
+      for (uint32_t value = 0; value < 16; value++) {
+        uint32_t out = 0;
+        for (size_t bit = 0; bit < 4; bit++) {
+          if (!(value & (1u << bit))) continue;
+          size_t src = nibble * 4 + bit;
+          uint8_t dst = profile.identity_buttons ? src : profile.buttons[src];
+          if (dst < 32) out |= 1u << dst;
+        }
+        button_lut_[nibble][value] = out;
+      }
+    }
+    for (size_t i = 0; i < InputState::NUM_AXES; i++) {
+      axis_src_[i] = profile.axes[i] < InputState::NUM_AXES ? profile.axes[i] : i;
+      axis_xor_[i] = (profile.invert_axes >> i) & 1 ? -1 : 0;
+    }
+    turbo_ = profile.turbo;
+    turbo_shift_ = profile.turbo_shift;
+    toggle_ = profile.toggle;
+    reset();
+  }
+
+  /** Clear the per device turbo / toggle state, e.g. on reconnect. */
+  void reset() {
+    counter_ = 0;
+    prev_ = 0;
+    latched_ = 0;
+  }
+
+  /** Remap state in place. */
+  void apply(InputState &state) {
+    uint32_t b = state.buttons;
+    uint32_t out = button_lut_[0][b & 0xF] | button_lut_[1][(b >> 4) & 0xF] |
+                   button_lut_[2][(b >> 8) & 0xF] | button_lut_[3][(b >> 12) & 0xF] |
+                   button_lut_[4][(b >> 16) & 0xF] | button_lut_[5][(b >> 20) & 0xF] |
+                   button_lut_[6][(b >> 24) & 0xF] | button_lut_[7][(b >> 28) & 0xF];
+    // turbo: drop the turbo buttons on every other phase
+    uint32_t phase = -((counter_++ >> turbo_shift_) & 1);
+    out &= ~(turbo_ & phase);
+    // toggle: flip the latch on each rising edge
+    latched_ ^= out & ~prev_ & toggle_;
+    prev_ = out;
+    state.buttons = (out & ~toggle_) | latched_;
+
+    std::array<int16_t, InputState::NUM_AXES> axes = state.axes;
+    for (size_t i = 0; i < InputState::NUM_AXES; i++) {
+      state.axes[i] = axes[axis_src_[i]] ^ axis_xor_[i];
+    }
+  }
+
+  const char *name() const { return name_; }
+
+protected:
+  const char *name_{nullptr};
+  uint32_t button_lut_[8][16];
+  std::array<uint8_t, InputState::NUM_AXES> axis_src_;
+  std::array<int16_t, InputState::NUM_AXES> axis_xor_;
+  uint32_t turbo_{0};
+  uint8_t turbo_shift_{0};
+  uint32_t toggle_{0};
+  uint32_t counter_{0};
+  uint32_t prev_{0};
+  uint32_t latched_{0};
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+/** Canonical, decoded input state of a single HID device.
+ *
+ *  Every report a device sends is decoded into this one layout regardless
+ *  of the device's report map, so sinks never have to look at raw reports.
+ *  It always holds the full state of the device, not just the fields of the
+ *  last report.
+ */
+struct InputState {
+  /** Absolute axes: Generic Desktop X..Dial followed by the Simulation
+   *  accelerator / brake, scaled to the full int16_t range. */
+  enum Axis : uint8_t {
+    X, Y, Z, RX, RY, RZ, SLIDER, DIAL, ACCELERATOR, BRAKE,
+    NUM_AXES,
+  };
+
+  /** Relative motion, as sent by mice. */
+  enum Motion : uint8_t {
+    DX, DY, WHEEL,
+    NUM_MOTION,
+  };
+
+  static constexpr size_t NUM_HATS = 2;
+  static constexpr uint8_t HAT_CENTERED = 0x0F;
+
+  uint16_t device{0};         /**< Connection handle of the device. */
+  uint8_t report_id{0};       /**< Report that produced this state. */
+  uint32_t sequence{0};       /**< Per-device sequence number. */
+  int64_t timestamp_us{0};    /**< When the report was received. */
+  int64_t event_us{0};        /**< Connection event it was sent in (estimated, see ConnectionTiming). */
+  uint32_t buttons{0};        /**< Bit n = Button page usage n + 1. */
+  std::array<int16_t, NUM_AXES> axes{};
+  std::array<int16_t, NUM_MOTION> motion{};
+  std::array<uint8_t, NUM_HATS> hats{HAT_CENTERED, HAT_CENTERED};
+  std::array<uint64_t, 4> keys{}; /**< Keyboard page usage bitmap, modifiers are 0xE0-0xE7. */
+
+  bool keyDown(uint8_t usage) const { return (keys[usage >> 6] >> (usage & 63)) & 1; }
+  void setKey(uint8_t usage) { keys[usage >> 6] |= 1ull << (usage & 63); }
+};
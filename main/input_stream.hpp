@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+#include "esp_timer.h"
+
+#include "input_state.hpp"
+#include "input_stream_protocol.hpp"
+#include "stream_link.hpp"
+
+/** Sends decoded input state to another MCU as framed binary records.
+ *
+ *  Events are added to the back frame buffer as they are polled off the
+ *  bus; once per frame tick flush() closes the frame and hands it to the
+ *  link while the other buffer becomes the back buffer. Ticks without
+ *  events send nothing. See input_stream_protocol.hpp for the format.
+ */
+class InputStream {
+public:
+  static_assert(input_stream::NUM_AXES == InputState::NUM_AXES, "wire format axis count mismatch");
+
+  /** Largest number of events that always fits in one frame. */
+  static constexpr size_t MAX_EVENTS_PER_FRAME = input_stream::MAX_PAYLOAD / input_stream::MAX_RECORD_SIZE;
+
+  explicit InputStream(StreamLink *link) : link_(link) {
+    writer_.begin(buffers_[back_]);
+  }
+
+  bool start() { return link_->start(); }
+
+  /** Add one event to the current frame. */
+  bool add(const InputState &state) {
+    input_stream::Record record;
+    record.device = state.device;
+    record.report_id = state.report_id;
+    record.flags = 0;
+    record.sequence = state.sequence;
+    record.timestamp_us = state.timestamp_us;
+    record.buttons = state.buttons;
+    for (size_t i = 0; i < InputState::NUM_AXES; i++) record.axes[i] = state.axes[i];
+    for (size_t i = 0; i < InputState::NUM_MOTION; i++) record.motion[i] = state.motion[i];
+    record.hats[0] = state.hats[0];
+    record.hats[1] = state.hats[1];
+    bool has_keys = (state.keys[0] | state.keys[1] | state.keys[2] | state.keys[3]) != 0;
+    if (!writer_.add(record, has_keys ? (const uint8_t *)state.keys.data() : nullptr)) {
+      overflows_++;
+      return false;
+    }
+    return true;
+  }
+
+  /** Close the current frame and start sending it. */
+  void flush() {
+    if (!writer_.numRecords()) return;
+    size_t records = writer_.numRecords();
+    size_t length = writer_.finish(sequence_++, (uint32_t)esp_timer_get_time());
+    if (link_->send(buffers_[back_], length)) {
+      frames_++;
+      records_ += records;
+      bytes_ += length;
+    } else {
+      send_errors_++;
+    }
+    back_ ^= 1;
+    writer_.begin(buffers_[back_]);
+  }
+
+  void printStats() const {
+    printf("Input stream: %lu frames, %lu events, %lu B, %lu send errors, %lu overflows\n",
+           (unsigned long)frames_, (unsigned long)records_, (unsigned long)bytes_,
+           (unsigned long)send_errors_, (unsigned long)overflows_);
+  }
+
+protected:
+  StreamLink *link_;
+  /** Static instances keep these in internal RAM, as DMA needs */
+  alignas(4) uint8_t buffers_[2][input_stream::MAX_FRAME_SIZE];
+  size_t back_{0};
+  input_stream::FrameWriter writer_;
+  uint16_t sequence_{0};
+  uint32_t frames_{0};
+  uint32_t records_{0};
+  uint32_t bytes_{0};
+  uint32_t send_errors_{0};
+  uint32_t overflows_{0};
+};
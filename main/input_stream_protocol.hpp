@@ -0,0 +1,124 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/** Wire format of the binary input stream, shared by the firmware and the
+ *  receiver library in tools/input_stream.
+ *
+ *  A frame carries every input event of one frame tick:
+ *
+ *    sync     2 B   0xA5 0x5A
+ *    length   2 B   bytes of records
+ *    sequence 2 B   frame counter, a gap means frames were lost
+ *    time     4 B   sender esp_timer_get_time() at the tick, low 32 bits (us)
+ *    records  length B
+ *    crc      2 B   CRC-16/CCITT-FALSE over length .. end of records
+ *
+ *  Each record is a Record, followed by the 32 B key bitmap when
+ *  HAS_KEYS is set. Everything is little endian. The header is 10 B so
+ *  records, and a sender's frame buffer, stay 2 byte aligned.
+ */
+namespace input_stream {
+
+static constexpr uint8_t SYNC[2] = {0xA5, 0x5A};
+static constexpr size_t HEADER_SIZE = 10;
+static constexpr size_t CRC_SIZE = 2;
+static constexpr size_t MAX_PAYLOAD = 1024;
+static constexpr size_t MAX_FRAME_SIZE = HEADER_SIZE + MAX_PAYLOAD + CRC_SIZE;
+static constexpr size_t NUM_AXES = 10;
+static constexpr size_t KEYS_SIZE = 32;
+
+enum RecordFlags : uint8_t {
+  HAS_KEYS = 0x01, /**< A 256-bit key bitmap (bit = HID keyboard usage) follows. */
+};
+
+/** One decoded input event. */
+struct __attribute__((packed)) Record {
+  uint16_t device;       /**< BLE connection handle. */
+  uint8_t report_id;
+  uint8_t flags;         /**< RecordFlags. */
+  uint32_t sequence;     /**< Per device event counter. */
+  uint32_t timestamp_us; /**< Receive time of the report, low 32 bits. */
+  uint32_t buttons;
+  int16_t axes[NUM_AXES];
+  int16_t motion[3];     /**< dx, dy, wheel. */
+  uint8_t hats[2];
+};
+
+static constexpr size_t MAX_RECORD_SIZE = sizeof(Record) + KEYS_SIZE;
+
+/** CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF), table driven. */
+static inline uint16_t crc16(const uint8_t *data, size_t length, uint16_t crc = 0xFFFF) {
+  static constexpr auto TABLE = [] {
+    std::array<uint16_t, 256> table{};
+    for (uint32_t i = 0; i < 256; i++) {
+      uint16_t c = i << 8;
+      for (int bit = 0; bit < 8; bit++) c = (c & 0x8000) ? (c << 1) ^ 0x1021 : c << 1;
+      table[i] = c;
+    }
+    return table;
+  }();
+  for (size_t i = 0; i < length; i++) crc = (crc << 8) ^ TABLE[((crc >> 8) ^ data[i]) & 0xFF];
+  return crc;
+}
+
+/** Builds one frame in place in a caller provided buffer of at least
+ *  MAX_FRAME_SIZE bytes: records are appended after room for the header,
+ *  and finish() fills in the header and CRC. */
+class FrameWriter {
+public:
+  void begin(uint8_t *buffer) {
+    buffer_ = buffer;
+    length_ = 0;
+    num_records_ = 0;
+  }
+
+  /** Append a record; keys may be nullptr. False if the frame is full. */
+  bool add(const Record &record, const uint8_t *keys) {
+    size_t size = sizeof(Record) + (keys ? KEYS_SIZE : 0);
+    if (length_ + size > MAX_PAYLOAD) return false;
+    uint8_t *out = buffer_ + HEADER_SIZE + length_;
+    memcpy(out, &record, sizeof(Record));
+    if (keys) {
+      out[offsetof(Record, flags)] |= HAS_KEYS;
+      memcpy(out + sizeof(Record), keys, KEYS_SIZE);
+    }
+    length_ += size;
+    num_records_++;
+    return true;
+  }
+
+  /** Fill in the header and CRC; returns the frame's total size. */
+  size_t finish(uint16_t sequence, uint32_t timestamp_us) {
+    buffer_[0] = SYNC[0];
+    buffer_[1] = SYNC[1];
+    put16(buffer_ + 2, length_);
+    put16(buffer_ + 4, sequence);
+    put32(buffer_ + 6, timestamp_us);
+    uint16_t crc = crc16(buffer_ + 2, HEADER_SIZE - 2 + length_);
+    put16(buffer_ + HEADER_SIZE + length_, crc);
+    return HEADER_SIZE + length_ + CRC_SIZE;
+  }
+
+  size_t numRecords() const { return num_records_; }
+  size_t payloadLength() const { return length_; }
+
+protected:
+  static void put16(uint8_t *p, uint16_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+  }
+  static void put32(uint8_t *p, uint32_t v) {
+    put16(p, v);
+    put16(p + 2, v >> 16);
+  }
+
+  uint8_t *buffer_{nullptr};
+  size_t length_{0};
+  size_t num_records_{0};
+};
+
+} // namespace input_stream
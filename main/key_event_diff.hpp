@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/** A key going down or up. usage is the Keyboard page usage; modifiers
+ *  are 0xE0-0xE7. */
+struct KeyEvent {
+  uint8_t usage;
+  bool down;
+};
+
+/** Turns successive keyboard snapshots into key down / up events.
+ *
+ *  Works on the 256-bit key bitmap of InputState (boot and NKRO reports
+ *  are both decoded into it), 64 keys at a time: XOR with the previous
+ *  bitmap gives the changed keys, AND with the new / old bitmap splits them
+ *  into downs and ups, and count-trailing-zeros walks the set bits. The
+ *  cost follows the number of changed keys, not the report size. Because
+ *  it compares snapshots, a consumer that missed events still ends up with
+ *  the right key state.
+ */
+class KeyEventDiff {
+public:
+  typedef std::array<uint64_t, 4> Bitmap;
+
+  /** Most events one update can produce: every key changing. */
+  static constexpr size_t MAX_EVENTS = 256;
+
+  void reset() { prev_ = {}; }
+
+  /** Diff against the previous bitmap. Writes the events to out (room for
+   *  MAX_EVENTS), ups first and then downs, each in usage order, and
+   *  returns how many there were. */
+  size_t update(const Bitmap &keys, KeyEvent *out) {
+    Bitmap changed;
+    for (size_t w = 0; w < 4; w++) changed[w] = keys[w] ^ prev_[w];
+    size_t n = 0;
+    for (size_t w = 0; w < 4; w++) n = emit(changed[w] & prev_[w], w, false, out, n);
+    for (size_t w = 0; w < 4; w++) n = emit(changed[w] & keys[w], w, true, out, n);
+    prev_ = keys;
+    return n;
+  }
+
+  const Bitmap &keys() const { return prev_; }
+
+protected:
+  static size_t emit(uint64_t bits, size_t word, bool down, KeyEvent *out, size_t n) {
+    while (bits) {
+      out[n++] = {(uint8_t)(word * 64 + __builtin_ctzll(bits)), down};
+      bits &= bits - 1;
+    }
+    return n;
+  }
+
+  Bitmap prev_{};
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+#include "probe_pin.hpp"
+
+/** Marks pipeline stages on output pins for a logic analyzer.
+ *
+ *  Each stage can have its own pin. In PULSE mode every mark is a single
+ *  2 us pulse; in ID mode it is a start pulse followed by a 16-bit word
+ *  (MSB first) saying which device, report and stage it was:
+ *
+ *    device (5 bits) | stage (3 bits) | report ID (8 bits)
+ *
+ *  with pulse widths of 4 us for start, 1 us for a 0 and 2 us for a 1, each
+ *  followed by 1 us low. The leading edge is what to measure latency from;
+ *  the rest of the train tells marks apart. Pins time the edges in
+ *  hardware, so an edge follows mark() by a fixed delay instead of by
+ *  however long a task takes to get scheduled.
+ *
+ *  mark() for a given stage must only be called from one task at a time;
+ *  different stages are marked from different tasks.
+ */
+class LogicProbe {
+public:
+  enum class Stage : uint8_t {
+    RECEIVED,  /**< Notification reached the transport boundary. */
+    PUBLISHED, /**< Decoded state published on the input bus. */
+    FORWARDED, /**< Report handed to the USB endpoint. */
+    COUNT,
+  };
+
+  enum class Mode : uint8_t {
+    PULSE,
+    ID,
+  };
+
+  /** Decoded contents of an ID mode mark. */
+  struct Code {
+    uint8_t device;
+    Stage stage;
+    uint8_t report_id;
+  };
+
+  static constexpr uint32_t TICK_HZ = 2000000; // 0.5 us
+  static constexpr size_t ID_BITS = 16;
+  static constexpr size_t MAX_PULSES = 1 + ID_BITS;
+  static constexpr ProbePin::Pulse MARK = {4, 2};
+  static constexpr ProbePin::Pulse START = {8, 2};
+  static constexpr ProbePin::Pulse ZERO = {2, 2};
+  static constexpr ProbePin::Pulse ONE = {4, 2};
+
+  explicit LogicProbe(Mode mode = Mode::PULSE) : mode_(mode) {}
+
+  void attach(Stage stage, ProbePin *pin) { pins_[(size_t)stage] = pin; }
+
+  void mark(Stage stage, uint16_t device, uint8_t report_id) {
+    auto pin = pins_[(size_t)stage];
+    if (!pin) return;
+    ProbePin::Pulse pulses[MAX_PULSES];
+    size_t count = encode(mode_, {(uint8_t)device, stage, report_id}, pulses);
+    if (pin->transmit(pulses, count)) {
+      marks_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      busy_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  static size_t encode(Mode mode, const Code &code, ProbePin::Pulse *out) {
+    if (mode == Mode::PULSE) {
+      out[0] = MARK;
+      return 1;
+    }
+    uint16_t word = ((code.device & 0x1F) << 11) | (((uint8_t)code.stage & 0x7) << 8) | code.report_id;
+    out[0] = START;
+    for (size_t i = 0; i < ID_BITS; i++) {
+      out[1 + i] = (word >> (ID_BITS - 1 - i)) & 1 ? ONE : ZERO;
+    }
+    return MAX_PULSES;
+  }
+
+  /** Decode an ID mode pulse train, as measured by a mock pin or an
+   *  analyzer (in ticks). Widths are matched to the nearest symbol. */
+  static bool decode(const ProbePin::Pulse *pulses, size_t count, Code &code) {
+    if (count != MAX_PULSES || pulses[0].high < (START.high + ONE.high) / 2) return false;
+    uint16_t word = 0;
+    for (size_t i = 0; i < ID_BITS; i++) {
+      auto high = pulses[1 + i].high;
+      if (high >= (START.high + ONE.high) / 2) return false;
+      word = (word << 1) | (high >= (ONE.high + ZERO.high) / 2 ? 1 : 0);
+    }
+    code.device = word >> 11;
+    code.stage = (Stage)((word >> 8) & 0x7);
+    code.report_id = word & 0xFF;
+    return true;
+  }
+
+  /** Marks sent, and marks skipped because their pin was busy. */
+  uint32_t marks() const { return marks_.load(std::memory_order_relaxed); }
+  uint32_t busy() const { return busy_.load(std::memory_order_relaxed); }
+
+  void printStats() const {
+    printf("Logic probe (%s): %lu marks, %lu skipped while busy\n", mode_ == Mode::ID ? "id" : "pulse",
+           (unsigned long)marks(), (unsigned long)busy());
+  }
+
+protected:
+  Mode mode_;
+  std::array<ProbePin *, (size_t)Stage::COUNT> pins_{};
+  std::atomic<uint32_t> marks_{0};
+  std::atomic<uint32_t> busy_{0};
+};
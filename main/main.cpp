@@ -7,23 +7,369 @@
  *      Author: H2zero
  * 
  */
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
 #include <NimBLEDevice.h>
+#include "freertos/queue.h"
 
 #include "format.hpp"
 
-#include "driver/gpio.h"
+#if CONFIG_HID_HOST_BONDING
+#include "bond_lru.hpp"
+#include "smp_timing.hpp"
+#endif
+#include "advertiser_cache.hpp"
+#include "connection_history.hpp"
+#include "fault_injector.hpp"
+#include "heap_tracker.hpp"
+#include "hid_device.hpp"
+#include "input_event_bus.hpp"
+#if CONFIG_HID_HOST_PROBE
+#include "logic_probe.hpp"
+#include "rmt_probe_pin.hpp"
+#endif
+#include "perf_profiles.hpp"
+#include "power_control.hpp"
+#include "remap_profiles.hpp"
+#include "scan_scheduler.hpp"
+#if CONFIG_HID_HOST_STACK_MONITOR
+#include "stack_monitor.hpp"
+#endif
+#include "stats_console.hpp"
+#include "task_monitor.hpp"
+#if CONFIG_HID_HOST_TELEMETRY
+#include "esp_mac.h"
+#include "telemetry.hpp"
+#if CONFIG_HID_HOST_TELEMETRY_UART
+#include "uart_stream_link.hpp"
+#endif
+#endif
+#if CONFIG_HID_HOST_BENCHMARKS
+#include "benchmarks.hpp"
+#endif
+#if CONFIG_HID_HOST_STATIC_ALLOCATION
+#include "allocation_guard.hpp"
+#endif
+#if CONFIG_HID_HOST_SOAK
+#include "soak_source.hpp"
+#endif
+#if CONFIG_HID_HOST_USB_PASSTHROUGH
+#include "tinyusb_hid_endpoint.hpp"
+#include "usb_passthrough.hpp"
+#endif
+#if CONFIG_HID_HOST_INPUT_STREAM
+#include "input_stream.hpp"
+#if CONFIG_HID_HOST_INPUT_STREAM_SPI
+#include "spi_stream_link.hpp"
+#else
+#include "uart_stream_link.hpp"
+#endif
+#endif
 
 extern "C" {void app_main(void);}
 
-static NimBLEAdvertisedDevice* advDevice;
+/** The device to connect to: a copy, since NimBLE keeps no scan results */
+static NimBLEAddress advAddress;
+static char advName[32];
 
 static bool doConnect = false;
+/** Set while the connect task is setting up a device, deferred setup included */
+static std::atomic<bool> connecting{false};
 static uint32_t scanTime = 0; /** scan time in milliseconds, 0 = scan forever */
-static constexpr size_t RECV_GPIO = 21;
-static int pin_level = 0;
+
+/** Largest notification we copy out of the mbuf in compact attribute mode */
+static constexpr size_t MAX_NOTIFY_SIZE = 128;
+
+static HeapTracker heap_tracker;
+
+/** Where each task runs, see Kconfig -> Task Topology */
+#if CONFIG_HID_HOST_TASK_TOPOLOGY
+static constexpr BaseType_t CONNECT_CORE = CONFIG_HID_HOST_CONNECT_CORE;
+static constexpr BaseType_t PIPELINE_CORE = CONFIG_HID_HOST_PIPELINE_CORE;
+static constexpr BaseType_t LOGGING_CORE = CONFIG_HID_HOST_LOGGING_CORE;
+#else
+static constexpr BaseType_t CONNECT_CORE = tskNO_AFFINITY;
+static constexpr BaseType_t PIPELINE_CORE = tskNO_AFFINITY;
+static constexpr BaseType_t LOGGING_CORE = tskNO_AFFINITY;
+#endif
+/** Logging gets the lowest priority, device setup one above it */
+static constexpr UBaseType_t LOGGING_PRIORITY = tskIDLE_PRIORITY + 1;
+static constexpr UBaseType_t CONNECT_PRIORITY = tskIDLE_PRIORITY + 2;
+
+#if CONFIG_HID_HOST_TASK_STATS
+static TaskMonitor task_monitor;
+#endif
+#if CONFIG_HID_HOST_STACK_MONITOR
+/** Peak stack use of every task, for sizing the stacks */
+static StackMonitor stack_monitor(CONFIG_HID_HOST_STACK_MARGIN_PERCENT);
+#endif
+#if CONFIG_HID_HOST_BONDING
+/** Which bond to give up when the bond store is full */
+static BondLru bond_lru;
+/** Securing a link: full pairing vs restarting encryption with stored keys */
+static LatencyStats pairing_time("pairing", 1000);
+static LatencyStats encryption_restart_time("encryption restart", 1000);
+/** Where that time goes, per SMP phase */
+static SmpTiming smp_timing;
+#endif
+/** From receiving a report to the pipeline being done with it */
+static LatencyStats report_latency("report path");
+
+/** The performance profile in use, see perf_profiles.hpp */
+static std::atomic<size_t> perf_profile{0};
+/** A profile to apply, set by the console; -1 for none. The connect task
+ *  applies it, as it is the one changing the scan and the client list */
+static std::atomic<int> perf_profile_request{-1};
+static PowerControl power_control;
+/** Report path latency under each profile, to compare them */
+static LatencyStats profile_latency[] = {
+  LatencyStats("report path (low-latency)"),
+  LatencyStats("report path (efficient)"),
+};
+static_assert(sizeof(profile_latency) / sizeof(profile_latency[0]) == NUM_PERF_PROFILES);
+
+/** Connection timing with and without a scan running, and when the latest
+ *  input arrived */
+static ScanImpact scan_impact;
+static std::atomic<int64_t> last_input_us{0};
+#if CONFIG_HID_HOST_SCAN_SCHEDULER
+/** Scan timing around the connections, see Kconfig -> Scan Scheduling */
+static ScanScheduler scan_scheduler({
+    .reserve_us = CONFIG_HID_HOST_SCAN_RESERVE_US,
+#if CONFIG_HID_HOST_SCAN_PAUSE_WHILE_ACTIVE
+    .pause_while_active = true,
+    .activity_holdoff_ms = CONFIG_HID_HOST_SCAN_ACTIVITY_HOLDOFF_MS,
+    .max_pause_ms = CONFIG_HID_HOST_SCAN_MAX_PAUSE_MS,
+#else
+    .pause_while_active = false,
+    .activity_holdoff_ms = 0,
+    .max_pause_ms = 0,
+#endif
+  });
+/** Whether we are looking for devices at all, and whether the next scan
+ *  starts afresh; the connect task starts and stops the scans */
+static std::atomic<bool> scan_wanted{false};
+static std::atomic<bool> scan_fresh{false};
+#endif
+
+/** The scan mode from the console, overriding the profile's until the
+ *  next reboot (COUNT: none); see scan_mode.hpp */
+static std::atomic<ScanMode> scan_mode_override{ScanMode::COUNT};
+/** Candidates an on-demand scan still asks for a scan response, and
+ *  whether the active burst that asks them is running */
+static ScanEscalation scan_escalation(CONFIG_HID_HOST_SCAN_ESCALATION_COOLDOWN_MS);
+static std::atomic<bool> scan_escalated{false};
+static ScanModeStats scan_mode_stats;
+/** Every advertiser in range, in a fixed size, see Kconfig -> Advertiser Cache */
+static AdvertiserCache<CONFIG_HID_HOST_ADV_CACHE_SIZE> adv_cache;
+#if CONFIG_HID_HOST_SOAK_ADVERTISERS
+static AdvertiserChurn<decltype(adv_cache)> advertiser_churn(adv_cache, CONFIG_HID_HOST_SOAK_ADVERTISER_POOL);
+#endif
+/** When we started looking for a device, for the discovery time */
+static std::atomic<int64_t> discovery_start_us{0};
+#if CONFIG_BT_NIMBLE_EXT_ADV
+/** Whether devices are found from extended advertisements too, or (as
+ *  without BLE 5) from legacy ones only; switchable from the console to
+ *  compare the discovery times */
+static std::atomic<bool> scan_extended{CONFIG_HID_HOST_SCAN_EXTENDED};
+static LatencyStats discovery_time[] = {
+  LatencyStats("discovery (legacy only)", 1000),
+  LatencyStats("discovery (extended)", 1000),
+};
+static std::atomic<uint32_t> extended_reports{0};
+static std::atomic<uint32_t> extended_discoveries{0};
+#endif
+
+static ScanMode scanMode() {
+  auto mode = scan_mode_override.load(std::memory_order_relaxed);
+  return mode != ScanMode::COUNT ? mode : PERF_PROFILES[perf_profile.load(std::memory_order_relaxed)].scan_mode;
+}
+#if CONFIG_HID_HOST_PIPELINE_TASK
+/** From queueing a report to the pipeline task picking it up */
+static LatencyStats wakeup_latency("pipeline wake-up");
+
+/** A report on its way from the BLE host task to the pipeline task */
+struct QueuedReport {
+  uint16_t conn_handle;
+  uint16_t char_handle;
+  uint16_t length;
+  int64_t rx_us;
+  uint8_t data[MAX_NOTIFY_SIZE];
+};
+static StaticQueue_t pipeline_queue_storage;
+static uint8_t pipeline_queue_items[CONFIG_HID_HOST_PIPELINE_QUEUE_LENGTH * sizeof(QueuedReport)];
+static QueueHandle_t pipeline_queue;
+static std::atomic<uint32_t> pipeline_drops{0};
+/** Most reports ever waiting in the queue */
+static std::atomic<uint32_t> pipeline_queue_max{0};
+#endif
+/** What became of the last connection attempts */
+static ConnectionHistory connection_history;
+/** Links lost since boot, whatever the reason */
+static std::atomic<uint32_t> disconnect_count{0};
+
+#if CONFIG_HID_HOST_PROBE
+/** Hardware timed marks of the pipeline stages, one pin per stage */
+static LogicProbe probe(
+#if CONFIG_HID_HOST_PROBE_MODE_ID
+    LogicProbe::Mode::ID
+#else
+    LogicProbe::Mode::PULSE
+#endif
+  );
+static RmtProbePin probe_pins[] = {
+  RmtProbePin(CONFIG_HID_HOST_PROBE_RECEIVED_GPIO),
+  RmtProbePin(CONFIG_HID_HOST_PROBE_PUBLISHED_GPIO),
+  RmtProbePin(CONFIG_HID_HOST_PROBE_FORWARDED_GPIO),
+};
+static_assert(sizeof(probe_pins) / sizeof(probe_pins[0]) == (size_t)LogicProbe::Stage::COUNT);
+#endif
+static HidDeviceTable devices;
+static struct ble_gap_event_listener gap_event_listener;
+
+/** Decoded input state of every device goes out on this bus */
+static InputEventBus<CONFIG_HID_HOST_BUS_CAPACITY> input_bus;
+/** Prints decoded input from the connect task instead of the BLE host task */
+static decltype(input_bus)::Subscriber console_sink(input_bus, "console");
+
+#if CONFIG_HID_HOST_USB_PASSTHROUGH
+static void onUsbEndpointFree();
+static void onUsbOutputReport(uint8_t report_id, const uint8_t* data, size_t length);
+/** Forwards input reports to the native USB port as a HID device */
+static TinyUsbHidEndpoint usb_endpoint(onUsbEndpointFree, onUsbOutputReport);
+static UsbPassthrough usb_passthrough({
+    .endpoint = &usb_endpoint,
+#if CONFIG_HID_HOST_USB_PASSTHROUGH_NORMALIZED
+    .mode = UsbPassthrough::Mode::NORMALIZED,
+#else
+    .mode = UsbPassthrough::Mode::RAW,
+#endif
+  });
+static void onUsbEndpointFree() { usb_passthrough.onEndpointFree(); }
+/** LED / rumble output from the USB host goes back to the forwarded device */
+static void onUsbOutputReport(uint8_t report_id, const uint8_t* data, size_t length) {
+  auto device = devices.findReady(usb_passthrough.connection());
+  if (device) {
+    device->output.submit(report_id, data, length);
+  }
+}
+#if CONFIG_HID_HOST_USB_PASSTHROUGH_NORMALIZED
+/** Polled right after each publish so normalized passthrough adds no latency */
+static decltype(input_bus)::Subscriber usb_sink(input_bus, "usb");
+#endif
+#endif
+
+#if CONFIG_HID_HOST_INPUT_STREAM
+/** Streams decoded input to another MCU, one frame per tick */
+#if CONFIG_HID_HOST_INPUT_STREAM_SPI
+static SpiStreamLink stream_link({
+    .host = SPI2_HOST,
+    .mosi_pin = CONFIG_HID_HOST_INPUT_STREAM_SPI_MOSI_GPIO,
+    .sclk_pin = CONFIG_HID_HOST_INPUT_STREAM_SPI_SCLK_GPIO,
+    .cs_pin = CONFIG_HID_HOST_INPUT_STREAM_SPI_CS_GPIO,
+    .clock_hz = CONFIG_HID_HOST_INPUT_STREAM_SPI_CLOCK_HZ,
+  });
+#else
+static UartStreamLink stream_link({
+    .port = CONFIG_HID_HOST_INPUT_STREAM_UART_PORT,
+    .tx_pin = CONFIG_HID_HOST_INPUT_STREAM_UART_TX_GPIO,
+    .baud_rate = CONFIG_HID_HOST_INPUT_STREAM_UART_BAUD,
+    .max_frame_size = input_stream::MAX_FRAME_SIZE,
+  });
+#endif
+static InputStream input_stream(&stream_link);
+static decltype(input_bus)::Subscriber stream_sink(input_bus, "stream");
+#endif
+
+#if CONFIG_HID_HOST_TELEMETRY
+/** Periodic binary snapshots of the statistics, see Kconfig -> Telemetry */
+#if CONFIG_HID_HOST_TELEMETRY_UART
+static UartStreamLink telemetry_link({
+    .port = CONFIG_HID_HOST_TELEMETRY_UART_PORT,
+    .tx_pin = CONFIG_HID_HOST_TELEMETRY_UART_TX_GPIO,
+    .baud_rate = CONFIG_HID_HOST_TELEMETRY_UART_BAUD,
+    .max_frame_size = telemetry::MAX_FRAME_SIZE,
+  });
+static Telemetry telemetry_sink(&telemetry_link);
+#else
+static Telemetry telemetry_sink;
+#endif
+#endif
+
+static void handleInputReport(uint16_t conn_handle, uint16_t char_handle, const uint8_t* pData, size_t length);
+static void onTransportReport(uint16_t conn_handle, uint16_t char_handle, const uint8_t* pData, size_t length);
+
+#if CONFIG_HID_HOST_SOAK
+#if CONFIG_HID_HOST_SOAK_ADVERTISERS
+/** Synthetic advertisers for the advertiser cache at their configured
+ *  rate, run from the soak task */
+static void soakAdvertisers() {
+  static int64_t next_us = esp_timer_get_time();
+  auto now_us = esp_timer_get_time();
+  size_t n = 0;
+  for (; next_us <= now_us; next_us += 1000000 / CONFIG_HID_HOST_SOAK_ADVERTISERS_PER_S) {
+    n++;
+  }
+  advertiser_churn.step(n, now_us / 1000);
+}
+#endif
+
+/** Synthetic device exercising the pipeline, see Kconfig */
+static SoakSource soak_source({
+    .deliver = onTransportReport,
+    .rate_hz = CONFIG_HID_HOST_SOAK_RATE_HZ,
+#if CONFIG_HID_HOST_SOAK_ADVERTISERS
+    .tick = soakAdvertisers,
+#else
+    .tick = nullptr,
+#endif
+  });
+#endif
+
+#if CONFIG_HID_HOST_FAULT_INJECTION
+/** Fault injector sitting on the transport boundary, see Kconfig for the probabilities */
+static FaultInjector fault_injector({
+    .deliver = handleInputReport,
+    .drop_per_mille = CONFIG_HID_HOST_FAULT_DROP_PER_MILLE,
+    .delay_per_mille = CONFIG_HID_HOST_FAULT_DELAY_PER_MILLE,
+    .delay_ms = CONFIG_HID_HOST_FAULT_DELAY_MS,
+    .reorder_per_mille = CONFIG_HID_HOST_FAULT_REORDER_PER_MILLE,
+    .duplicate_per_mille = CONFIG_HID_HOST_FAULT_DUPLICATE_PER_MILLE,
+    .connect_fail_per_mille = CONFIG_HID_HOST_FAULT_CONNECT_FAIL_PER_MILLE,
+    .disconnect_after_connect_per_mille = CONFIG_HID_HOST_FAULT_DISCONNECT_AFTER_CONNECT_PER_MILLE,
+    .disconnect_during_discovery_per_mille = CONFIG_HID_HOST_FAULT_DISCONNECT_DURING_DISCOVERY_PER_MILLE,
+    .disconnect_after_subscribe_per_mille = CONFIG_HID_HOST_FAULT_DISCONNECT_AFTER_SUBSCRIBE_PER_MILLE,
+  });
+#endif
+
+/** Scan afresh (starting clears the previous results); with the scan
+ *  scheduler the connect task starts it at its next poll */
+static void requestScan() {
+  int64_t not_looking = 0;
+  discovery_start_us.compare_exchange_strong(not_looking, esp_timer_get_time());
+#if CONFIG_HID_HOST_SCAN_SCHEDULER
+  scan_fresh = true;
+  scan_wanted = true;
+#else
+  heap_tracker.reset(HeapTracker::Tag::SCAN);
+  NimBLEDevice::getScan()->start(scanTime);
+#endif
+}
 
 /**  None of these are required as they will be handled by the library with defaults. **
  **                       Remove as you see fit for your needs                        */  
+/** Ask for the current profile's connection parameters: on the client's
+ *  next connection, and with update_link on its current one too */
+static void requestProfileConnParams(NimBLEClient* pClient, bool update_link) {
+  auto& p = PERF_PROFILES[perf_profile.load(std::memory_order_relaxed)];
+  pClient->setConnectionParams(p.conn_interval_min, p.conn_interval_max, p.conn_latency, p.supervision_timeout);
+  if (update_link) {
+    pClient->updateConnParams(p.conn_interval_min, p.conn_interval_max, p.conn_latency, p.supervision_timeout);
+  }
+}
+
 class ClientCallbacks : public NimBLEClientCallbacks {
   void onConnect(NimBLEClient* pClient) {
     printf("Connected\n");
@@ -35,13 +381,14 @@ class ClientCallbacks : public NimBLEClientCallbacks {
      */
     // pClient->updateConnParams(120,120,0,45);
     // pClient->setConnectionParams(6,6,0,15);
-    pClient->setConnectionParams(6,6,0,15);
+    /** the link came up with them already; this keeps them for reconnects */
+    requestProfileConnParams(pClient, false);
   }
 
   void onDisconnect(NimBLEClient* pClient, int reason) {
     printf("%s Disconnected, reason = %d - Starting scan\n",
            pClient->getPeerAddress().toString().c_str(), reason);
-    NimBLEDevice::getScan()->start(scanTime);
+    requestScan();
   }
     
   /********************* Security handled here **********************
@@ -70,17 +417,83 @@ class ClientCallbacks : public NimBLEClientCallbacks {
 };
 
 
+/** A device to connect to: one that advertises as a HID device, or a
+ *  bonded one reconnecting (directed advertisements carry no payload).
+ *  In the on-demand scan mode, an advertiser that may be one has to
+ *  answer a scan request first. */
+static bool isTarget(NimBLEAdvertisedDevice* advertisedDevice) {
+  auto kind = legacyAdvKind(advertisedDevice->getAdvType());
+#if CONFIG_BT_NIMBLE_EXT_ADV
+  if (!advertisedDevice->isLegacyAdvertisement()) {
+    kind = extendedAdvKind(advertisedDevice->getAdvType());
+    if (!scan_extended) {
+      return false;
+    }
+  }
+#if !CONFIG_HID_HOST_SCAN_CODED
+  if (advertisedDevice->getPrimaryPhy() == BLE_HCI_LE_PHY_CODED) {
+    return false;
+  }
+#endif
+#endif
+  if (!kind.connectable) {
+    return false;
+  }
+  auto identity = identifyAdvertiser(advertisedDevice->getPayload(), advertisedDevice->getPayloadLength());
+  if (identity == AdvertiserIdentity::HID) {
+    return true;
+  }
+#if CONFIG_HID_HOST_BONDING
+  if (NimBLEDevice::isBonded(advertisedDevice->getAddress())) {
+    return true;
+  }
+#endif
+  /** (an extended advertisement is never connectable and scannable both) */
+  if (identity == AdvertiserIdentity::UNKNOWN && kind.scannable && scanMode() == ScanMode::ON_DEMAND &&
+      !scan_escalated) {
+    auto address = advertisedDevice->getAddress();
+    scan_escalation.add(address.getNative(), address.getType(), esp_timer_get_time());
+  }
+  return false;
+}
+
 /** Define a class to handle the callbacks when advertisments are received */
 class scanCallbacks: public NimBLEScanCallbacks {
+  /** Called once per new advertiser, which NimBLE keeps only until onResult()
+   *  (setMaxResults(0)), or a fresh scan for one whose scan response never came */
+  void onDiscovered(NimBLEAdvertisedDevice* advertisedDevice) {
+    heap_tracker.add(HeapTracker::Tag::SCAN, sizeof(NimBLEAdvertisedDevice));
+  }
+
   void onResult(NimBLEAdvertisedDevice* advertisedDevice) {
-    printf("Advertised Device found: %s\n", advertisedDevice->toString().c_str());
-    if(advertisedDevice->isAdvertisingService(NimBLEUUID("1812")))
+    heap_tracker.sub(HeapTracker::Tag::SCAN, sizeof(NimBLEAdvertisedDevice));
+    {
+      HeapTracker::Scope scope(heap_tracker, HeapTracker::Tag::LOGGING);
+      printf("Advertised Device found: %s\n", advertisedDevice->toString().c_str());
+    }
+    if(isTarget(advertisedDevice))
       {
         printf("Found Our Service\n");
+        int64_t start_us = discovery_start_us.exchange(0);
+        if (start_us) {
+          scan_mode_stats.onDiscovered(scanMode(), esp_timer_get_time() - start_us);
+#if CONFIG_BT_NIMBLE_EXT_ADV
+          discovery_time[scan_extended].record(esp_timer_get_time() - start_us);
+#endif
+        }
+#if CONFIG_BT_NIMBLE_EXT_ADV
+        if (!advertisedDevice->isLegacyAdvertisement()) {
+          extended_discoveries++;
+        }
+#endif
         /** stop scan before connecting */
+#if CONFIG_HID_HOST_SCAN_SCHEDULER
+        scan_wanted = false;
+#endif
         NimBLEDevice::getScan()->stop();
-        /** Save the device reference in a global for the client to use*/
-        advDevice = advertisedDevice;
+        /** Save the device in a global for the client to use; NimBLE frees it after this */
+        advAddress = advertisedDevice->getAddress();
+        snprintf(advName, sizeof(advName), "%s", advertisedDevice->getName().c_str());
         /** Ready to connect now */
         doConnect = true;
       }
@@ -93,8 +506,8 @@ class scanCallbacks: public NimBLEScanCallbacks {
 };
 
 
-/** Notification / Indication receiving handler callback */
-void notifyCB(NimBLERemoteCharacteristic* pRemoteCharacteristic, uint8_t* pData, size_t length, bool isNotify){
+/** Report pipeline: called for every input report that makes it across the transport */
+static void handleInputReport(uint16_t conn_handle, uint16_t char_handle, const uint8_t* pData, size_t length) {
   // std::string str = (isNotify == true) ? "Notification" : "Indication";
   // str += " from ";
   // str += pRemoteCharacteristic->getRemoteService()->getClient()->getPeerAddress().toString();
@@ -102,24 +515,601 @@ void notifyCB(NimBLERemoteCharacteristic* pRemoteCharacteristic, uint8_t* pData,
   // str += ", Characteristic = " + pRemoteCharacteristic->getUUID().toString();
   // str += ", Value = " + std::string((char*)pData, length);
   // printf("%s\n", str.c_str());
+  auto timestamp_us = esp_timer_get_time();
+  auto device = devices.findReady(conn_handle);
+  if (!device) {
+    return;
+  }
+  auto handle = device->findHandle(char_handle);
+  if (!handle) {
+    return;
+  }
+#if CONFIG_HID_HOST_USB_PASSTHROUGH
+  /** raw passthrough goes out before we spend any time decoding */
+  if (handle->kind == HidDevice::Kind::REPORT) {
+    usb_passthrough.forwardRaw(conn_handle, handle->report_id, pData, length,
+                               device->sequence, timestamp_us);
+#if CONFIG_HID_HOST_PROBE && CONFIG_HID_HOST_USB_PASSTHROUGH_RAW
+    probe.mark(LogicProbe::Stage::FORWARDED, conn_handle, handle->report_id);
+#endif
+  }
+#endif
+  auto& state = device->state;
+  switch (handle->kind) {
+  case HidDevice::Kind::REPORT:
+    device->report_map.decode(handle->report_id, pData, length, state);
+    break;
+  case HidDevice::Kind::BOOT_KEYBOARD:
+    HidReportMap::decodeBootKeyboard(pData, length, state);
+    break;
+  case HidDevice::Kind::BOOT_MOUSE:
+    HidReportMap::decodeBootMouse(pData, length, state);
+    break;
+  default:
+    return;
+  }
+  device->motion.add(state.motion);
+  state.sequence = device->sequence++;
+  state.timestamp_us = timestamp_us;
+  state.event_us = device->timing.lastEventUs();
+  input_bus.publish(state, [device](InputState& s) {
+    device->axis_processor.apply(s.axes);
+    device->remap.apply(s);
+  });
+#if CONFIG_HID_HOST_PROBE
+  probe.mark(LogicProbe::Stage::PUBLISHED, conn_handle, handle->report_id);
+#endif
+#if CONFIG_HID_HOST_USB_PASSTHROUGH_NORMALIZED
+  usb_sink.poll([](const InputState& s) {
+    usb_passthrough.forwardState(s);
+#if CONFIG_HID_HOST_PROBE
+    probe.mark(LogicProbe::Stage::FORWARDED, s.device, s.report_id);
+#endif
+  });
+#endif
+}
+
+/** Everything after the transport boundary, in whichever task runs the pipeline */
+static void runPipeline(uint16_t conn_handle, uint16_t char_handle, const uint8_t* pData, size_t length) {
+#if CONFIG_HID_HOST_FAULT_INJECTION
+  fault_injector.onNotification(conn_handle, char_handle, pData, length);
+#else
+  handleInputReport(conn_handle, char_handle, pData, length);
+#endif
+}
+
+/** Transport boundary: every notification / indication enters the pipeline here */
+static void onTransportReport(uint16_t conn_handle, uint16_t char_handle, const uint8_t* pData, size_t length) {
+  /** radio / host timing is taken before anything (fault injection included) can delay it */
+  auto rx_us = esp_timer_get_time();
+  auto device = devices.findReady(conn_handle);
+  if (device) {
+    auto sample = device->timing.onReport(rx_us);
+    if (sample.host_us >= 0) {
+      scan_impact.record(ble_gap_disc_active(), sample.host_us, sample.missed_events);
+    }
+    last_input_us.store(rx_us, std::memory_order_relaxed);
+    device->setup.onReport(rx_us);
+#if CONFIG_HID_HOST_PROBE
+    auto handle = device->findHandle(char_handle);
+    probe.mark(LogicProbe::Stage::RECEIVED, conn_handle, handle ? handle->report_id : 0);
+#endif
+  }
+#if CONFIG_HID_HOST_PIPELINE_TASK
+  /** hand the report to the pipeline task; never block the host task */
+  QueuedReport report;
+  report.conn_handle = conn_handle;
+  report.char_handle = char_handle;
+  report.length = std::min(length, sizeof(report.data));
+  report.rx_us = rx_us;
+  memcpy(report.data, pData, report.length);
+  if (xQueueSend(pipeline_queue, &report, 0) != pdTRUE) {
+    pipeline_drops++;
+  }
+  uint32_t depth = uxQueueMessagesWaiting(pipeline_queue);
+  if (depth > pipeline_queue_max.load(std::memory_order_relaxed)) {
+    pipeline_queue_max.store(depth, std::memory_order_relaxed);
+  }
+#else
+  runPipeline(conn_handle, char_handle, pData, length);
+  auto latency_us = esp_timer_get_time() - rx_us;
+  report_latency.record(latency_us);
+  profile_latency[perf_profile.load(std::memory_order_relaxed)].record(latency_us);
+#endif
+}
+
+/** Notification / Indication receiving handler callback */
+void notifyCB(NimBLERemoteCharacteristic* pRemoteCharacteristic, uint8_t* pData, size_t length, bool isNotify){
+  uint16_t conn_handle = pRemoteCharacteristic->getRemoteService()->getClient()->getConnId();
+  uint16_t char_handle = pRemoteCharacteristic->getHandle();
+  onTransportReport(conn_handle, char_handle, pData, length);
+}
+
+/** Prints each decoded input event; the logging task polls console_sink
+ *  for them, so printing never holds up the pipeline */
+static void printInputState(const InputState& s) {
+  /** keyboards: show what changed since the last event we printed */
+  static KeyEvent key_events[KeyEventDiff::MAX_EVENTS];
+  static char keys[64];
+  size_t num_keys = 0;
+  /** motion since the last event we printed, so events the console dropped don't lose any */
+  std::array<int16_t, InputState::NUM_MOTION> motion{};
+  auto device = devices.find(s.device);
+  if (device) {
+    num_keys = device->console_keys.update(s.keys, key_events);
+    motion = device->motion.drain();
+  }
+  size_t pos = 0;
+  for (size_t i = 0; i < num_keys && pos + 5 < sizeof(keys); i++) {
+    pos += snprintf(keys + pos, sizeof(keys) - pos, " %c%02x", key_events[i].down ? '+' : '-', key_events[i].usage);
+  }
+  keys[pos] = 0;
   fmt::print("\x1B[1A" // go up a line
              "\x1B[2K\r" // erase the line
-             "Got notification from service {}, characteristic {}, length = {} B\n",
-             pRemoteCharacteristic->getRemoteService()->getUUID().toString(),
-             pRemoteCharacteristic->getUUID().toString(),
-             length);
-  // toogle the pin
-  pin_level = pin_level ? 0 : 1;
-  gpio_set_level((gpio_num_t)RECV_GPIO, pin_level);
+             "Device {} #{} (report {}): buttons {:08x}, axes {} {} {} {} {} {}, hats {:x} {:x}, motion {} {} {}{}{}\n",
+             s.device, s.sequence, s.report_id, s.buttons,
+             s.axes[InputState::X], s.axes[InputState::Y], s.axes[InputState::Z],
+             s.axes[InputState::RX], s.axes[InputState::RY], s.axes[InputState::RZ],
+             s.hats[0], s.hats[1],
+             motion[InputState::DX], motion[InputState::DY], motion[InputState::WHEEL],
+             num_keys ? ", keys" : "", keys);
+}
+
+/** Connection parameters are known or changed: re-pace output reports and the timing model */
+static void applyConnectionParams(HidDevice* device) {
+  struct ble_gap_conn_desc desc;
+  if (ble_gap_conn_find(device->conn_handle, &desc) != 0) {
+    return;
+  }
+  /** the connection interval is in units of 1.25 ms */
+  uint32_t interval_us = desc.conn_itvl * 1250;
+  device->timing.setInterval(interval_us);
+  if (device->output.numTargets()) {
+    /** send output reports at most once per connection interval */
+    device->output.start(interval_us);
+    printf("Output reports of device %d paced to %lu us\n", device->conn_handle, (unsigned long)interval_us);
+  }
 }
 
+/** Every advertising report, legacy or extended, as the controller gives
+ *  it (NimBLE's scan callbacks see them merged and deduplicated) */
+static void onAdvertisingReport(const ble_addr_t& addr, uint8_t adv_type, const AdvKind& kind, int8_t rssi,
+                                uint8_t phys, const uint8_t* data, size_t length) {
+  adv_cache.update(addr.val, addr.type, adv_type, kind.scan_response, rssi, phys, data, length,
+                   esp_timer_get_time() / 1000);
+  if (kind.scan_response) {
+    scan_mode_stats.onScanResponse(scanMode(), length);
+  } else {
+    scan_mode_stats.onAdvertisement(scanMode());
+  }
+}
+
+/** Watches GAP events for every connection: releases devices on disconnect,
+ *  re-paces output reports on connection parameter updates and,
+ *  in compact attribute mode, dispatches notifications by handle once the
+ *  attribute objects have been freed */
+static int gapEventListener(struct ble_gap_event* event, void* arg) {
+  switch (event->type) {
+#if CONFIG_HID_HOST_COMPACT_ATTRIBUTES
+  case BLE_GAP_EVENT_NOTIFY_RX: {
+    auto conn_handle = event->notify_rx.conn_handle;
+    auto char_handle = event->notify_rx.attr_handle;
+    auto device = devices.findReady(conn_handle);
+    if (!device || !device->findHandle(char_handle)) {
+      break;
+    }
+    uint8_t data[MAX_NOTIFY_SIZE];
+    size_t length = std::min<size_t>(OS_MBUF_PKTLEN(event->notify_rx.om), sizeof(data));
+    os_mbuf_copydata(event->notify_rx.om, 0, length, data);
+    onTransportReport(conn_handle, char_handle, data, length);
+    break;
+  }
+#endif
+  case BLE_GAP_EVENT_DISC:
+    onAdvertisingReport(event->disc.addr, event->disc.event_type, legacyAdvKind(event->disc.event_type),
+                        event->disc.rssi, decltype(adv_cache)::LEGACY_PHYS, event->disc.data, event->disc.length_data);
+    break;
+#if CONFIG_BT_NIMBLE_EXT_ADV
+  case BLE_GAP_EVENT_EXT_DISC: {
+    /** a payload too long for one report comes in a chain of them, and the
+     *  ones after the first start in the middle of an AD structure */
+    static ble_addr_t chain_addr;
+    static bool chained = false;
+    auto& disc = event->ext_disc;
+    bool continuation = chained && !ble_addr_cmp(&chain_addr, &disc.addr);
+    chained = disc.data_status == BLE_GAP_EXT_ADV_DATA_STATUS_INCOMPLETE;
+    chain_addr = disc.addr;
+    auto kind = extendedAdvKind(disc.props);
+    if (!kind.legacy) {
+      extended_reports++;
+    }
+    onAdvertisingReport(disc.addr, kind.legacy ? disc.legacy_event_type : disc.props, kind, disc.rssi,
+                        disc.prim_phy << 4 | disc.sec_phy, continuation ? nullptr : disc.data,
+                        continuation ? 0 : disc.length_data);
+    break;
+  }
+#endif
+  case BLE_GAP_EVENT_CONN_UPDATE: {
+    /** keep output reports and the timing model on the new connection interval */
+    auto device = devices.findReady(event->conn_update.conn_handle);
+    if (device && event->conn_update.status == 0) {
+      applyConnectionParams(device);
+    }
+    break;
+  }
+#if CONFIG_HID_HOST_BONDING
+  case BLE_GAP_EVENT_PASSKEY_ACTION:
+    smp_timing.mark(event->passkey.conn_handle, SmpTiming::Phase::USER_ACTION, esp_timer_get_time());
+    break;
+  case BLE_GAP_EVENT_ENC_CHANGE:
+    if (event->enc_change.status == 0) {
+      smp_timing.mark(event->enc_change.conn_handle, SmpTiming::Phase::ENCRYPTED, esp_timer_get_time());
+    }
+    break;
+  case BLE_GAP_EVENT_IDENTITY_RESOLVED:
+    smp_timing.mark(event->identity_resolved.conn_handle, SmpTiming::Phase::IDENTITY, esp_timer_get_time());
+    break;
+#endif
+  case BLE_GAP_EVENT_DISCONNECT:
+    disconnect_count++;
+    devices.release(event->disconnect.conn.conn_handle);
+#if CONFIG_HID_HOST_USB_PASSTHROUGH
+    usb_passthrough.onDisconnect(event->disconnect.conn.conn_handle);
+#endif
+    break;
+  default:
+    break;
+  }
+  return 0;
+}
+
+/** Apply the default stick deadzones; calibration and curves start out as pass-through */
+static void configureAxisProcessing(HidDevice* device) {
+  uint16_t deadzone = CONFIG_HID_HOST_STICK_DEADZONE_PERCENT * AxisProcessor::FULL_SCALE / 100;
+  /** most BLE gamepads put the right stick on Z / Rz rather than Rx / Ry */
+  device->axis_processor.configureStick(0, {.enabled = deadzone > 0, .x = InputState::X,
+                                            .y = InputState::Y, .deadzone = deadzone});
+  device->axis_processor.configureStick(1, {.enabled = deadzone > 0, .x = InputState::Z,
+                                            .y = InputState::RZ, .deadzone = deadzone});
+}
+
+/** Report types in the Report Reference descriptor */
+static constexpr uint8_t REPORT_TYPE_INPUT = 1;
+static constexpr uint8_t REPORT_TYPE_OUTPUT = 2;
+
+/** Read the report ID and type from a report's Report Reference descriptor (0x2908) */
+static void readReportReference(NimBLERemoteCharacteristic* c, uint8_t* report_id, uint8_t* report_type) {
+  *report_id = 0;
+  *report_type = REPORT_TYPE_INPUT;
+  auto pRef = c->getDescriptor(NimBLEUUID((uint16_t)0x2908));
+  if (pRef) {
+    auto value = pRef->readValue();
+    if (value.length() >= 2) {
+      *report_id = ((const uint8_t*)value.data())[0];
+      *report_type = ((const uint8_t*)value.data())[1];
+    } else if (value.length() >= 1) {
+      *report_id = ((const uint8_t*)value.data())[0];
+    }
+  }
+}
+
+/** Record what a subscribed characteristic carries so the pipeline can decode it */
+static void addReportHandle(HidDevice* device, NimBLERemoteCharacteristic* c) {
+  auto kind = HidDevice::Kind::OTHER;
+  uint8_t report_id = 0;
+  if (c->getUUID() == NimBLEUUID((uint16_t)0x2A4D)) {
+    kind = HidDevice::Kind::REPORT;
+    uint8_t report_type;
+    readReportReference(c, &report_id, &report_type);
+  } else if (c->getUUID() == NimBLEUUID((uint16_t)0x2A22)) {
+    kind = HidDevice::Kind::BOOT_KEYBOARD;
+  } else if (c->getUUID() == NimBLEUUID((uint16_t)0x2A33)) {
+    kind = HidDevice::Kind::BOOT_MOUSE;
+  }
+  if (!device->addHandle(c->getHandle(), report_id, kind)) {
+    printf("Handle table full, ignoring %s\n", c->getUUID().toString().c_str());
+  }
+}
+
+/** Register a writable output report (0x2A4D, type output) with the device's output channel */
+static void addOutputReport(HidDevice* device, NimBLERemoteCharacteristic* c) {
+  uint8_t report_id, report_type;
+  readReportReference(c, &report_id, &report_type);
+  if (report_type != REPORT_TYPE_OUTPUT) {
+    return;
+  }
+  bool no_response = c->canWriteNoResponse();
+  if (!device->output.addTarget(report_id, c->getHandle(), no_response)) {
+    printf("Output report table full, ignoring report %d\n", report_id);
+    return;
+  }
+  printf("Output report %d (%s)\n", report_id, no_response ? "write without response" : "write");
+}
+
+/** Read and parse the HID report map (0x2A4B) */
+static void readReportMap(HidDevice* device, NimBLERemoteCharacteristic* c) {
+  auto value = c->readValue();
+  if (!device->report_map.parse((const uint8_t*)value.data(), value.length())) {
+    printf("Report map (%d B) could not be fully parsed\n", (int)value.length());
+  }
+  printf("Report map: %d B, %d reports, %d input fields\n", (int)value.length(),
+         (int)device->report_map.numReports(), (int)device->report_map.numFields());
+#if CONFIG_HID_HOST_USB_PASSTHROUGH
+  usb_passthrough.onReportMap(device->conn_handle, (const uint8_t*)value.data(), value.length());
+#endif
+}
+
+#if CONFIG_HID_HOST_COMPACT_ATTRIBUTES
+/** Free the discovered attribute tree of a client, keeping only the device's handle table */
+static void compactAttributes(NimBLEClient* pClient) {
+  auto free_before = HeapTracker::freeBytes();
+  pClient->deleteServices();
+  /** the enclosing discovery scope credits the freed bytes back to DISCOVERY */
+  int saved = (int)HeapTracker::freeBytes() - (int)free_before;
+  printf("Freed %d B of attribute objects, keeping %d B of handle table\n",
+         saved, (int)HidDevice::handleTableBytes());
+}
+#endif
+
+static const NimBLEUUID HID_SERVICE_UUID((uint16_t)0x1812);
+
+/** Subscribe callback for input reports. In compact attribute mode the GAP
+ *  event listener dispatches them by handle instead, so the attribute
+ *  objects can be freed whenever the deferred setup gets to it */
+static NimBLERemoteCharacteristic::notify_callback reportCallback() {
+#if CONFIG_HID_HOST_COMPACT_ATTRIBUTES
+  return nullptr;
+#else
+  return notifyCB;
+#endif
+}
+
+/** Discover a service's characteristics, read the report map and subscribe to everything that notifies / indicates */
+static void setupService(HidDevice* device, NimBLERemoteService* s) {
+  auto characteristics = s->getCharacteristics(true);
+  auto num_chars = characteristics->size();
+  printf("got service %s, with %d characteristics\n", s->getUUID().toString().c_str(), num_chars);
+  for (int j=0; j<num_chars; j++) {
+    auto c = (*characteristics)[j];
+    auto descriptors = c->getDescriptors(true);
+    auto num_desc = descriptors->size();
+    printf("Got characteristic: %s, with %d descriptors\n", c->getUUID().toString().c_str(), num_desc);
+    for (int k=0; k<num_desc; k++) {
+      auto d = (*descriptors)[k];
+      printf("Got descriptor: %s\n", d->getUUID().toString().c_str());
+    }
+    if(c->getUUID() == NimBLEUUID((uint16_t)0x2A4B) && c->canRead()) {
+      readReportMap(device, c);
+    }
+    if(c->getUUID() == NimBLEUUID((uint16_t)0x2A4D) && (c->canWriteNoResponse() || c->canWrite())) {
+      addOutputReport(device, c);
+    }
+    if(c->canNotify()) {
+      printf("subscribing (notifications)\n");
+      if(!c->subscribe(true, reportCallback())) {
+        printf("couldn't subscribe (notifications)!\n");
+      }
+      else {
+        addReportHandle(device, c);
+      }
+    } else if(c->canIndicate()) {
+      printf("subscribing (indication)\n");
+      /** Send false as first argument to subscribe to indications instead of notifications */
+      if(!c->subscribe(false, reportCallback())) {
+        printf("couldn't subscribe (indication)!\n");
+      }
+      else {
+        addReportHandle(device, c);
+      }
+    }
+  }
+}
+
+/** Find a characteristic of a discovered service, nullptr if the device doesn't have it */
+static NimBLERemoteCharacteristic* findCharacteristic(NimBLEClient* pClient, uint16_t service, uint16_t characteristic) {
+  auto pSvc = pClient->getService(NimBLEUUID(service));
+  return pSvc ? pSvc->getCharacteristic(NimBLEUUID(characteristic)) : nullptr;
+}
+
+/** The services other than HID we set up, each discovered on its own by
+ *  UUID: only HID is discovered before input flows, and discovering all
+ *  services again would duplicate it */
+static constexpr uint16_t OTHER_SERVICES[] = {
+  0x180F, /**< Battery */
+  0x180A, /**< Device Information */
+};
+
+/** Setup that waits until input is flowing, in this order */
+static constexpr DeferredSetup::Job SETUP_JOBS[] = {
+  DeferredSetup::Job::DISCOVER_SERVICES,
+  DeferredSetup::Job::READ_BATTERY,
+  DeferredSetup::Job::READ_PNP_ID,
+  DeferredSetup::Job::READ_INPUT_REPORT,
+#if CONFIG_HID_HOST_COMPACT_ATTRIBUTES
+  DeferredSetup::Job::COMPACT,
+#endif
+};
+static DeferredSetup deferred_setup;
+
+/** One piece of setup that does not hold up input */
+static void runSetupJob(HidDevice* device, NimBLEClient* pClient, DeferredSetup::Job job) {
+  switch (job) {
+  case DeferredSetup::Job::DISCOVER_SERVICES: {
+    for (auto uuid : OTHER_SERVICES) {
+      auto pSvc = pClient->getService(NimBLEUUID(uuid));
+      if (pSvc) {
+        setupService(device, pSvc);
+      }
+    }
+    break;
+  }
+  case DeferredSetup::Job::READ_BATTERY: {
+    auto c = findCharacteristic(pClient, 0x180F, 0x2A19);
+    if (c && c->canRead()) {
+      auto value = c->readValue();
+      if (value.length() >= 1) {
+        device->battery_level = ((const uint8_t*)value.data())[0];
+        printf("Battery level: %d%%\n", device->battery_level);
+      }
+    }
+    break;
+  }
+  case DeferredSetup::Job::READ_PNP_ID: {
+    auto c = findCharacteristic(pClient, 0x180A, 0x2A50);
+    if (c && c->canRead()) {
+      /** vendor ID source, vendor ID, product ID, product version, little endian */
+      auto value = c->readValue();
+      auto v = (const uint8_t*)value.data();
+      if (value.length() >= 7) {
+        device->vendor_id = v[1] | (v[2] << 8);
+        device->product_id = v[3] | (v[4] << 8);
+        device->product_version = v[5] | (v[6] << 8);
+        printf("PnP ID: vendor %04x product %04x version %04x\n",
+               device->vendor_id, device->product_id, device->product_version);
+      }
+    }
+    break;
+  }
+  case DeferredSetup::Job::READ_INPUT_REPORT: {
+    auto pChr = findCharacteristic(pClient, 0x1812, 0x2A4D);
+    if(pChr && pChr->canRead()) {
+      printf("%s Value: %s\n",
+             pChr->getUUID().toString().c_str(),
+             pChr->readValue().c_str());
+    }
+    break;
+  }
+  case DeferredSetup::Job::COMPACT:
+#if CONFIG_HID_HOST_COMPACT_ATTRIBUTES
+    compactAttributes(pClient);
+#endif
+    break;
+  }
+}
+
+#if CONFIG_HID_HOST_BONDING
+static BondLru::Peer toPeer(const NimBLEAddress& address) {
+  BondLru::Peer peer;
+  peer.type = address.getType();
+  memcpy(peer.val, address.getNative(), sizeof(peer.val));
+  return peer;
+}
+
+/** The peer's identity address, which its bond and its place in bond_lru
+ *  are kept under. getPeerAddress() is the address it connected with, a
+ *  resolvable private one for peers using privacy; NimBLE resolves it once
+ *  it has the peer's IRK, i.e. for a bonded peer or after pairing */
+static NimBLEAddress identityAddress(NimBLEClient* pClient) {
+  struct ble_gap_conn_desc desc;
+  if (ble_gap_conn_find(pClient->getConnId(), &desc) != 0) {
+    return pClient->getPeerAddress();
+  }
+  return NimBLEAddress(desc.peer_id_addr);
+}
+
+/** With the bond store full, delete the least recently used bond so pairing a new peer can keep its keys */
+static void makeRoomForBond() {
+  int num_bonds = NimBLEDevice::getNumBonds();
+  if (num_bonds < CONFIG_BT_NIMBLE_MAX_BONDS) {
+    return;
+  }
+  int victim = -1;
+  size_t victim_rank = 0;
+  /** the store's addresses are identity addresses, as bond_lru's are */
+  for (int i = 0; i < num_bonds; i++) {
+    size_t rank = bond_lru.rank(toPeer(NimBLEDevice::getBondedAddress(i)));
+    if (victim < 0 || rank >= victim_rank) {
+      victim = i;
+      victim_rank = rank;
+    }
+  }
+  auto address = NimBLEDevice::getBondedAddress(victim);
+  printf("Bond store full, forgetting least recently used %s\n", address.toString().c_str());
+  NimBLEDevice::deleteBond(address);
+  bond_lru.remove(toPeer(address));
+  bond_lru.save();
+}
+
+/** Encrypt the link: restart encryption with the stored keys of a bonded
+ *  peer, or pair (and bond) with a new one */
+static bool secureConnection(NimBLEClient* pClient) {
+  auto address = identityAddress(pClient);
+  bool bonded = NimBLEDevice::isBonded(address);
+  if (!bonded) {
+    makeRoomForBond();
+  }
+  auto start_us = esp_timer_get_time();
+  smp_timing.begin(pClient->getConnId(), !bonded, start_us);
+  bool secured = pClient->secureConnection();
+  auto elapsed_us = esp_timer_get_time() - start_us;
+  smp_timing.end(secured, start_us + elapsed_us);
+  const char* what = bonded ? "Encryption restart" : "Pairing";
+  if (!secured) {
+    printf("%s failed after %lld ms\n", what, (long long)elapsed_us / 1000);
+    if (bonded) {
+      /** the peer has lost its keys; forget ours so the next attempt pairs again */
+      NimBLEDevice::deleteBond(address);
+      bond_lru.remove(toPeer(address));
+      bond_lru.save();
+    }
+    return false;
+  }
+  (bonded ? encryption_restart_time : pairing_time).record(elapsed_us);
+  printf("%s took %lld ms\n", what, (long long)elapsed_us / 1000);
+  /** pairing has just given us the IRK of a peer using privacy */
+  address = identityAddress(pClient);
+  bond_lru.touch(toPeer(address));
+  bond_lru.save();
+  return true;
+}
+#endif
 
 /** Create a single global instance of the callback class to be used by all clients */
 static ClientCallbacks clientCB;
 
+/** Switch every setting of a performance profile at once: scanning (picked
+ *  up where it was), TX power, connection parameters of every client and
+ *  link, and the CPU clock / light sleep. Only from the connect task once
+ *  it runs (see perf_profile_request) */
+static void applyPerfProfile(size_t index) {
+  auto& p = PERF_PROFILES[index];
+  perf_profile = index;
+  NimBLEDevice::setPower(p.tx_power);
+#if !CONFIG_HID_HOST_SCAN_SCHEDULER
+  /** (the scan scheduler takes the new scan timing at its next poll) */
+  NimBLEScan* pScan = NimBLEDevice::getScan();
+  bool scanning = pScan->isScanning();
+  if (scanning) {
+    pScan->stop();
+  }
+  pScan->setInterval(p.scan_interval_ms);
+  pScan->setWindow(p.scan_window_ms);
+  pScan->setActiveScan(scanMode() == ScanMode::ACTIVE);
+  if (scanning) {
+    /** continue: keep the results so far */
+    pScan->start(scanTime, true);
+  }
+#endif
+  for (auto pClient : *NimBLEDevice::getClientList()) {
+    requestProfileConnParams(pClient, pClient->isConnected());
+  }
+  bool power = power_control.apply(p.cpu_max_mhz, p.cpu_min_mhz, p.light_sleep);
+  printf("Performance profile: %s (CPU %lu MHz%s)\n", p.name, (unsigned long)PowerControl::cpuMhz(),
+         power ? "" : ", no power management");
+}
+
 /** Handles the provisioning of clients and connects / interfaces with the server */
-bool connectToServer() {
+static ConnectionHistory::Result connectToServer() {
+  using Result = ConnectionHistory::Result;
   NimBLEClient* pClient = nullptr;
+  auto start_us = esp_timer_get_time();
+
+#if CONFIG_HID_HOST_FAULT_INJECTION
+  if (fault_injector.shouldFailConnect()) {
+    printf("Injected connect failure\n");
+    return Result::INJECTED_FAULT;
+  }
+#endif
     
   /** Check if we have a client we should reuse first **/
   if(NimBLEDevice::getClientListSize()) {
@@ -127,11 +1117,11 @@ bool connectToServer() {
      *  second argument in connect() to prevent refreshing the service database.
      *  This saves considerable time and power.
      */
-    pClient = NimBLEDevice::getClientByPeerAddress(advDevice->getAddress());
+    pClient = NimBLEDevice::getClientByPeerAddress(advAddress);
     if(pClient){
-      if(!pClient->connect(advDevice, false)) {
+      if(!pClient->connect(advAddress, false)) {
         printf("Reconnect failed\n");
-        return false;
+        return Result::CONNECT_FAILED;
       }
       printf("Reconnected client\n");
     }
@@ -147,7 +1137,7 @@ bool connectToServer() {
   if(!pClient) {
     if(NimBLEDevice::getClientListSize() >= NIMBLE_MAX_CONNECTIONS) {
       printf("Max clients reached - no more connections available\n");
-      return false;
+      return Result::NO_CLIENT;
     }
         
     pClient = NimBLEDevice::createClient();
@@ -160,138 +1150,865 @@ bool connectToServer() {
      *  connections. Timeout should be a multiple of the interval, minimum is 100ms.
      *  Min interval: 12 * 1.25ms = 15, Max interval: 12 * 1.25ms = 15, 0 latency, 12 * 10ms = 120ms timeout
      */
-    // pClient->setConnectionParams(6,6,0,15);
+    requestProfileConnParams(pClient, false);
     /** Set how long we are willing to wait for the connection to complete (seconds), default is 30. */
     // pClient->setConnectTimeout(5);
         
 
-    if (!pClient->connect(advDevice)) {
+    if (!pClient->connect(advAddress)) {
       /** Created a client but failed to connect, don't need to keep it as it has no data */
       NimBLEDevice::deleteClient(pClient);
       printf("Failed to connect, deleted client\n");
-      return false;
+      return Result::CONNECT_FAILED;
     }
   }
     
   if(!pClient->isConnected()) {
-    if (!pClient->connect(advDevice)) {
+    if (!pClient->connect(advAddress)) {
       printf("Failed to connect\n");
-      return false;
+      return Result::CONNECT_FAILED;
     }
   }
     
   printf("Connected to: %s RSSI: %d\n",
          pClient->getPeerAddress().toString().c_str(),
          pClient->getRssi());
-    
-  /** Now we can read/write/subscribe the charateristics of the services we are interested in */
-  NimBLERemoteService* pSvc = nullptr;
-  NimBLERemoteCharacteristic* pChr = nullptr;
-  NimBLERemoteDescriptor* pDsc = nullptr;
-    
-  auto services = pClient->getServices(true);
-  auto num_srv = services->size();
-  printf("got %d services!\n", num_srv);
-  for (int i=0; i< num_srv; i++) {
-    auto s = (*services)[i];
-    auto characteristics = s->getCharacteristics(true);
-    auto num_chars = characteristics->size();
-    printf("got service %s, with %d characteristics\n", s->getUUID().toString().c_str(), num_chars);
-    for (int j=0; j<num_chars; j++) {
-      auto c = (*characteristics)[j];
-      auto descriptors = c->getDescriptors(true);
-      auto num_desc = descriptors->size();
-      printf("Got characteristic: %s, with %d descriptors\n", c->getUUID().toString().c_str(), num_desc);
-      for (int k=0; k<num_desc; k++) {
-        auto d = (*descriptors)[k];
-        printf("Got descriptor: %s\n", d->getUUID().toString().c_str());
-      }
-      if(c->canNotify()) {
-        printf("subscribing (notifications)\n");
-        if(!c->subscribe(true, notifyCB)) {
-          printf("couldn't subscribe (notifications)!\n");
-        }
-      } else if(c->canIndicate()) {
-        printf("subscribing (indication)\n");
-        /** Send false as first argument to subscribe to indications instead of notifications */
-        if(!c->subscribe(false, notifyCB)) {
-          printf("couldn't subscribe (indication)!\n");
-        }
-      }
 
-    }
+#if CONFIG_HID_HOST_FAULT_INJECTION
+  if (fault_injector.shouldDisconnect(FaultInjector::Phase::AFTER_CONNECT)) {
+    printf("Injected disconnect after connect\n");
+    pClient->disconnect();
+    return Result::INJECTED_FAULT;
   }
+#endif
 
-  pSvc = pClient->getService("1812");
+#if CONFIG_HID_HOST_BONDING
+  /** many HID peripherals send nothing until the link is encrypted */
+  if (!secureConnection(pClient)) {
+    pClient->disconnect();
+    return Result::SECURITY_FAILED;
+  }
+#endif
+    
+  auto device = devices.claim(pClient->getConnId());
+  if (!device) {
+    printf("No free device slot - disconnecting\n");
+    pClient->disconnect();
+    return Result::NO_DEVICE_SLOT;
+  }
+  device->setup.reset(start_us);
+  /** compile the remap for this controller model once, up front */
+  auto& profile = selectRemapProfile(advName);
+  device->remap.compile(profile);
+  printf("Using remap profile: %s\n", profile.name);
+  configureAxisProcessing(device);
+  device->motion.setScale(CONFIG_HID_HOST_MOUSE_SENSITIVITY_PERCENT * MotionAccumulator::ONE / 100);
+  HeapTracker::Scope discovery_scope(heap_tracker, HeapTracker::Tag::DISCOVERY);
+  /** Input first: the HID service (report map, input report subscriptions)
+   *  is all the pipeline needs, so it is the only one discovered now; the
+   *  rest waits for the DISCOVER_SERVICES setup job */
+  auto pSvc = pClient->getService(HID_SERVICE_UUID);
+#if CONFIG_HID_HOST_FAULT_INJECTION
+  /** the service is known, its characteristics not yet */
+  if (fault_injector.shouldDisconnect(FaultInjector::Phase::DURING_DISCOVERY)) {
+    printf("Injected disconnect during discovery\n");
+    pClient->disconnect();
+    return Result::INJECTED_FAULT;
+  }
+#endif
   if(pSvc) {     /** make sure it's not null */
-    pChr = pSvc->getCharacteristic("2A4D");
+    setupService(device, pSvc);
   } else {
     printf("Could not get service 0x1812\n");
   }
+#if CONFIG_HID_HOST_FAULT_INJECTION
+  if (fault_injector.shouldDisconnect(FaultInjector::Phase::AFTER_SUBSCRIBE)) {
+    printf("Injected disconnect after subscribe\n");
+    pClient->disconnect();
+    return Result::INJECTED_FAULT;
+  }
+#endif
 
-  if(pChr) {     /** make sure it's not null */
-    if(pChr->canRead()) {
-      printf("%s Value: %s\n",
-             pChr->getUUID().toString().c_str(),
-             pChr->readValue().c_str());
+  /** a reused connection handle must not run the previous device's jobs */
+  deferred_setup.drop(device->conn_handle);
+#if CONFIG_HID_HOST_DEFERRED_SETUP
+  /** from here on the pipeline decodes this device's reports */
+  device->setup.ready_us = esp_timer_get_time();
+  device->ready.store(true, std::memory_order_release);
+  applyConnectionParams(device);
+  for (auto job : SETUP_JOBS) {
+    deferred_setup.push(device->conn_handle, job);
+  }
+  printf("Done with this device, %d setup jobs deferred until input flows\n", (int)(sizeof(SETUP_JOBS) / sizeof(SETUP_JOBS[0])));
+#else
+  for (auto job : SETUP_JOBS) {
+    runSetupJob(device, pClient, job);
+  }
+  device->setup.deferred_done_us = esp_timer_get_time();
+  /** from here on the pipeline decodes this device's reports */
+  device->setup.ready_us = esp_timer_get_time();
+  device->ready.store(true, std::memory_order_release);
+  applyConnectionParams(device);
+  printf("Done with this device!\n");
+#endif
+  return Result::CONNECTED;
+}
+
+/** Run the next deferred setup job, of the first device whose input is
+ *  flowing (or has been ready for the grace period without sending any) */
+static void runDeferredSetup() {
+  DeferredSetup::Item item;
+  auto now = esp_timer_get_time();
+  bool found = deferred_setup.pop(item, [now](uint16_t conn_handle) {
+    auto device = devices.findReady(conn_handle);
+    /** jobs of devices that went away are taken and skipped */
+    if (!device) {
+      return true;
     }
-    // if(pChr->canWrite()) {
-    //   if(pChr->writeValue("No tip!")) {
-    //     printf("Wrote new value to: %s\n", pChr->getUUID().toString().c_str());
-    //   }
-    //   else {
-    //     printf("couldn't write!\n");
-    //   }
-    //   if(pChr->canRead()) {
-    //     printf("The value of: %s is now: %s\n",
-    //            pChr->getUUID().toString().c_str(),
-    //            pChr->readValue().c_str());
-    //   }
-    // }
-  } else {
-    printf("2A4D service not found.\n");
+    return device->setup.first_report_us.load(std::memory_order_relaxed) != 0 ||
+           now - device->setup.ready_us > CONFIG_HID_HOST_DEFERRED_SETUP_GRACE_MS * 1000ll;
+  });
+  if (!found) {
+    return;
+  }
+  auto device = devices.findReady(item.conn_handle);
+  auto pClient = NimBLEDevice::getClientByID(item.conn_handle);
+  if (!device || !pClient || !pClient->isConnected()) {
+    return;
+  }
+  connecting = true;
+  {
+    HeapTracker::Scope discovery_scope(heap_tracker, HeapTracker::Tag::DISCOVERY);
+    runSetupJob(device, pClient, item.job);
   }
+  connecting = false;
+  if (!deferred_setup.pending(item.conn_handle)) {
+    device->setup.deferred_done_us = esp_timer_get_time();
+    device->setup.printStats(item.conn_handle);
+  }
+}
 
-  printf("Done with this device!\n");
-  return true;
+#if CONFIG_HID_HOST_SC_PRECOMPUTE_KEYS
+/** Have NimBLE generate its LE Secure Connections key pair now, instead of
+ *  in the middle of the first pairing. NimBLE keeps the pair for the life
+ *  of the host, so from then on a pairing only pays for the DHKey;
+ *  generating OOB data is the public way to get the pair made. */
+static void precomputeScKeys() {
+  struct ble_sm_sc_oob_data oob;
+  auto start_us = esp_timer_get_time();
+  int rc = ble_sm_sc_oob_generate_data(&oob);
+  if (rc != 0) {
+    printf("Could not precompute the LE Secure Connections key pair: %d\n", rc);
+    return;
+  }
+  printf("LE Secure Connections key pair ready in %lld ms\n",
+         (long long)(esp_timer_get_time() - start_us) / 1000);
+}
+#endif
+
+#if CONFIG_HID_HOST_STACK_STRESS
+/** Drops one connected device so it comes back through the deepest setup
+ *  paths: full discovery and, with its bond forgotten, full pairing */
+static void stressReconnect() {
+  NimBLEClient* victim = nullptr;
+  devices.forEachReady([&victim](HidDevice& device) {
+    /** the soak source has no client */
+    auto pClient = NimBLEDevice::getClientByID(device.conn_handle);
+    if (!victim && pClient && pClient->isConnected()) {
+      victim = pClient;
+    }
+  });
+  if (!victim) {
+    return;
+  }
+  auto address = victim->getPeerAddress();
+  printf("Stack stress: reconnecting %s\n", address.toString().c_str());
+#if CONFIG_HID_HOST_BONDING
+  auto identity = identityAddress(victim);
+  if (NimBLEDevice::isBonded(identity)) {
+    /** unpairing ends the link too */
+    NimBLEDevice::deleteBond(identity);
+    bond_lru.remove(toPeer(identity));
+    bond_lru.save();
+    return;
+  }
+#endif
+  victim->disconnect();
+}
+#endif
+
+#if CONFIG_HID_HOST_SCAN_SCHEDULER
+/** Scans as the scheduler plans them for the current connections and
+ *  input activity, restarted (keeping the results) when the plan or the
+ *  profile changes */
+static void rescheduleScan() {
+  static ScanScheduler::Plan applied = {};
+  static bool applied_active = false;
+  if (!scan_wanted || doConnect || connecting || scan_escalated) {
+    return;
+  }
+  auto& p = PERF_PROFILES[perf_profile.load(std::memory_order_relaxed)];
+  scan_scheduler.setBase(p.scan_interval_ms, p.scan_window_ms);
+  uint32_t intervals_us[NIMBLE_MAX_CONNECTIONS];
+  size_t num_connections = 0;
+  for (auto pClient : *NimBLEDevice::getClientList()) {
+    struct ble_gap_conn_desc desc;
+    if (num_connections < NIMBLE_MAX_CONNECTIONS && pClient->isConnected() &&
+        ble_gap_conn_find(pClient->getConnId(), &desc) == 0) {
+      intervals_us[num_connections++] = desc.conn_itvl * 1250;
+    }
+  }
+  auto plan = scan_scheduler.plan(intervals_us, num_connections, last_input_us.load(std::memory_order_relaxed),
+                                  esp_timer_get_time());
+  NimBLEScan* pScan = NimBLEDevice::getScan();
+  bool scanning = pScan->isScanning();
+  if (!plan.scan) {
+    if (scanning) {
+      pScan->stop();
+    }
+    return;
+  }
+  bool fresh = scan_fresh;
+  bool active = scanMode() == ScanMode::ACTIVE;
+  if (scanning && !fresh && plan == applied && active == applied_active) {
+    return;
+  }
+  if (scanning) {
+    pScan->stop();
+  }
+  pScan->setInterval(plan.interval_ms);
+  pScan->setWindow(plan.window_ms);
+  pScan->setActiveScan(active);
+  if (fresh) {
+    heap_tracker.reset(HeapTracker::Tag::SCAN);
+    scan_fresh = false;
+  }
+  pScan->start(scanTime, !fresh);
+  applied = plan;
+  applied_active = active;
+}
+#endif
+
+/** Drops what NimBLE still holds of the scan (advertisers whose scan
+ *  response never came) and restarts the controller's duplicate filter,
+ *  so every advertiser in range is heard, and its cache entry refreshed,
+ *  again */
+static void restartScanAfresh() {
+#if CONFIG_HID_HOST_SCAN_SCHEDULER
+  if (scan_wanted) {
+    scan_fresh = true;
+  }
+#else
+  NimBLEScan* pScan = NimBLEDevice::getScan();
+  if (!pScan->isScanning() || doConnect || connecting || scan_escalated) {
+    return;
+  }
+  pScan->stop();
+  heap_tracker.reset(HeapTracker::Tag::SCAN);
+  pScan->start(scanTime, false);
+#endif
+}
+
+/** Back to the normal scan after an active burst: off the accept list and
+ *  passive again, and with restart, scanning afresh so the candidates
+ *  that did not answer are heard (and kept from asking again) once more */
+static void endScanEscalation(bool restart) {
+  NimBLEScan* pScan = NimBLEDevice::getScan();
+  if (pScan->isScanning()) {
+    pScan->stop();
+  }
+  while (NimBLEDevice::getWhiteListCount()) {
+    NimBLEDevice::whiteListRemove(NimBLEDevice::getWhiteListAddress(0));
+  }
+  pScan->setFilterPolicy(BLE_HCI_SCAN_FILT_NO_WL);
+  pScan->setActiveScan(scanMode() == ScanMode::ACTIVE);
+  scan_escalated = false;
+  if (restart) {
+    requestScan();
+  }
+}
+
+/** On-demand scan mode: asks the waiting candidates for their scan
+ *  responses with a short active scan only they can answer */
+static void escalateScan() {
+  static int64_t burst_end_us = 0;
+  auto now_us = esp_timer_get_time();
+  NimBLEScan* pScan = NimBLEDevice::getScan();
+  if (scan_escalated) {
+    if (pScan->isScanning() && now_us < burst_end_us) {
+      return;
+    }
+    endScanEscalation(true);
+    return;
+  }
+  if (scanMode() != ScanMode::ON_DEMAND || doConnect || connecting || !pScan->isScanning()) {
+    return;
+  }
+  ScanEscalation::Candidate candidates[ScanEscalation::MAX_CANDIDATES];
+  size_t n = scan_escalation.take(candidates, ScanEscalation::MAX_CANDIDATES, now_us);
+  if (!n) {
+    return;
+  }
+  /** (allocations are expected now too: the accept list is a vector) */
+  scan_escalated = true;
+  pScan->stop();
+  for (size_t i = 0; i < n; i++) {
+    ble_addr_t address;
+    address.type = candidates[i].address_type;
+    memcpy(address.val, candidates[i].address, sizeof(address.val));
+    NimBLEDevice::whiteListAdd(NimBLEAddress(address));
+  }
+  pScan->setFilterPolicy(BLE_HCI_SCAN_FILT_USE_WL);
+  pScan->setActiveScan(true);
+  /** afresh: the candidates' results were sent already, without the responses */
+  heap_tracker.reset(HeapTracker::Tag::SCAN);
+  pScan->start(CONFIG_HID_HOST_SCAN_ESCALATION_BURST_MS, false);
+  burst_end_us = now_us + CONFIG_HID_HOST_SCAN_ESCALATION_BURST_MS * 1000ll;
 }
 
 void connectTask (void * parameter){
+#if CONFIG_HID_HOST_SC_PRECOMPUTE_KEYS
+  /** scanning carries on meanwhile; nothing pairs before this task connects */
+  precomputeScKeys();
+#endif
+#if CONFIG_HID_HOST_STACK_STRESS
+  int64_t last_stress_us = esp_timer_get_time();
+#endif
+  int64_t last_poll_us = esp_timer_get_time();
+  int64_t last_prune_us = esp_timer_get_time();
   /** Loop here until we find a device we want to connect to */
   for(;;) {
+    auto now_us = esp_timer_get_time();
+    if (ble_gap_disc_active()) {
+      scan_mode_stats.addScanTime(scanMode(), now_us - last_poll_us);
+    }
+    last_poll_us = now_us;
+    int profile_request = perf_profile_request.exchange(-1);
+    if (profile_request >= 0) {
+      applyPerfProfile(profile_request);
+    }
     if(doConnect) {
       doConnect = false;
+      if (scan_escalated) {
+        /** found during a burst: leave the accept list for the next scan */
+        endScanEscalation(false);
+      }
+#if CONFIG_HID_HOST_SCAN_SCHEDULER
+      /** the scheduler may have restarted the scan just before the result came in */
+      if(NimBLEDevice::getScan()->isScanning()) {
+        NimBLEDevice::getScan()->stop();
+      }
+#endif
       /** Found a device we want to connect to, do it now */
-      if(connectToServer()) {
+      connecting = true;
+      ConnectionHistory::Entry attempt = {};
+      attempt.start_us = esp_timer_get_time();
+      memcpy(attempt.address, advAddress.getNative(), sizeof(attempt.address));
+      attempt.result = connectToServer();
+      attempt.duration_ms = (esp_timer_get_time() - attempt.start_us) / 1000;
+      connection_history.add(attempt);
+      bool connected = attempt.result == ConnectionHistory::Result::CONNECTED;
+      connecting = false;
+      if(connected) {
         printf("Success! we should now be getting notifications!\n");
       } else {
         printf("Failed to connect, starting scan\n");
-        // NimBLEDevice::getScan()->start(scanTime);
+        /** onDisconnect may already have restarted the scan for us */
+        if(!NimBLEDevice::getScan()->isScanning()) {
+          requestScan();
+        }
       }
+    } else {
+      runDeferredSetup();
+    }
+    if (now_us - last_prune_us > CONFIG_HID_HOST_ADV_CACHE_PRUNE_PERIOD_S * 1000000ll) {
+      last_prune_us = now_us;
+      adv_cache.prune(CONFIG_HID_HOST_ADV_CACHE_MAX_AGE_S * 1000, now_us / 1000);
+      restartScanAfresh();
     }
+    escalateScan();
+#if CONFIG_HID_HOST_SCAN_SCHEDULER
+    rescheduleScan();
+#endif
+#if CONFIG_HID_HOST_STACK_STRESS
+    if (esp_timer_get_time() - last_stress_us > CONFIG_HID_HOST_STACK_STRESS_PERIOD_S * 1000000ll) {
+      last_stress_us = esp_timer_get_time();
+      stressReconnect();
+    }
+#endif
     vTaskDelay(10/portTICK_PERIOD_MS);
   }
     
   vTaskDelete(NULL);
 }
 
+/** Event bus, pipeline queue and sink queues */
+static void printQueueStats() {
+  printf("Input bus: %lu events published\n", (unsigned long)input_bus.published());
+  console_sink.printStats();
+#if CONFIG_HID_HOST_USB_PASSTHROUGH_NORMALIZED
+  usb_sink.printStats();
+#endif
+#if CONFIG_HID_HOST_INPUT_STREAM
+  stream_sink.printStats();
+#endif
+#if CONFIG_HID_HOST_PIPELINE_TASK
+  printf("  pipeline queue: %lu waiting (max %lu of %d), %lu dropped\n",
+         (unsigned long)uxQueueMessagesWaiting(pipeline_queue), (unsigned long)pipeline_queue_max.load(),
+         CONFIG_HID_HOST_PIPELINE_QUEUE_LENGTH, (unsigned long)pipeline_drops.load());
+#endif
+#if CONFIG_HID_HOST_USB_PASSTHROUGH
+  usb_passthrough.printStats();
+#endif
+#if CONFIG_HID_HOST_INPUT_STREAM
+  input_stream.printStats();
+#endif
+#if CONFIG_HID_HOST_TELEMETRY
+  telemetry_sink.printStats();
+#endif
+}
+
+/** Per connection setup times, timing model and output report counters */
+static void printConnectionStats() {
+  devices.forEachReady([](HidDevice& device) {
+    printf("Device %d: %lu reports", device.conn_handle, (unsigned long)device.sequence);
+    if (device.battery_level != 0xFF) {
+      printf(", battery %d%%", device.battery_level);
+    }
+    if (device.vendor_id) {
+      printf(", vendor %04x product %04x", device.vendor_id, device.product_id);
+    }
+    printf("\n");
+    device.setup.printStats(device.conn_handle);
+    device.timing.printStats(device.conn_handle);
+    device.output.printStats();
+  });
+}
+
+/** Report path and link security latencies */
+static void printLatencyStats() {
+  printf("Report latency:\n");
+  report_latency.print();
+  for (auto& stats : profile_latency) {
+    stats.print();
+  }
+#if CONFIG_HID_HOST_PIPELINE_TASK
+  wakeup_latency.print();
+#endif
+#if CONFIG_HID_HOST_PROBE
+  probe.printStats();
+#endif
+#if CONFIG_HID_HOST_BONDING
+  printf("Security: %d bonds\n", NimBLEDevice::getNumBonds());
+  pairing_time.print();
+  encryption_restart_time.print();
+  smp_timing.printStats();
+#endif
+}
+
+/** Scan modes, scheduling and what scanning costs the connections */
+static void printScanStats() {
+  printf("Scan mode: %s\n", scanModeName(scanMode()));
+  scan_mode_stats.print();
+  scan_escalation.printStats();
+#if CONFIG_BT_NIMBLE_EXT_ADV
+  printf("  extended advertising %s: %lu extended reports, %lu devices found from one\n",
+         scan_extended ? "on" : "off (legacy only)", (unsigned long)extended_reports.load(),
+         (unsigned long)extended_discoveries.load());
+  for (auto& stats : discovery_time) {
+    stats.print();
+  }
+#endif
+  adv_cache.printStats();
+#if CONFIG_HID_HOST_SOAK_ADVERTISERS
+  advertiser_churn.printStats();
+#endif
+#if CONFIG_HID_HOST_SCAN_SCHEDULER
+  scan_scheduler.printStats(esp_timer_get_time());
+#endif
+  scan_impact.printStats();
+}
+
+static void printHeapStats() {
+  heap_tracker.print();
+#if CONFIG_HID_HOST_STATIC_ALLOCATION
+  AllocationGuard::printStats();
+#endif
+}
+
+static void printTaskStats() {
+#if CONFIG_HID_HOST_TASK_STATS
+  task_monitor.print();
+#endif
+}
+
+static void printStackStats() {
+#if CONFIG_HID_HOST_STACK_MONITOR
+  stack_monitor.sample();
+  stack_monitor.print();
+#endif
+}
+
+#if CONFIG_HID_HOST_TELEMETRY
+/** Builds and sends one telemetry snapshot; report rates and CPU load cover
+ *  the time since the previous one */
+static void sendTelemetry() {
+  static int64_t last_us = 0;
+  auto now_us = esp_timer_get_time();
+  auto period_us = now_us - last_us;
+  last_us = now_us;
+
+  telemetry::SystemRecord system = {};
+  uint8_t mac[6] = {};
+  esp_efuse_mac_get_default(mac);
+  system.unit_id = mac[2] << 24 | mac[3] << 16 | mac[4] << 8 | mac[5];
+  system.uptime_ms = now_us / 1000;
+  system.heap_free = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+  system.heap_min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+  system.heap_largest_block = heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT);
+  /** 0xFFFF: not measured */
+  system.cpu0_load_permille = system.cpu1_load_permille = 0xFFFF;
+#if CONFIG_HID_HOST_TASK_STATS
+  uint16_t load[portNUM_PROCESSORS];
+  if (task_monitor.coreLoad(load)) {
+    system.cpu0_load_permille = load[0];
+#if portNUM_PROCESSORS > 1
+    system.cpu1_load_permille = load[1];
+#endif
+  }
+#endif
+  system.events_published = input_bus.published();
+#if CONFIG_HID_HOST_PIPELINE_TASK
+  system.pipeline_drops = pipeline_drops.load(std::memory_order_relaxed);
+  system.pipeline_queue_max = pipeline_queue_max.load(std::memory_order_relaxed);
+#endif
+  system.connect_attempts = connection_history.count();
+  system.connect_failures = connection_history.failures();
+  system.disconnects = disconnect_count.load(std::memory_order_relaxed);
+  system.report_latency_p50_us = report_latency.percentile(50);
+  system.report_latency_p90_us = report_latency.percentile(90);
+  system.report_latency_p99_us = report_latency.percentile(99);
+  system.report_latency_max_us = report_latency.max();
+  system.scanning = ble_gap_disc_active();
+  system.scan_host_delay_p99_us = scan_impact.hostPercentile(true, 99);
+  system.idle_host_delay_p99_us = scan_impact.hostPercentile(false, 99);
+#if CONFIG_HID_HOST_STATIC_ALLOCATION
+  system.alloc_violations = AllocationGuard::violations();
+#endif
+  telemetry_sink.begin(system);
+
+  devices.forEachReady([&](HidDevice& device) {
+    auto timing = device.timing.summary();
+    telemetry::ConnectionRecord c = {};
+    c.conn_handle = device.conn_handle;
+    struct ble_gap_conn_desc desc;
+    if (ble_gap_conn_find(device.conn_handle, &desc) == 0) {
+      for (int i = 5; i >= 0; i--) c.address = c.address << 8 | desc.peer_id_addr.val[i];
+      c.interval_1250us = desc.conn_itvl;
+      c.peripheral_latency = desc.conn_latency;
+      c.supervision_timeout_10ms = desc.supervision_timeout;
+    }
+    int8_t rssi = 0;
+    c.rssi = ble_gap_conn_rssi(device.conn_handle, &rssi) == 0 ? rssi : INT8_MIN;
+    c.reports = timing.reports;
+    c.report_rate_hz = period_us > 0 ? (timing.reports - device.telemetry_reports) * 1000000ll / period_us : 0;
+    device.telemetry_reports = timing.reports;
+    c.missed_events = timing.missed_events;
+    c.jitter_us = std::min<uint32_t>(timing.jitter_us, UINT16_MAX);
+    c.host_delay_p50_us = timing.host_p50_us;
+    c.host_delay_p99_us = timing.host_p99_us;
+    auto output = device.output.stats();
+    c.output_sent = output.sent;
+    c.output_failed = output.failed;
+    auto first_report_us = device.setup.first_report_us.load(std::memory_order_relaxed);
+    c.first_report_ms = first_report_us && device.setup.start_us
+                          ? (first_report_us - device.setup.start_us) / 1000 : UINT32_MAX;
+    c.battery_level = device.battery_level;
+    telemetry_sink.add(c);
+  });
+  telemetry_sink.send();
+}
+#endif
+
+/** Console output and statistics, at the lowest priority so it never holds up a report */
+void loggingTask (void * parameter){
+#if CONFIG_HID_HOST_FAULT_INJECTION
+  int64_t last_stats_us = esp_timer_get_time();
+#endif
+#if CONFIG_HID_HOST_HEAP_ACCOUNTING
+  int64_t last_heap_us = esp_timer_get_time();
+#endif
+  int64_t last_bus_us = esp_timer_get_time();
+#if CONFIG_HID_HOST_TELEMETRY
+  int64_t last_telemetry_us = esp_timer_get_time();
+#endif
+#if CONFIG_HID_HOST_STACK_MONITOR
+  int64_t last_stack_us = esp_timer_get_time();
+#endif
+#if CONFIG_HID_HOST_STACK_STRESS
+  int64_t last_burst_us = esp_timer_get_time();
+#endif
+  for(;;) {
+#if CONFIG_HID_HOST_FAULT_INJECTION
+    if (esp_timer_get_time() - last_stats_us > CONFIG_HID_HOST_FAULT_REPORT_PERIOD_S * 1000000ll) {
+      last_stats_us = esp_timer_get_time();
+      fault_injector.printStats();
+    }
+#endif
+    console_sink.poll(printInputState);
+    if (esp_timer_get_time() - last_bus_us > CONFIG_HID_HOST_BUS_STATS_PERIOD_S * 1000000ll) {
+      last_bus_us = esp_timer_get_time();
+      printQueueStats();
+      printConnectionStats();
+      printLatencyStats();
+      printScanStats();
+      printTaskStats();
+    }
+#if CONFIG_HID_HOST_STACK_MONITOR
+    if (esp_timer_get_time() - last_stack_us > CONFIG_HID_HOST_STACK_REPORT_PERIOD_S * 1000000ll) {
+      last_stack_us = esp_timer_get_time();
+      printStackStats();
+    }
+#endif
+#if CONFIG_HID_HOST_STACK_STRESS
+    /** every statistic back to back: the logging task's deepest path */
+    if (esp_timer_get_time() - last_burst_us > CONFIG_HID_HOST_STACK_STRESS_PERIOD_S * 1000000ll) {
+      last_burst_us = esp_timer_get_time();
+      printQueueStats();
+      printConnectionStats();
+      printLatencyStats();
+      printScanStats();
+      printHeapStats();
+      printTaskStats();
+      connection_history.print(esp_timer_get_time());
+#if CONFIG_HID_HOST_FAULT_INJECTION
+      fault_injector.printStats();
+#endif
+      stack_monitor.sample();
+    }
+#endif
+#if CONFIG_HID_HOST_TELEMETRY
+    if (esp_timer_get_time() - last_telemetry_us > CONFIG_HID_HOST_TELEMETRY_PERIOD_S * 1000000ll) {
+      last_telemetry_us = esp_timer_get_time();
+      sendTelemetry();
+    }
+#endif
+#if CONFIG_HID_HOST_HEAP_ACCOUNTING
+    if (esp_timer_get_time() - last_heap_us > CONFIG_HID_HOST_HEAP_REPORT_PERIOD_S * 1000000ll) {
+      last_heap_us = esp_timer_get_time();
+      printHeapStats();
+    }
+#endif
+    vTaskDelay(10/portTICK_PERIOD_MS);
+  }
+    
+  vTaskDelete(NULL);
+}
+
+#if CONFIG_HID_HOST_CONSOLE
+/** Stats console commands; each only prints what the report path already keeps */
+static const StatsConsole::Command CONSOLE_COMMANDS[] = {
+  {"latency", "Report path, wake-up and pairing latency histograms",
+   [](int, char**) { printLatencyStats(); return 0; }},
+  {"conns", "Per connection setup times, timing and counters",
+   [](int, char**) { printConnectionStats(); return 0; }},
+  {"queues", "Event bus, pipeline queue and sink watermarks",
+   [](int, char**) { printQueueStats(); return 0; }},
+  {"heap", "Heap use per subsystem and steady state allocations",
+   [](int, char**) { printHeapStats(); return 0; }},
+  {"tasks", "Per task core, priority, CPU use and free stack",
+   [](int, char**) { printTaskStats(); return 0; }},
+  {"profile", "List the performance profiles, or switch to and save one: profile <name>",
+   [](int argc, char** argv) {
+     if (argc < 2) {
+       for (size_t i = 0; i < NUM_PERF_PROFILES; i++) {
+         printf("%c %s\n", i == perf_profile ? '*' : ' ', PERF_PROFILES[i].name);
+         profile_latency[i].print();
+       }
+       return 0;
+     }
+     int index = findPerfProfile(argv[1]);
+     if (index < 0) {
+       printf("No profile %s\n", argv[1]);
+       return 1;
+     }
+     perf_profile_request = index;
+     if (!savePerfProfile(index)) {
+       printf("Could not save the profile\n");
+     }
+     return 0;
+   }},
+  {"scan", "Scan modes, discovery times, scan airtime and the scanning's cost to connections",
+   [](int, char**) { printScanStats(); return 0; }},
+  {"advs", "The advertisers in range, most recently heard first",
+   [](int, char**) { adv_cache.print(esp_timer_get_time() / 1000); return 0; }},
+#if CONFIG_BT_NIMBLE_EXT_ADV
+  {"scanext", "Find devices from extended advertisements too, or from legacy ones only: scanext <on|off>",
+   [](int argc, char** argv) {
+     if (argc >= 2) {
+       scan_extended = !strcmp(argv[1], "on");
+     }
+     printf("extended advertising %s\n", scan_extended ? "on" : "off (legacy only)");
+     return 0;
+   }},
+#endif
+  {"scanmode", "Show the scan mode, or use one until reboot: scanmode <passive|active|on-demand|profile>",
+   [](int argc, char** argv) {
+     if (argc < 2) {
+       printf("%s%s\n", scanModeName(scanMode()),
+              scan_mode_override == ScanMode::COUNT ? " (from the profile)" : "");
+       return 0;
+     }
+     auto mode = findScanMode(argv[1]);
+     if (mode == ScanMode::COUNT && strcmp(argv[1], "profile")) {
+       printf("No scan mode %s\n", argv[1]);
+       return 1;
+     }
+     scan_mode_override = mode;
+#if !CONFIG_HID_HOST_SCAN_SCHEDULER
+     /** (the scan scheduler picks the mode up at its next poll) */
+     perf_profile_request = perf_profile.load();
+#endif
+     return 0;
+   }},
+#if CONFIG_HID_HOST_STACK_MONITOR
+  {"stacks", "Peak stack use per task and suggested stack sizes",
+   [](int, char**) { printStackStats(); return 0; }},
+#endif
+  {"history", "Recent connection attempts and how they ended",
+   [](int, char**) { connection_history.print(esp_timer_get_time()); return 0; }},
+#if CONFIG_HID_HOST_FAULT_INJECTION
+  {"faults", "Fault injector counters",
+   [](int, char**) { fault_injector.printStats(); return 0; }},
+#endif
+};
+static StatsConsole stats_console;
+#endif
+
+#if CONFIG_HID_HOST_PIPELINE_TASK
+/** Decodes, publishes and forwards the reports the BLE host task queued */
+void pipelineTask (void * parameter){
+  static QueuedReport report;
+  for(;;) {
+    TickType_t wait = portMAX_DELAY;
+#if CONFIG_HID_HOST_FAULT_INJECTION
+    /** delayed reports are released here, on time, rather than by another
+     *  task racing this one through the pipeline */
+    auto release_us = fault_injector.nextReleaseUs();
+    if (release_us >= 0) {
+      auto in_us = release_us - esp_timer_get_time();
+      wait = in_us > 0 ? std::max<TickType_t>(1, pdMS_TO_TICKS((in_us + 999) / 1000)) : 0;
+    }
+#endif
+    bool received = xQueueReceive(pipeline_queue, &report, wait) == pdTRUE;
+#if CONFIG_HID_HOST_FAULT_INJECTION
+    fault_injector.poll();
+#endif
+    if (!received) {
+      continue;
+    }
+    wakeup_latency.record(esp_timer_get_time() - report.rx_us);
+    runPipeline(report.conn_handle, report.char_handle, report.data, report.length);
+    auto latency_us = esp_timer_get_time() - report.rx_us;
+    report_latency.record(latency_us);
+    profile_latency[perf_profile.load(std::memory_order_relaxed)].record(latency_us);
+  }
+}
+#endif
+
+#if CONFIG_HID_HOST_INPUT_STREAM
+/** Batches everything published on the bus into one stream frame per tick */
+void streamTask (void * parameter){
+  TickType_t last_wake = xTaskGetTickCount();
+  for(;;) {
+    vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(CONFIG_HID_HOST_INPUT_STREAM_TICK_MS));
+    /** whatever does not fit stays on the bus for the next tick */
+    stream_sink.poll([](const InputState& s) { input_stream.add(s); }, InputStream::MAX_EVENTS_PER_FRAME);
+    input_stream.flush();
+  }
+}
+#endif
+
+#if CONFIG_HID_HOST_STATIC_ALLOCATION
+/** Heap use is expected from the tasks that scan and set devices up: the
+ *  BLE host (advertiser results, discovery) and the connect task (the accept
+ *  list of an on-demand burst, connecting). The static allocation mode
+ *  needs the pipeline task, so the host task only times a report and copies
+ *  it into the pipeline queue; from there on it is guarded. */
+static void permitAllocations(TaskHandle_t connect_task) {
+  if (!AllocationGuard::permitTask(xTaskGetHandle("nimble_host")) || !AllocationGuard::permitTask(connect_task)) {
+    printf("Allocation guard: could not find the BLE host or connect task\n");
+  }
+#if CONFIG_HID_HOST_CONSOLE
+  /** the console's line editing uses the heap; it is nowhere near the report path */
+  AllocationGuard::permitTask(xTaskGetHandle("console_repl"));
+#endif
+}
+#endif
+
+#if CONFIG_HID_HOST_SOAK
+void soakTask (void * parameter){
+  soak_source.run();
+}
+#endif
+
 void app_main (void){
+#if CONFIG_HID_HOST_STACK_MONITOR
+  stack_monitor.addSystemTasks();
+  stack_monitor.add("connectTask", CONFIG_HID_HOST_CONNECT_TASK_STACK_SIZE, "HID_HOST_CONNECT_TASK_STACK_SIZE");
+  stack_monitor.add("loggingTask", CONFIG_HID_HOST_LOGGING_TASK_STACK_SIZE, "HID_HOST_LOGGING_TASK_STACK_SIZE");
+#if CONFIG_HID_HOST_PIPELINE_TASK
+  stack_monitor.add("pipelineTask", CONFIG_HID_HOST_PIPELINE_TASK_STACK_SIZE, "HID_HOST_PIPELINE_TASK_STACK_SIZE");
+#endif
+#if CONFIG_HID_HOST_INPUT_STREAM
+  stack_monitor.add("streamTask", CONFIG_HID_HOST_STREAM_TASK_STACK_SIZE, "HID_HOST_STREAM_TASK_STACK_SIZE");
+#endif
+#if CONFIG_HID_HOST_SOAK
+  stack_monitor.add("soakTask", CONFIG_HID_HOST_SOAK_TASK_STACK_SIZE, "HID_HOST_SOAK_TASK_STACK_SIZE");
+#endif
+#if CONFIG_HID_HOST_CONSOLE
+  stack_monitor.add("console_repl", CONFIG_HID_HOST_CONSOLE_TASK_STACK_SIZE, "HID_HOST_CONSOLE_TASK_STACK_SIZE");
+#endif
+#endif
+#if CONFIG_HID_HOST_BENCHMARKS
+  benchmarks::runAll();
+#endif
   printf("Starting NimBLE Client\n");
   /** Initialize NimBLE, no device name spcified as we are not advertising */
   NimBLEDevice::init("");
+  /** the saved performance profile, else the configured one (NVS is up now) */
+  int profile = loadPerfProfile();
+  if (profile < 0) {
+    profile = findPerfProfile(CONFIG_HID_HOST_PERF_PROFILE);
+  }
+  perf_profile = profile < 0 ? 0 : profile;
+
+#if CONFIG_HID_HOST_PIPELINE_TASK
+  /** the pipeline must be up before the first notification can arrive */
+  pipeline_queue = xQueueCreateStatic(CONFIG_HID_HOST_PIPELINE_QUEUE_LENGTH, sizeof(QueuedReport),
+                                      pipeline_queue_items, &pipeline_queue_storage);
+  xTaskCreatePinnedToCore(pipelineTask, "pipelineTask", CONFIG_HID_HOST_PIPELINE_TASK_STACK_SIZE, NULL, CONFIG_HID_HOST_PIPELINE_PRIORITY,
+                          NULL, PIPELINE_CORE);
+#endif
+  ble_gap_event_listener_register(&gap_event_listener, gapEventListener, nullptr);
 
-  // set up the gpio we'll toggle every time we get an input report
-  static int pin_level = 0;
-  gpio_config_t io_conf;
-  memset(&io_conf, 0, sizeof(io_conf));
-  io_conf.intr_type = GPIO_INTR_DISABLE;
-  io_conf.pin_bit_mask = (1<<RECV_GPIO);
-  io_conf.mode = GPIO_MODE_OUTPUT;
-  io_conf.pull_up_en = GPIO_PULLUP_ENABLE;
-  io_conf.pull_down_en = GPIO_PULLDOWN_DISABLE;
-  gpio_config(&io_conf);
-  // now set the initial level to low
-  gpio_set_level((gpio_num_t)RECV_GPIO, pin_level);
+#if CONFIG_HID_HOST_STATIC_ALLOCATION
+  /** one client per possible connection, reused for every reconnect and never deleted */
+  for (size_t i = 0; i < NIMBLE_MAX_CONNECTIONS; i++) {
+    auto pClient = NimBLEDevice::createClient();
+    pClient->setClientCallbacks(&clientCB);
+    requestProfileConnParams(pClient, false);
+  }
+#endif
+
+#if CONFIG_HID_HOST_PROBE
+  /** pins of the stages that have one; the rest stay unmarked */
+  for (size_t i = 0; i < (size_t)LogicProbe::Stage::COUNT; i++) {
+    if (probe_pins[i].start()) {
+      probe.attach((LogicProbe::Stage)i, &probe_pins[i]);
+    }
+  }
+#endif
     
   /** Set the IO capabilities of the device, each option will trigger a different pairing method.
    *  BLE_HS_IO_KEYBOARD_ONLY    - Passkey pairing
@@ -301,6 +2018,13 @@ void app_main (void){
   //NimBLEDevice::setSecurityIOCap(BLE_HS_IO_KEYBOARD_ONLY); // use passkey
   //NimBLEDevice::setSecurityIOCap(BLE_HS_IO_DISPLAY_YESNO); //use numeric comparison
   
+#if CONFIG_HID_HOST_BONDING
+  /** bonding, no man in the middle protection, secure connections; the
+   *  keys are kept in NVS (CONFIG_BT_NIMBLE_NVS_PERSIST) across reboots */
+  NimBLEDevice::setSecurityAuth(BLE_SM_PAIR_AUTHREQ_BOND | BLE_SM_PAIR_AUTHREQ_SC);
+  bond_lru.load();
+  printf("%d bonded peers\n", NimBLEDevice::getNumBonds());
+#else
   /** 2 different ways to set security - both calls achieve the same result.
    *  no bonding, no man in the middle protection, secure connections.
    *
@@ -308,9 +2032,9 @@ void app_main (void){
    */
   NimBLEDevice::setSecurityAuth(false, false, false); // NOTE: last was true
   NimBLEDevice::setSecurityAuth(/*BLE_SM_PAIR_AUTHREQ_BOND | BLE_SM_PAIR_AUTHREQ_MITM |*/ BLE_SM_PAIR_AUTHREQ_SC);
+#endif
   
-  /** Optional: set the transmit power, default is -3db */
-  NimBLEDevice::setPower(ESP_PWR_LVL_P9); /** 12db */
+  /** The transmit power (default is -3db) comes from the performance profile */
     
   /** Optional: set any devices you don't want to get advertisments from */
   // NimBLEDevice::addIgnored(NimBLEAddress ("aa:bb:cc:dd:ee:ff"));
@@ -320,22 +2044,61 @@ void app_main (void){
     
   /** create a callback that gets called when advertisers are found */
   pScan->setScanCallbacks (new scanCallbacks());
+  /** NimBLE keeps no results (scanning forever, they would fill the heap);
+   *  the advertiser cache keeps what we need of them in a fixed size */
+  pScan->setMaxResults(0);
     
-  /** Set scan interval (how often) and window (how long) in milliseconds */
-  pScan->setInterval(100);
-  pScan->setWindow(99);
-    
-  /** Active scan will gather scan response data from advertisers
-   *  but will use more energy from both devices
-   */
-  pScan->setActiveScan(true);
+  /** Scan interval (how often) and window (how long) in milliseconds, and
+   *  active scanning, which gathers scan response data from advertisers
+   *  but uses more energy on both sides, come from the profile */
+  applyPerfProfile(perf_profile);
   /** Start scanning for advertisers for the scan time specified (in seconds) 0 = forever
    *  Optional callback for when scanning stops.
    */
-  pScan->start(scanTime);
+  requestScan();
     
   printf("Scanning for peripherals\n");
     
-  xTaskCreate(connectTask, "connectTask", 5000, NULL, 1, NULL);
+  TaskHandle_t connect_task = nullptr;
+  xTaskCreatePinnedToCore(connectTask, "connectTask", CONFIG_HID_HOST_CONNECT_TASK_STACK_SIZE, NULL,
+                          CONNECT_PRIORITY, &connect_task, CONNECT_CORE);
+  xTaskCreatePinnedToCore(loggingTask, "loggingTask", CONFIG_HID_HOST_LOGGING_TASK_STACK_SIZE, NULL,
+                          LOGGING_PRIORITY, NULL, LOGGING_CORE);
+#if CONFIG_HID_HOST_INPUT_STREAM
+  if (input_stream.start()) {
+    xTaskCreatePinnedToCore(streamTask, "streamTask", CONFIG_HID_HOST_STREAM_TASK_STACK_SIZE, NULL, 2, NULL,
+                            PIPELINE_CORE);
+  } else {
+    printf("Could not start the input stream link\n");
+  }
+#endif
+#if CONFIG_HID_HOST_TELEMETRY
+  if (!telemetry_sink.start()) {
+    printf("Could not start the telemetry link\n");
+  }
+#endif
+#if CONFIG_HID_HOST_SOAK
+  if (soak_source.attach(devices)) {
+    /** stands in for the radio, so it runs on the BLE host's side */
+    xTaskCreatePinnedToCore(soakTask, "soakTask", CONFIG_HID_HOST_SOAK_TASK_STACK_SIZE, NULL, 1, NULL, CONNECT_CORE);
+  } else {
+    printf("No free device slot for the soak source\n");
+  }
+#endif
+#if CONFIG_HID_HOST_CONSOLE
+  if (!stats_console.start(CONSOLE_COMMANDS, sizeof(CONSOLE_COMMANDS) / sizeof(CONSOLE_COMMANDS[0]),
+                           LOGGING_PRIORITY)) {
+    printf("Could not start the stats console\n");
+  }
+#endif
+#if CONFIG_HID_HOST_STACK_MONITOR
+  /** the main task ends when app_main returns; note its peak first */
+  stack_monitor.sample();
+#endif
+#if CONFIG_HID_HOST_STATIC_ALLOCATION
+  /** everything from here on should come from the static pools */
+  permitAllocations(connect_task);
+  AllocationGuard::arm();
+#endif
 }
 
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "probe_pin.hpp"
+
+/** ProbePin that records every pulse train with the time it was queued,
+ *  for checking probe output off target. Not for the report path: it
+ *  allocates. */
+class MockProbePin : public ProbePin {
+public:
+  struct Transmission {
+    int64_t time_ns;
+    std::vector<Pulse> pulses;
+  };
+
+  bool start() override { return true; }
+
+  bool transmit(const Pulse *pulses, size_t count) override {
+    if (busy_) return false;
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    transmissions_.push_back({std::chrono::duration_cast<std::chrono::nanoseconds>(now).count(),
+                              std::vector<Pulse>(pulses, pulses + count)});
+    return true;
+  }
+
+  /** Make transmit() fail, as a pin still sending would. */
+  void setBusy(bool busy) { busy_ = busy; }
+
+  const std::vector<Transmission> &transmissions() const { return transmissions_; }
+  void clear() { transmissions_.clear(); }
+
+protected:
+  bool busy_{false};
+  std::vector<Transmission> transmissions_;
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#include "input_state.hpp"
+
+/** Sums a device's relative motion (dx, dy, wheel) between consumer polls.
+ *
+ *  The report side add()s each report's motion, scaled by a fixed-point
+ *  sensitivity; a consumer drain()s whole counts at its own rate, e.g.
+ *  once per USB poll. Nothing is lost or counted twice whatever the two
+ *  rates are:
+ *   - the fraction left over by the sensitivity scaling stays behind as a
+ *     sub-count carry for the next drain,
+ *   - counts beyond what the consumer can take at once (e.g. +-127 for a
+ *     boot mouse report) stay behind too,
+ *   - the accumulators saturate instead of wrapping if nobody drains.
+ *
+ *  Each axis is one atomic word: add() is a CAS loop that only retries if
+ *  a drain hit the same word in between, drain() is an exchange plus an
+ *  add of whatever it leaves behind. Neither side ever waits for the other.
+ *  Axes are drained one after the other, so one report's dx and dy can
+ *  land in consecutive drains; the totals are still exact.
+ */
+class MotionAccumulator {
+public:
+  static constexpr int FRACTION_BITS = 8;
+  static constexpr int32_t ONE = 1 << FRACTION_BITS;
+  /** Accumulators saturate here, well clear of int32_t overflow on add. */
+  static constexpr int32_t LIMIT = INT32_MAX / 2;
+
+  /** Sensitivity in 1/256 counts per input count (256 = 1:1). */
+  void setScale(int32_t scale_q8) { scale_q8_ = scale_q8; }
+
+  void reset() {
+    for (auto &a : accum_) a.store(0, std::memory_order_relaxed);
+  }
+
+  /** Report side: add one report's motion. */
+  void add(const std::array<int16_t, InputState::NUM_MOTION> &motion) {
+    for (size_t i = 0; i < InputState::NUM_MOTION; i++) {
+      if (motion[i]) addSaturating(accum_[i], motion[i] * scale_q8_);
+    }
+  }
+
+  /** Consumer side: take the whole counts gathered since the last drain,
+   *  at most max_counts per axis, leaving the rest for the next one. */
+  std::array<int16_t, InputState::NUM_MOTION> drain(int16_t max_counts = INT16_MAX) {
+    std::array<int16_t, InputState::NUM_MOTION> out;
+    for (size_t i = 0; i < InputState::NUM_MOTION; i++) {
+      int32_t taken = accum_[i].exchange(0, std::memory_order_acq_rel);
+      int32_t whole = taken >> FRACTION_BITS; // floor, so the carry is always 0..ONE-1
+      if (whole > max_counts) whole = max_counts;
+      if (whole < -max_counts) whole = -max_counts;
+      int32_t left = taken - whole * ONE;
+      if (left) addSaturating(accum_[i], left);
+      out[i] = whole;
+    }
+    return out;
+  }
+
+  /** Whole counts waiting, without draining them. */
+  int32_t pending(size_t axis) const {
+    return accum_[axis].load(std::memory_order_relaxed) >> FRACTION_BITS;
+  }
+
+protected:
+  static void addSaturating(std::atomic<int32_t> &a, int32_t delta) {
+    int32_t current = a.load(std::memory_order_relaxed);
+    int32_t next;
+    do {
+      next = current + delta;
+      if (next > LIMIT) next = LIMIT;
+      if (next < -LIMIT) next = -LIMIT;
+    } while (!a.compare_exchange_weak(current, next, std::memory_order_acq_rel, std::memory_order_relaxed));
+  }
+
+  std::array<std::atomic<int32_t>, InputState::NUM_MOTION> accum_{};
+  int32_t scale_q8_{ONE};
+};
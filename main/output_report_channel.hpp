@@ -0,0 +1,232 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+#include "esp_timer.h"
+#include "host/ble_gatt.h"
+
+/** Coalescing, paced output report path (rumble, LEDs, ...) for one device.
+ *
+ *  Consumers submit output reports at whatever rate they like; only the
+ *  newest report per report ID is kept. A one-shot timer sends at most one
+ *  pending report per connection interval, round robin over report IDs, so
+ *  output never takes more than one PDU of a connection event and input
+ *  notifications never queue behind it. The timer is armed only while
+ *  reports are pending, so an idle channel costs no wakeups. Reports
+ *  go out with write-without-response when the characteristic allows it;
+ *  otherwise the next write waits for the previous response.
+ */
+class OutputReportChannel {
+public:
+  static constexpr size_t MAX_REPORTS = 4;
+  static constexpr size_t MAX_REPORT_SIZE = 64;
+
+  OutputReportChannel() = default;
+  OutputReportChannel(const OutputReportChannel &) = delete;
+  OutputReportChannel &operator=(const OutputReportChannel &) = delete;
+
+  ~OutputReportChannel() {
+    if (timer_) {
+      esp_timer_stop(timer_);
+      esp_timer_delete(timer_);
+    }
+  }
+
+  /** Forget all targets and pending reports, for a new connection. */
+  void reset(uint16_t conn_handle) {
+    stop();
+    std::lock_guard<std::mutex> lk(mutex_);
+    conn_handle_ = conn_handle;
+    num_slots_ = 0;
+    next_slot_ = 0;
+    in_flight_ = false;
+    last_send_us_ = 0;
+    stats_ = Stats();
+  }
+
+  /** Register the output report characteristic for a report ID. */
+  bool addTarget(uint8_t report_id, uint16_t value_handle, bool write_no_response) {
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (num_slots_ == MAX_REPORTS) return false;
+    auto &slot = slots_[num_slots_++];
+    slot.report_id = report_id;
+    slot.value_handle = value_handle;
+    slot.write_no_response = write_no_response;
+    slot.dirty = false;
+    return true;
+  }
+
+  size_t numTargets() const { return num_slots_; }
+
+  /** Start (or re-pace) sending, one report per connection interval. */
+  void start(uint32_t interval_us) {
+    if (!num_slots_) return;
+    if (!timer_) {
+      esp_timer_create_args_t args = {};
+      args.callback = &OutputReportChannel::onTimer;
+      args.arg = this;
+      args.name = "output_reports";
+      if (esp_timer_create(&args, &timer_) != ESP_OK) return;
+    }
+    std::lock_guard<std::mutex> lk(mutex_);
+    esp_timer_stop(timer_);
+    armed_ = false;
+    interval_us_ = interval_us;
+    running_ = true;
+    if (anyDirty()) armLocked();
+  }
+
+  void stop() {
+    std::lock_guard<std::mutex> lk(mutex_);
+    running_ = false;
+    armed_ = false;
+    if (timer_) esp_timer_stop(timer_);
+  }
+
+  /** Queue an output report; replaces any unsent report with the same ID.
+   *  Returns false if the device has no such output report. */
+  bool submit(uint8_t report_id, const uint8_t *data, size_t length) {
+    if (length > MAX_REPORT_SIZE) return false;
+    std::lock_guard<std::mutex> lk(mutex_);
+    for (size_t i = 0; i < num_slots_; i++) {
+      auto &slot = slots_[i];
+      if (slot.report_id != report_id) continue;
+      stats_.submitted++;
+      if (slot.dirty) stats_.coalesced++;
+      memcpy(slot.data, data, length);
+      slot.length = length;
+      slot.dirty = true;
+      if (!armed_) armLocked();
+      return true;
+    }
+    return false;
+  }
+
+  struct Stats {
+    uint32_t submitted{0};
+    uint32_t coalesced{0};
+    uint32_t sent{0};
+    uint32_t failed{0};
+  };
+
+  Stats stats() {
+    std::lock_guard<std::mutex> lk(mutex_);
+    return stats_;
+  }
+
+  void printStats() {
+    Stats s;
+    {
+      std::lock_guard<std::mutex> lk(mutex_);
+      if (!num_slots_) return;
+      s = stats_;
+    }
+    printf("  output reports (device %d): submitted %lu, coalesced %lu, sent %lu, failed %lu\n",
+           conn_handle_, (unsigned long)s.submitted, (unsigned long)s.coalesced,
+           (unsigned long)s.sent, (unsigned long)s.failed);
+  }
+
+protected:
+  struct Slot {
+    uint8_t report_id{0};
+    uint16_t value_handle{0};
+    bool write_no_response{false};
+    bool dirty{false};
+    uint8_t length{0};
+    uint8_t data[MAX_REPORT_SIZE];
+  };
+
+  bool anyDirty() const {
+    for (size_t i = 0; i < num_slots_; i++) {
+      if (slots_[i].dirty) return true;
+    }
+    return false;
+  }
+
+  /** Arm the timer for the next send, one interval after the last one. */
+  void armLocked() {
+    if (!running_) return;
+    int64_t delay_us = std::max<int64_t>(0, last_send_us_ + interval_us_ - esp_timer_get_time());
+    armed_ = esp_timer_start_once(timer_, delay_us) == ESP_OK;
+  }
+
+  static void onTimer(void *arg) {
+    static_cast<OutputReportChannel *>(arg)->sendOne();
+  }
+
+  static int onWriteComplete(uint16_t conn_handle, const struct ble_gatt_error *error,
+                             struct ble_gatt_attr *attr, void *arg) {
+    auto channel = static_cast<OutputReportChannel *>(arg);
+    std::lock_guard<std::mutex> lk(channel->mutex_);
+    channel->in_flight_ = false;
+    if (error->status == 0) {
+      channel->stats_.sent++;
+    } else {
+      channel->stats_.failed++;
+    }
+    return 0;
+  }
+
+  void sendOne() {
+    Slot slot;
+    uint16_t conn_handle;
+    {
+      std::lock_guard<std::mutex> lk(mutex_);
+      armed_ = false;
+      if (!running_) return;
+      if (in_flight_) {
+        // try again next interval, the response should be in by then
+        armed_ = esp_timer_start_once(timer_, interval_us_) == ESP_OK;
+        return;
+      }
+      size_t i = 0;
+      for (; i < num_slots_; i++) {
+        if (slots_[(next_slot_ + i) % num_slots_].dirty) break;
+      }
+      if (i == num_slots_) return;
+      auto &pending = slots_[(next_slot_ + i) % num_slots_];
+      next_slot_ = (next_slot_ + i + 1) % num_slots_;
+      pending.dirty = false;
+      slot = pending;
+      conn_handle = conn_handle_;
+      if (!slot.write_no_response) in_flight_ = true;
+      last_send_us_ = esp_timer_get_time();
+    }
+    int rc;
+    if (slot.write_no_response) {
+      rc = ble_gattc_write_no_rsp_flat(conn_handle, slot.value_handle, slot.data, slot.length);
+    } else {
+      rc = ble_gattc_write_flat(conn_handle, slot.value_handle, slot.data, slot.length,
+                                &OutputReportChannel::onWriteComplete, this);
+    }
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (rc == 0) {
+      // a write with response counts once it is answered (onWriteComplete)
+      if (slot.write_no_response) stats_.sent++;
+    } else {
+      stats_.failed++;
+      in_flight_ = false;
+    }
+    // more to send (maybe submitted meanwhile): the next one an interval on
+    if (!armed_ && anyDirty()) armLocked();
+  }
+
+  std::mutex mutex_;
+  esp_timer_handle_t timer_{nullptr};
+  uint16_t conn_handle_{0xFFFF};
+  std::array<Slot, MAX_REPORTS> slots_;
+  size_t num_slots_{0};
+  size_t next_slot_{0};
+  bool in_flight_{false};
+  /** the one-shot timer is pending */
+  bool armed_{false};
+  bool running_{false};
+  uint32_t interval_us_{0};
+  int64_t last_send_us_{0};
+  Stats stats_;
+};
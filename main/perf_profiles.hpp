@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "esp_bt.h"
+#include "nvs.h"
+
+#include "scan_mode.hpp"
+
+/** A named set of the settings that trade latency against power: scan
+ *  duty, TX power, the connection parameters asked of each device, the
+ *  CPU clock range and light sleep. Switched at run time from the console
+ *  ("profile <name>") and remembered in NVS. */
+struct PerfProfile {
+  const char *name;
+  uint16_t scan_interval_ms;
+  uint16_t scan_window_ms;
+  ScanMode scan_mode;
+  esp_power_level_t tx_power;
+  /** Connection parameters, in the BLE units: 1.25 ms, events, 10 ms. */
+  uint16_t conn_interval_min;
+  uint16_t conn_interval_max;
+  uint16_t conn_latency;
+  uint16_t supervision_timeout;
+  /** CPU clock range for dynamic frequency scaling. */
+  uint16_t cpu_max_mhz;
+  uint16_t cpu_min_mhz;
+  /** Let the chip light sleep between connection events. */
+  bool light_sleep;
+};
+
+/** Built-in profiles; the first one is the default. */
+static const PerfProfile PERF_PROFILES[] = {
+  {
+    /** near continuous scanning (scan requests only where the
+     *  advertisement leaves the device's kind open), the shortest
+     *  connection interval, full clock, never sleep */
+    .name = "low-latency",
+    .scan_interval_ms = 100,
+    .scan_window_ms = 99,
+    .scan_mode = ScanMode::ON_DEMAND,
+    .tx_power = ESP_PWR_LVL_P9,
+    .conn_interval_min = 6,
+    .conn_interval_max = 6,
+    .conn_latency = 0,
+    .supervision_timeout = 15,
+    .cpu_max_mhz = 240,
+    .cpu_min_mhz = 240,
+    .light_sleep = false,
+  },
+  {
+    /** 10% scan duty, 15 - 30 ms intervals the peripheral may skip up
+     *  to 4 of while idle, 0 dBm, DFS down to 40 MHz with light sleep */
+    .name = "efficient",
+    .scan_interval_ms = 640,
+    .scan_window_ms = 64,
+    .scan_mode = ScanMode::ON_DEMAND,
+    .tx_power = ESP_PWR_LVL_N0,
+    .conn_interval_min = 12,
+    .conn_interval_max = 24,
+    .conn_latency = 4,
+    .supervision_timeout = 400,
+    .cpu_max_mhz = 160,
+    .cpu_min_mhz = 40,
+    .light_sleep = true,
+  },
+};
+
+static constexpr size_t NUM_PERF_PROFILES = sizeof(PERF_PROFILES) / sizeof(PERF_PROFILES[0]);
+
+/** Index of the profile with that name, or -1. */
+static inline int findPerfProfile(const char *name) {
+  for (size_t i = 0; i < NUM_PERF_PROFILES; i++) {
+    if (name && !strcmp(PERF_PROFILES[i].name, name)) return i;
+  }
+  return -1;
+}
+
+/** NVS key of the selected profile, next to the bond order. */
+static constexpr const char *PERF_PROFILE_NVS_NAMESPACE = "hid_host";
+static constexpr const char *PERF_PROFILE_NVS_KEY = "perf_profile";
+
+/** The profile saved by savePerfProfile(), or -1. */
+static inline int loadPerfProfile() {
+  nvs_handle_t nvs;
+  if (nvs_open(PERF_PROFILE_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) return -1;
+  char name[32];
+  size_t length = sizeof(name);
+  int index = nvs_get_str(nvs, PERF_PROFILE_NVS_KEY, name, &length) == ESP_OK ? findPerfProfile(name) : -1;
+  nvs_close(nvs);
+  return index;
+}
+
+static inline bool savePerfProfile(size_t index) {
+  nvs_handle_t nvs;
+  if (nvs_open(PERF_PROFILE_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) return false;
+  bool ok = nvs_set_str(nvs, PERF_PROFILE_NVS_KEY, PERF_PROFILES[index].name) == ESP_OK &&
+            nvs_commit(nvs) == ESP_OK;
+  nvs_close(nvs);
+  return ok;
+}
@@ -0,0 +1,43 @@
+#include "esp_private/esp_clk.h"
+
+#include "power_control.hpp"
+
+bool PowerControl::apply(uint16_t cpu_max_mhz, uint16_t cpu_min_mhz, bool light_sleep) {
+#if CONFIG_PM_ENABLE
+  if (!cpu_lock_ && (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "profile_cpu", &cpu_lock_) != ESP_OK ||
+                     esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "profile_sleep", &sleep_lock_) != ESP_OK)) {
+    return false;
+  }
+  esp_pm_config_esp32s3_t config = {};
+  config.max_freq_mhz = cpu_max_mhz;
+  config.min_freq_mhz = cpu_min_mhz;
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+  config.light_sleep_enable = light_sleep;
+#endif
+  if (esp_pm_configure(&config) != ESP_OK) {
+    return false;
+  }
+  bool hold_cpu = cpu_min_mhz >= cpu_max_mhz;
+  if (hold_cpu != cpu_held_) {
+    hold_cpu ? esp_pm_lock_acquire(cpu_lock_) : esp_pm_lock_release(cpu_lock_);
+    cpu_held_ = hold_cpu;
+  }
+  if (light_sleep == sleep_held_) {
+    light_sleep ? esp_pm_lock_release(sleep_lock_) : esp_pm_lock_acquire(sleep_lock_);
+    sleep_held_ = !light_sleep;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+void PowerControl::release() {
+#if CONFIG_PM_ENABLE
+  if (cpu_held_) esp_pm_lock_release(cpu_lock_);
+  if (sleep_held_) esp_pm_lock_release(sleep_lock_);
+  cpu_held_ = sleep_held_ = false;
+#endif
+}
+
+uint32_t PowerControl::cpuMhz() { return esp_clk_cpu_freq() / 1000000; }
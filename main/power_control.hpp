@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+
+#include "sdkconfig.h"
+#if CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
+
+/** CPU clock range and light sleep, through ESP-IDF power management.
+ *
+ *  Needs CONFIG_PM_ENABLE (and CONFIG_FREERTOS_USE_TICKLESS_IDLE for light
+ *  sleep); without it apply() does nothing and the CPU stays at its boot
+ *  frequency. When a profile wants neither a lower clock nor light sleep,
+ *  power management locks pin the CPU at its maximum and keep the chip
+ *  awake, so nothing else that configures power management can slow the
+ *  report path down.
+ */
+class PowerControl {
+public:
+  /** Returns false if power management is not available. */
+  bool apply(uint16_t cpu_max_mhz, uint16_t cpu_min_mhz, bool light_sleep);
+
+  /** Let go of the locks; the clock range and light sleep stay configured. */
+  void release();
+
+  /** Current CPU clock. */
+  static uint32_t cpuMhz();
+
+protected:
+#if CONFIG_PM_ENABLE
+  esp_pm_lock_handle_t cpu_lock_{nullptr};
+  esp_pm_lock_handle_t sleep_lock_{nullptr};
+  bool cpu_held_{false};
+  bool sleep_held_{false};
+#endif
+};
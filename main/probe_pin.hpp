@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/** One output pin of the logic probe, driven by hardware timing.
+ *
+ *  A transmission is a train of pulses, each high then low for a number of
+ *  LogicProbe::TICK_HZ ticks, starting from a low idle level. The pin owns
+ *  the timing of the edges once transmit() has returned, so it can be
+ *  backed by a peripheral such as RMT on the target or by a mock that
+ *  records what it was asked to send when running off target.
+ */
+class ProbePin {
+public:
+  struct Pulse {
+    uint16_t high; /**< Ticks high. */
+    uint16_t low;  /**< Ticks low after it. */
+  };
+
+  virtual ~ProbePin() = default;
+
+  /** Configure the pin. False if it is not available. */
+  virtual bool start() = 0;
+
+  /** Queue a pulse train, copying it. Must not block: returns false if the
+   *  pin is still busy with earlier trains. */
+  virtual bool transmit(const Pulse *pulses, size_t count) = 0;
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstring>
+
+#include "input_remapper.hpp"
+
+/** Built-in remap profiles, picked by advertised device name at connect
+ *  time. The first profile whose name_match is contained in the device name
+ *  wins; the last entry matches everything. */
+static const RemapProfile REMAP_PROFILES[] = {
+  {
+    .name = "nintendo-layout",
+    .name_match = "Pro Controller",
+    /** swap A/B and X/Y so the face buttons match their printed labels */
+    .identity_buttons = false,
+    .buttons = {1, 0, 3, 2, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+                16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31},
+  },
+  {
+    .name = "flight-stick",
+    .name_match = "Flight",
+    /** pull back to climb */
+    .invert_axes = 1 << InputState::Y,
+  },
+  {
+    .name = "identity",
+    .name_match = nullptr,
+  },
+};
+
+/** Find the profile for a device by its advertised name. */
+static inline const RemapProfile &selectRemapProfile(const char *device_name) {
+  for (auto &profile : REMAP_PROFILES) {
+    if (!profile.name_match || (device_name && strstr(device_name, profile.name_match))) {
+      return profile;
+    }
+  }
+  return REMAP_PROFILES[sizeof(REMAP_PROFILES) / sizeof(REMAP_PROFILES[0]) - 1];
+}
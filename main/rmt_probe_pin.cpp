@@ -0,0 +1,66 @@
+#include "sdkconfig.h"
+
+#if CONFIG_HID_HOST_PROBE
+
+#include "esp_attr.h"
+
+#include "rmt_probe_pin.hpp"
+
+bool RmtProbePin::start() {
+  if (channel_) {
+    return true;
+  }
+  if (gpio_ < 0) {
+    return false;
+  }
+  rmt_tx_channel_config_t channel_config = {};
+  channel_config.gpio_num = gpio_;
+  channel_config.clk_src = RMT_CLK_SRC_DEFAULT;
+  channel_config.resolution_hz = LogicProbe::TICK_HZ;
+  channel_config.mem_block_symbols = SOC_RMT_MEM_WORDS_PER_CHANNEL;
+  channel_config.trans_queue_depth = QUEUE_DEPTH;
+  if (rmt_new_tx_channel(&channel_config, &channel_) != ESP_OK) {
+    channel_ = nullptr;
+    return false;
+  }
+  rmt_copy_encoder_config_t encoder_config = {};
+  rmt_new_copy_encoder(&encoder_config, &encoder_);
+  rmt_tx_event_callbacks_t callbacks = {};
+  callbacks.on_trans_done = onTransmitDone;
+  rmt_tx_register_event_callbacks(channel_, &callbacks, this);
+  rmt_enable(channel_);
+  return true;
+}
+
+bool RmtProbePin::transmit(const Pulse *pulses, size_t count) {
+  if (!channel_ || count > LogicProbe::MAX_PULSES) {
+    return false;
+  }
+  /** rmt_transmit() would block on a full queue, so don't let it fill */
+  if (in_flight_.load(std::memory_order_acquire) >= QUEUE_DEPTH) {
+    return false;
+  }
+  auto symbols = buffers_[next_];
+  next_ = (next_ + 1) % QUEUE_DEPTH;
+  for (size_t i = 0; i < count; i++) {
+    symbols[i].level0 = 1;
+    symbols[i].duration0 = pulses[i].high;
+    symbols[i].level1 = 0;
+    symbols[i].duration1 = pulses[i].low;
+  }
+  rmt_transmit_config_t transmit_config = {};
+  in_flight_.fetch_add(1, std::memory_order_acq_rel);
+  if (rmt_transmit(channel_, encoder_, symbols, count * sizeof(rmt_symbol_word_t), &transmit_config) != ESP_OK) {
+    in_flight_.fetch_sub(1, std::memory_order_acq_rel);
+    return false;
+  }
+  return true;
+}
+
+bool IRAM_ATTR RmtProbePin::onTransmitDone(rmt_channel_handle_t channel, const rmt_tx_done_event_data_t *event,
+                                           void *arg) {
+  static_cast<RmtProbePin *>(arg)->in_flight_.fetch_sub(1, std::memory_order_acq_rel);
+  return false;
+}
+
+#endif // CONFIG_HID_HOST_PROBE
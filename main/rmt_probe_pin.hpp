@@ -0,0 +1,37 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "driver/rmt_tx.h"
+
+#include "logic_probe.hpp"
+#include "probe_pin.hpp"
+
+/** ProbePin on an RMT TX channel.
+ *
+ *  rmt_transmit() starts the pulse train from the channel's own memory, so
+ *  the first edge follows the call by a fixed delay and the widths are
+ *  exact. Up to QUEUE_DEPTH trains can be queued; transmit() refuses more
+ *  rather than block the caller. A gpio of -1 leaves the pin unused.
+ */
+class RmtProbePin : public ProbePin {
+public:
+  static constexpr size_t QUEUE_DEPTH = 4;
+
+  explicit RmtProbePin(int gpio) : gpio_(gpio) {}
+
+  bool start() override;
+  bool transmit(const Pulse *pulses, size_t count) override;
+
+protected:
+  static bool onTransmitDone(rmt_channel_handle_t channel, const rmt_tx_done_event_data_t *event, void *arg);
+
+  int gpio_;
+  rmt_channel_handle_t channel_{nullptr};
+  rmt_encoder_handle_t encoder_{nullptr};
+  /** The copy encoder reads symbols while sending, so each queued train keeps its own buffer */
+  rmt_symbol_word_t buffers_[QUEUE_DEPTH][LogicProbe::MAX_PULSES];
+  size_t next_{0};
+  std::atomic<uint32_t> in_flight_{0};
+};
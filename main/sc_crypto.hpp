@@ -0,0 +1,182 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "mbedtls/aes.h"
+#include "mbedtls/bignum.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/ecdh.h"
+#include "mbedtls/ecp.h"
+#include "mbedtls/entropy.h"
+
+/** The LE Secure Connections pairing crypto, on mbedTLS like NimBLE with
+ *  BT_NIMBLE_CRYPTO_STACK_MBEDTLS: a P-256 key pair, the DHKey (ECDH with
+ *  a check of the peer's public key) and the AES-CMAC based f4 / f5 / f6.
+ *  Shared by the boot benchmarks and the Linux benchmark in tools/, to see
+ *  what each step costs. Values are big endian, as in the specification;
+ *  NimBLE byte swaps around the same operations.
+ */
+class ScCrypto {
+public:
+  struct KeyPair {
+    uint8_t pub[64]; /**< X then Y. */
+    uint8_t priv[32];
+  };
+
+  ScCrypto() {
+    mbedtls_entropy_init(&entropy_);
+    mbedtls_ctr_drbg_init(&drbg_);
+    mbedtls_ecp_group_init(&group_);
+    static const char PERSONALIZATION[] = "hid_host_sc";
+    ok_ = mbedtls_ctr_drbg_seed(&drbg_, mbedtls_entropy_func, &entropy_,
+                                (const unsigned char *)PERSONALIZATION, sizeof(PERSONALIZATION)) == 0 &&
+          mbedtls_ecp_group_load(&group_, MBEDTLS_ECP_DP_SECP256R1) == 0;
+  }
+
+  ~ScCrypto() {
+    mbedtls_ecp_group_free(&group_);
+    mbedtls_ctr_drbg_free(&drbg_);
+    mbedtls_entropy_free(&entropy_);
+  }
+
+  ScCrypto(const ScCrypto &) = delete;
+  ScCrypto &operator=(const ScCrypto &) = delete;
+
+  bool ok() const { return ok_; }
+
+  /** The local key pair: what NimBLE generates on the first pairing. */
+  bool generateKeyPair(KeyPair &keys) {
+    mbedtls_mpi d;
+    mbedtls_ecp_point q;
+    mbedtls_mpi_init(&d);
+    mbedtls_ecp_point_init(&q);
+    bool ok = mbedtls_ecp_gen_keypair(&group_, &d, &q, mbedtls_ctr_drbg_random, &drbg_) == 0 &&
+              mbedtls_mpi_write_binary(&d, keys.priv, sizeof(keys.priv)) == 0 &&
+              writePoint(q, keys.pub);
+    mbedtls_ecp_point_free(&q);
+    mbedtls_mpi_free(&d);
+    return ok;
+  }
+
+  /** DHKey = P-256 ECDH of our private key and the peer's public key,
+   *  after checking that the public key is on the curve. */
+  bool dhkey(const uint8_t peer_pub[64], const uint8_t priv[32], uint8_t out[32]) {
+    mbedtls_mpi d, z;
+    mbedtls_ecp_point q;
+    mbedtls_mpi_init(&d);
+    mbedtls_mpi_init(&z);
+    mbedtls_ecp_point_init(&q);
+    uint8_t point[65];
+    point[0] = 0x04; // uncompressed
+    memcpy(point + 1, peer_pub, 64);
+    bool ok = mbedtls_ecp_point_read_binary(&group_, &q, point, sizeof(point)) == 0 &&
+              mbedtls_ecp_check_pubkey(&group_, &q) == 0 &&
+              mbedtls_mpi_read_binary(&d, priv, 32) == 0 &&
+              mbedtls_ecdh_compute_shared(&group_, &z, &q, &d, mbedtls_ctr_drbg_random, &drbg_) == 0 &&
+              mbedtls_mpi_write_binary(&z, out, 32) == 0;
+    mbedtls_ecp_point_free(&q);
+    mbedtls_mpi_free(&z);
+    mbedtls_mpi_free(&d);
+    return ok;
+  }
+
+  /** AES-CMAC (RFC 4493) with a 128-bit key. */
+  static bool cmac(const uint8_t key[16], const uint8_t *msg, size_t length, uint8_t out[16]) {
+    mbedtls_aes_context aes;
+    mbedtls_aes_init(&aes);
+    bool ok = mbedtls_aes_setkey_enc(&aes, key, 128) == 0;
+    // subkeys K1 / K2 from L = AES(0)
+    uint8_t k1[16] = {}, k2[16];
+    ok = ok && mbedtls_aes_crypt_ecb(&aes, MBEDTLS_AES_ENCRYPT, k1, k1) == 0;
+    doubleBlock(k1, k1);
+    doubleBlock(k1, k2);
+    size_t blocks = length ? (length + 15) / 16 : 1;
+    bool complete = length && length % 16 == 0;
+    uint8_t x[16] = {};
+    for (size_t b = 0; ok && b < blocks; b++) {
+      uint8_t block[16];
+      size_t n = b + 1 < blocks ? 16 : length - b * 16;
+      memcpy(block, msg + b * 16, n);
+      if (b + 1 == blocks) {
+        if (!complete) {
+          memset(block + n, 0, 16 - n);
+          block[n] = 0x80;
+        }
+        for (size_t i = 0; i < 16; i++) block[i] ^= complete ? k1[i] : k2[i];
+      }
+      for (size_t i = 0; i < 16; i++) x[i] ^= block[i];
+      ok = mbedtls_aes_crypt_ecb(&aes, MBEDTLS_AES_ENCRYPT, x, x) == 0;
+    }
+    mbedtls_aes_free(&aes);
+    memcpy(out, x, 16);
+    return ok;
+  }
+
+  /** f4(U, V, X, Z): confirm values. */
+  static bool f4(const uint8_t u[32], const uint8_t v[32], const uint8_t x[16], uint8_t z, uint8_t out[16]) {
+    uint8_t m[65];
+    memcpy(m, u, 32);
+    memcpy(m + 32, v, 32);
+    m[64] = z;
+    return cmac(x, m, sizeof(m), out);
+  }
+
+  /** f5(W, N1, N2, A1, A2): MacKey and LTK from the DHKey. */
+  static bool f5(const uint8_t w[32], const uint8_t n1[16], const uint8_t n2[16], const uint8_t a1[7],
+                 const uint8_t a2[7], uint8_t mac_key[16], uint8_t ltk[16]) {
+    static constexpr uint8_t SALT[16] = {0x6c, 0x88, 0x83, 0x91, 0xaa, 0xf5, 0xa5, 0x38,
+                                         0x60, 0x37, 0x0b, 0xdb, 0x5a, 0x60, 0x83, 0xbe};
+    uint8_t t[16];
+    if (!cmac(SALT, w, 32, t)) return false;
+    // counter, keyID "btle", N1, N2, A1, A2, length 256
+    uint8_t m[53] = {0, 0x62, 0x74, 0x6c, 0x65};
+    memcpy(m + 5, n1, 16);
+    memcpy(m + 21, n2, 16);
+    memcpy(m + 37, a1, 7);
+    memcpy(m + 44, a2, 7);
+    m[51] = 0x01;
+    m[52] = 0x00;
+    if (!cmac(t, m, sizeof(m), mac_key)) return false;
+    m[0] = 1;
+    return cmac(t, m, sizeof(m), ltk);
+  }
+
+  /** f6(W, N1, N2, R, IOcap, A1, A2): DHKey check values. */
+  static bool f6(const uint8_t w[16], const uint8_t n1[16], const uint8_t n2[16], const uint8_t r[16],
+                 const uint8_t io_cap[3], const uint8_t a1[7], const uint8_t a2[7], uint8_t out[16]) {
+    uint8_t m[65];
+    memcpy(m, n1, 16);
+    memcpy(m + 16, n2, 16);
+    memcpy(m + 32, r, 16);
+    memcpy(m + 48, io_cap, 3);
+    memcpy(m + 51, a1, 7);
+    memcpy(m + 58, a2, 7);
+    return cmac(w, m, sizeof(m), out);
+  }
+
+protected:
+  bool writePoint(const mbedtls_ecp_point &q, uint8_t out[64]) {
+    uint8_t point[65];
+    size_t length = 0;
+    if (mbedtls_ecp_point_write_binary(&group_, &q, MBEDTLS_ECP_PF_UNCOMPRESSED, &length, point,
+                                       sizeof(point)) != 0 || length != sizeof(point)) {
+      return false;
+    }
+    memcpy(out, point + 1, 64);
+    return true;
+  }
+
+  /** Multiply by x in GF(2^128), for the CMAC subkeys. */
+  static void doubleBlock(const uint8_t in[16], uint8_t out[16]) {
+    uint8_t carry = in[0] >> 7;
+    for (size_t i = 0; i < 15; i++) out[i] = (in[i] << 1) | (in[i + 1] >> 7);
+    out[15] = (in[15] << 1) ^ (carry ? 0x87 : 0);
+  }
+
+  mbedtls_entropy_context entropy_;
+  mbedtls_ctr_drbg_context drbg_;
+  mbedtls_ecp_group group_;
+  bool ok_{false};
+};
@@ -0,0 +1,272 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+#include "task_monitor.hpp"
+
+/** How scanning gets to know advertisers.
+ *
+ *  Active scanning sends a scan request to every scannable advertiser it
+ *  hears, costing airtime and power on both sides, while a HID device
+ *  nearly always says what it is (the HID service UUID or a HID
+ *  appearance) in its advertisement proper. ON_DEMAND scans passively and
+ *  sends scan requests only to the advertisers whose advertisement leaves
+ *  open whether they are HID devices: the connect task collects those
+ *  candidates, puts them on the controller's accept list and scans
+ *  actively for a short burst that only they can answer.
+ */
+enum class ScanMode : uint8_t { PASSIVE, ACTIVE, ON_DEMAND, COUNT };
+
+static constexpr const char *SCAN_MODE_NAMES[] = {"passive", "active", "on-demand"};
+static_assert(sizeof(SCAN_MODE_NAMES) / sizeof(SCAN_MODE_NAMES[0]) == (size_t)ScanMode::COUNT);
+
+static inline const char *scanModeName(ScanMode mode) { return SCAN_MODE_NAMES[(size_t)mode]; }
+
+/** The mode with that name, or COUNT. */
+static inline ScanMode findScanMode(const char *name) {
+  for (size_t i = 0; i < (size_t)ScanMode::COUNT; i++) {
+    if (name && !strcmp(SCAN_MODE_NAMES[i], name)) return (ScanMode)i;
+  }
+  return ScanMode::COUNT;
+}
+
+/** What an advertising payload (advertisement and scan response, as far
+ *  as received) says about the advertiser. */
+enum class AdvertiserIdentity : uint8_t { HID, NOT_HID, UNKNOWN };
+
+static constexpr uint16_t HID_SERVICE_UUID16 = 0x1812;
+/** The HID appearance category, 0x03C0 - 0x03FF. */
+static constexpr uint16_t APPEARANCE_HID_FIRST = 0x03C0;
+static constexpr uint16_t APPEARANCE_HID_LAST = 0x03FF;
+
+/** What kind of PDU an advertising report came from, whether it came
+ *  through legacy or extended scanning. */
+struct AdvKind {
+  bool connectable;
+  bool scannable;
+  bool directed;
+  bool scan_response;
+  bool legacy;
+};
+
+/** Legacy advertising report event types. */
+static constexpr uint8_t ADV_IND = 0;
+static constexpr uint8_t ADV_DIRECT_IND = 1;
+static constexpr uint8_t ADV_SCAN_IND = 2;
+static constexpr uint8_t ADV_NONCONN_IND = 3;
+static constexpr uint8_t ADV_SCAN_RSP = 4;
+
+static inline AdvKind legacyAdvKind(uint8_t event_type) {
+  return {
+    .connectable = event_type == ADV_IND || event_type == ADV_DIRECT_IND,
+    .scannable = event_type == ADV_IND || event_type == ADV_SCAN_IND,
+    .directed = event_type == ADV_DIRECT_IND,
+    .scan_response = event_type == ADV_SCAN_RSP,
+    .legacy = true,
+  };
+}
+
+/** From the event type bits of an extended advertising report. */
+static inline AdvKind extendedAdvKind(uint16_t props) {
+  return {
+    .connectable = (props & 0x01) != 0,
+    .scannable = (props & 0x02) != 0,
+    .directed = (props & 0x04) != 0,
+    .scan_response = (props & 0x08) != 0,
+    .legacy = (props & 0x10) != 0,
+  };
+}
+
+/** AD structure types we look at. */
+static constexpr uint8_t AD_FLAGS = 0x01;
+static constexpr uint8_t AD_UUID16_INCOMPLETE = 0x02;
+static constexpr uint8_t AD_UUID16_COMPLETE = 0x03;
+static constexpr uint8_t AD_APPEARANCE = 0x19;
+/** Flags: LE limited or general discoverable. */
+static constexpr uint8_t AD_FLAGS_DISCOVERABLE = 0x03;
+
+/** Calls fn(type, data, length) for each AD structure of a payload,
+ *  stopping at the first malformed one. */
+template <typename Fn> static inline void forEachAdStructure(const uint8_t *payload, size_t length, Fn fn) {
+  for (size_t pos = 0; pos + 1 < length;) {
+    size_t size = payload[pos];
+    if (!size || pos + 1 + size > length) break;
+    fn(payload[pos + 1], payload + pos + 2, size - 1);
+    pos += 1 + size;
+  }
+}
+
+/** HID if it lists the HID service or has a HID appearance; NOT_HID if
+ *  its complete service list or its appearance says otherwise, or it is
+ *  not discoverable (a bonded device reconnecting is known by address
+ *  instead); UNKNOWN otherwise. */
+static inline AdvertiserIdentity identifyAdvertiser(const uint8_t *payload, size_t length) {
+  bool hid = false, not_hid = false;
+  forEachAdStructure(payload, length, [&](uint8_t type, const uint8_t *data, size_t data_length) {
+    switch (type) {
+    case AD_FLAGS:
+      if (data_length && !(data[0] & AD_FLAGS_DISCOVERABLE)) not_hid = true;
+      break;
+    case AD_UUID16_INCOMPLETE:
+    case AD_UUID16_COMPLETE: {
+      bool listed = false;
+      for (size_t i = 0; i + 1 < data_length; i += 2) {
+        if ((data[i] | data[i + 1] << 8) == HID_SERVICE_UUID16) listed = true;
+      }
+      if (listed) hid = true;
+      else if (type == AD_UUID16_COMPLETE) not_hid = true;
+      break;
+    }
+    case AD_APPEARANCE:
+      if (data_length >= 2) {
+        uint16_t appearance = data[0] | data[1] << 8;
+        if (appearance >= APPEARANCE_HID_FIRST && appearance <= APPEARANCE_HID_LAST) hid = true;
+        else if (appearance) not_hid = true;
+      }
+      break;
+    default:
+      break;
+    }
+  });
+  return hid ? AdvertiserIdentity::HID : not_hid ? AdvertiserIdentity::NOT_HID : AdvertiserIdentity::UNKNOWN;
+}
+
+/** The advertisers an ON_DEMAND scan still has to ask for a scan
+ *  response. Candidates are added from the BLE host task as they are
+ *  heard and taken by the connect task for a burst; each is asked once
+ *  per cooldown, so one that stays UNKNOWN is not asked over and over. */
+class ScanEscalation {
+public:
+  static constexpr size_t MAX_CANDIDATES = 8;
+
+  struct Candidate {
+    uint8_t address[6];
+    uint8_t address_type;
+  };
+
+  explicit ScanEscalation(uint32_t cooldown_ms) : cooldown_us_(cooldown_ms * 1000ll) {}
+
+  /** A candidate was heard; false if it was asked within the cooldown or
+   *  there is no room. */
+  bool add(const uint8_t address[6], uint8_t address_type, int64_t now_us) {
+    std::lock_guard<std::mutex> lk(mutex_);
+    Entry *slot = nullptr;
+    for (auto &e : entries_) {
+      if (e.used && e.candidate.address_type == address_type && !memcmp(e.candidate.address, address, 6)) {
+        if (e.waiting || now_us - e.asked_us < cooldown_us_) return false;
+        slot = &e;
+        break;
+      }
+    }
+    if (!slot) {
+      // a free slot, else the one asked longest ago, if its cooldown is over
+      for (auto &e : entries_) {
+        if (!e.used) {
+          slot = &e;
+          break;
+        }
+        if (!e.waiting && now_us - e.asked_us >= cooldown_us_ && (!slot || e.asked_us < slot->asked_us)) slot = &e;
+      }
+      if (!slot) return false;
+    }
+    memcpy(slot->candidate.address, address, 6);
+    slot->candidate.address_type = address_type;
+    slot->used = true;
+    slot->waiting = true;
+    candidates_++;
+    return true;
+  }
+
+  /** The waiting candidates, which count as asked from now on. */
+  size_t take(Candidate *out, size_t max, int64_t now_us) {
+    std::lock_guard<std::mutex> lk(mutex_);
+    size_t n = 0;
+    for (auto &e : entries_) {
+      if (!e.used || !e.waiting || n == max) continue;
+      out[n++] = e.candidate;
+      e.waiting = false;
+      e.asked_us = now_us;
+    }
+    if (n) bursts_++;
+    return n;
+  }
+
+  void printStats() const {
+    printf("  on-demand: %lu candidates asked in %lu active bursts\n", (unsigned long)candidates_,
+           (unsigned long)bursts_);
+  }
+
+protected:
+  struct Entry {
+    Candidate candidate;
+    bool used;
+    bool waiting;
+    int64_t asked_us;
+  };
+
+  int64_t cooldown_us_;
+  std::mutex mutex_;
+  Entry entries_[MAX_CANDIDATES]{};
+  uint32_t candidates_{0};
+  uint32_t bursts_{0};
+};
+
+/** Discovery time and scan airtime per scan mode, to compare them. The
+ *  airtime is what the scan requests and their responses take on the
+ *  1M PHY; requests that got no response are not seen by the host, so it
+ *  is a lower bound. Advertisements are sent either way and not counted. */
+class ScanModeStats {
+public:
+  /** A scan request (with its response of length bytes) was answered. */
+  void onScanResponse(ScanMode mode, size_t length) {
+    auto &m = modes_[(size_t)mode];
+    m.scan_responses.fetch_add(1, std::memory_order_relaxed);
+    m.airtime_us.fetch_add(SCAN_REQ_US + 2 * T_IFS_US + pduUs(length), std::memory_order_relaxed);
+  }
+
+  void onAdvertisement(ScanMode mode) { modes_[(size_t)mode].advertisements.fetch_add(1, std::memory_order_relaxed); }
+
+  /** Time spent scanning in a mode, from the connect task's polls. */
+  void addScanTime(ScanMode mode, int64_t us) { modes_[(size_t)mode].scan_us.fetch_add(us, std::memory_order_relaxed); }
+
+  /** From asking for a scan to finding a device to connect to. */
+  void onDiscovered(ScanMode mode, int64_t us) { modes_[(size_t)mode].discovery.record(us); }
+
+  void print() const {
+    printf("Scan modes:\n");
+    for (size_t i = 0; i < (size_t)ScanMode::COUNT; i++) {
+      auto &m = modes_[i];
+      int64_t scan_us = m.scan_us.load(std::memory_order_relaxed);
+      if (!scan_us) continue;
+      uint64_t airtime_us = m.airtime_us.load(std::memory_order_relaxed);
+      printf("  %-9s scanned %llu s: %lu advertisements, %lu scan responses, %.2f ms request / response "
+             "airtime per second scanned\n",
+             SCAN_MODE_NAMES[i], (unsigned long long)(scan_us / 1000000),
+             (unsigned long)m.advertisements.load(std::memory_order_relaxed),
+             (unsigned long)m.scan_responses.load(std::memory_order_relaxed), airtime_us * 1000.0f / scan_us);
+      m.discovery.print();
+    }
+  }
+
+protected:
+  /** A legacy PDU on the 1M PHY: preamble, access address, header,
+   *  advertiser address and CRC around the data, 8 us per byte. */
+  static constexpr uint32_t pduUs(size_t length) { return (1 + 4 + 2 + 6 + length + 3) * 8; }
+  static constexpr uint32_t SCAN_REQ_US = (1 + 4 + 2 + 12 + 3) * 8;
+  static constexpr uint32_t T_IFS_US = 150;
+
+  struct Mode {
+    LatencyStats discovery{"discovery", 1000};
+    std::atomic<uint32_t> advertisements{0};
+    std::atomic<uint32_t> scan_responses{0};
+    std::atomic<uint64_t> airtime_us{0};
+    std::atomic<int64_t> scan_us{0};
+  };
+  Mode modes_[(size_t)ScanMode::COUNT];
+};
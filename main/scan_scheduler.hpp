@@ -0,0 +1,172 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#include "task_monitor.hpp"
+
+/** Fits scanning around the live connections.
+ *
+ *  Scan windows and connection events share one radio, and a scan window
+ *  that overlaps a connection event costs that event (or the controller
+ *  cuts the window short). With connections up, the window is shortened to
+ *  fit between two events of the busiest connection, leaving reserve_us of
+ *  airtime per event, and the scan interval is stretched so scanning takes
+ *  at most half of the airtime the connections leave free. Without
+ *  connections the profile's own timing applies.
+ *
+ *  Input that arrived within activity_holdoff_ms makes a latency critical
+ *  period: scanning pauses altogether, but for no more than max_pause_ms
+ *  at a time, after which it runs for one scan interval so a device that
+ *  is trying to reconnect is still found while another is in use.
+ */
+class ScanScheduler {
+public:
+  struct Config {
+    uint32_t reserve_us;          /**< Airtime kept free per connection event. */
+    bool pause_while_active;
+    uint32_t activity_holdoff_ms;
+    uint32_t max_pause_ms;
+  };
+
+  struct Plan {
+    bool scan;
+    uint16_t interval_ms;
+    uint16_t window_ms;
+    bool operator==(const Plan &other) const {
+      return scan == other.scan && interval_ms == other.interval_ms && window_ms == other.window_ms;
+    }
+    bool operator!=(const Plan &other) const { return !(*this == other); }
+  };
+
+  /** Shortest scan window the controller takes, and longest interval. */
+  static constexpr uint32_t MIN_WINDOW_US = 2500;
+  static constexpr uint32_t MAX_INTERVAL_US = 10240000;
+
+  explicit ScanScheduler(const Config &config) : config_(config) {}
+
+  /** The profile's timing, used as is without connections and as an
+   *  upper bound on window and duty with them. */
+  void setBase(uint16_t interval_ms, uint16_t window_ms) {
+    base_interval_us_ = interval_ms * 1000;
+    base_window_us_ = std::min(window_ms, interval_ms) * 1000;
+  }
+
+  /** What scanning should do now, given the connection interval of each
+   *  live connection and when the latest input report arrived. */
+  Plan plan(const uint32_t *intervals_us, size_t num_connections, int64_t last_input_us, int64_t now_us) {
+    if (pausing(num_connections, last_input_us, now_us)) {
+      return {false, 0, 0};
+    }
+    if (!num_connections) {
+      return {true, (uint16_t)(base_interval_us_ / 1000), (uint16_t)(base_window_us_ / 1000)};
+    }
+    uint32_t shortest = UINT32_MAX;
+    float load = 0;
+    for (size_t i = 0; i < num_connections; i++) {
+      uint32_t interval = std::max<uint32_t>(intervals_us[i], 1);
+      shortest = std::min(shortest, interval);
+      load += (float)config_.reserve_us / interval;
+    }
+    uint32_t reserved = config_.reserve_us * num_connections;
+    uint32_t window = shortest > reserved + MIN_WINDOW_US ? shortest - reserved : MIN_WINDOW_US;
+    window = std::max(std::min(window, base_window_us_), MIN_WINDOW_US);
+    // whole milliseconds, as NimBLEScan takes them: the window rounded down
+    // (but not under the minimum), the interval up
+    uint32_t window_ms = std::max<uint32_t>(window / 1000, (MIN_WINDOW_US + 999) / 1000);
+    float base_duty = (float)base_window_us_ / base_interval_us_;
+    float duty = std::min(base_duty, std::max(1.0f - load, 0.0f) / 2);
+    uint32_t interval = duty > 0 ? (uint32_t)(window_ms * 1000 / duty) : MAX_INTERVAL_US;
+    interval = std::min(std::max(interval, window_ms * 1000), MAX_INTERVAL_US);
+    return {true, (uint16_t)((interval + 999) / 1000), (uint16_t)window_ms};
+  }
+
+  void printStats(int64_t now_us) const {
+    int64_t paused_us = paused_us_ + (pause_start_us_ && !probe_until_us_ ? now_us - pause_start_us_ : 0);
+    printf("  scan scheduler: %lu pauses, %lld ms paused, %lu probe scans\n", (unsigned long)pauses_,
+           (long long)(paused_us / 1000), (unsigned long)probes_);
+  }
+
+protected:
+  bool pausing(size_t num_connections, int64_t last_input_us, int64_t now_us) {
+    bool critical = config_.pause_while_active && num_connections && last_input_us &&
+                    now_us - last_input_us < config_.activity_holdoff_ms * 1000ll;
+    if (!critical) {
+      endPause(now_us);
+      return false;
+    }
+    if (probe_until_us_) {
+      if (now_us < probe_until_us_) return false;
+      // probe done, pause again
+      probe_until_us_ = 0;
+      pause_start_us_ = now_us;
+      return true;
+    }
+    if (!pause_start_us_) {
+      pause_start_us_ = now_us;
+      pauses_++;
+      return true;
+    }
+    if (now_us - pause_start_us_ < config_.max_pause_ms * 1000ll) return true;
+    // paused for too long: scan for one interval
+    paused_us_ += now_us - pause_start_us_;
+    probe_until_us_ = now_us + std::max<uint32_t>(base_interval_us_, MIN_WINDOW_US);
+    probes_++;
+    return false;
+  }
+
+  void endPause(int64_t now_us) {
+    if (pause_start_us_ && !probe_until_us_) paused_us_ += now_us - pause_start_us_;
+    pause_start_us_ = 0;
+    probe_until_us_ = 0;
+  }
+
+  Config config_;
+  uint32_t base_interval_us_{100000};
+  uint32_t base_window_us_{99000};
+  int64_t pause_start_us_{0};
+  int64_t probe_until_us_{0};
+  int64_t paused_us_{0};
+  uint32_t pauses_{0};
+  uint32_t probes_{0};
+};
+
+/** What scanning costs the connections: the timing model's host delay
+ *  and missed connection events, split by whether a scan was running when
+ *  each report arrived. Recorded from the BLE host task. */
+class ScanImpact {
+public:
+  void record(bool scanning, int64_t host_delay_us, uint32_t missed_events) {
+    auto &side = sides_[scanning];
+    side.host_delay.record(host_delay_us);
+    side.missed_events.fetch_add(missed_events, std::memory_order_relaxed);
+  }
+
+  /** Host delay percentile over the reports that arrived with (or without) a scan running. */
+  uint32_t hostPercentile(bool scanning, uint32_t percent) const {
+    return sides_[scanning].host_delay.percentile(percent);
+  }
+
+  void printStats() const {
+    printf("Scan impact (host delay and missed connection events per 1000 reports):\n");
+    for (int scanning = 1; scanning >= 0; scanning--) {
+      auto &side = sides_[scanning];
+      uint32_t reports = side.host_delay.count();
+      if (!reports) continue;
+      printf("  %-12s %7lu reports, host delay p50 %lu us p99 %lu us, %.1f missed events\n",
+             scanning ? "scanning" : "not scanning", (unsigned long)reports,
+             (unsigned long)side.host_delay.percentile(50), (unsigned long)side.host_delay.percentile(99),
+             side.missed_events.load(std::memory_order_relaxed) * 1000.0f / reports);
+    }
+  }
+
+protected:
+  struct Side {
+    LatencyStats host_delay{"host delay", 250};
+    std::atomic<uint32_t> missed_events{0};
+  };
+  Side sides_[2];
+};
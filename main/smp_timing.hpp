@@ -0,0 +1,101 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+/** Where the time of securing a link goes, phase by phase.
+ *
+ *  The connect task secures one link at a time: begin() when it starts
+ *  pairing / restarting encryption, end() when that returns. In between
+ *  the GAP event listener mark()s the phases NimBLE lets us see:
+ *   - USER_ACTION: a passkey / numeric comparison was asked for (only with
+ *     IO capabilities other than no input / output),
+ *   - ENCRYPTED: the link is encrypted. For pairing this covers feature
+ *     exchange, public key exchange, the DHKey and the DHKey check; for an
+ *     encryption restart it is all there is,
+ *   - IDENTITY: the peer's identity address was resolved, during key
+ *     distribution.
+ *  Each phase is timed from the previous one that was reached; pairing
+ *  and encryption restarts are summed separately.
+ */
+class SmpTiming {
+public:
+  enum class Phase : uint8_t { START, USER_ACTION, ENCRYPTED, IDENTITY, COMPLETE, COUNT };
+  static constexpr size_t NUM_PHASES = (size_t)Phase::COUNT;
+
+  void begin(uint16_t conn_handle, bool pairing, int64_t now_us) {
+    for (auto &m : marks_) m.store(0, std::memory_order_relaxed);
+    pairing_ = pairing;
+    conn_handle_.store(conn_handle, std::memory_order_relaxed);
+    marks_[(size_t)Phase::START].store(now_us, std::memory_order_release);
+  }
+
+  /** From the GAP event listener; ignored for other connections. */
+  void mark(uint16_t conn_handle, Phase phase, int64_t now_us) {
+    if (conn_handle != conn_handle_.load(std::memory_order_relaxed)) return;
+    int64_t none = 0;
+    marks_[(size_t)phase].compare_exchange_strong(none, now_us, std::memory_order_acq_rel);
+  }
+
+  void end(bool ok, int64_t now_us) {
+    conn_handle_.store(NONE, std::memory_order_relaxed);
+    auto &kind = kinds_[pairing_];
+    if (!ok) {
+      kind.failed++;
+      return;
+    }
+    marks_[(size_t)Phase::COMPLETE].store(now_us, std::memory_order_relaxed);
+    kind.count++;
+    int64_t previous = marks_[(size_t)Phase::START].load(std::memory_order_acquire);
+    for (size_t p = 1; p < NUM_PHASES; p++) {
+      int64_t at = marks_[p].load(std::memory_order_acquire);
+      if (!at) continue;
+      auto &phase = kind.phases[p];
+      int64_t us = at - previous;
+      phase.count++;
+      phase.sum_us += us;
+      if (us > phase.max_us) phase.max_us = us;
+      previous = at;
+    }
+  }
+
+  void printStats() const {
+    static constexpr const char *PHASE_NAMES[NUM_PHASES] = {
+      "start", "user action", "encrypted", "identity", "complete",
+    };
+    for (int pairing = 1; pairing >= 0; pairing--) {
+      auto &kind = kinds_[pairing];
+      if (!kind.count && !kind.failed) continue;
+      printf("  %s: %lu done, %lu failed, phases (avg / max ms):", pairing ? "pairing" : "encryption restart",
+             (unsigned long)kind.count, (unsigned long)kind.failed);
+      for (size_t p = 1; p < NUM_PHASES; p++) {
+        auto &phase = kind.phases[p];
+        if (!phase.count) continue;
+        printf(" %s %.1f / %.1f", PHASE_NAMES[p], phase.sum_us / 1000.0f / phase.count,
+               phase.max_us / 1000.0f);
+      }
+      printf("\n");
+    }
+  }
+
+protected:
+  static constexpr uint16_t NONE = 0xFFFF;
+
+  struct PhaseStats {
+    uint32_t count{0};
+    int64_t sum_us{0};
+    int64_t max_us{0};
+  };
+  struct KindStats {
+    uint32_t count{0};
+    uint32_t failed{0};
+    std::array<PhaseStats, NUM_PHASES> phases{};
+  };
+
+  std::atomic<uint16_t> conn_handle_{NONE};
+  bool pairing_{false};
+  std::array<std::atomic<int64_t>, NUM_PHASES> marks_{};
+  std::array<KindStats, 2> kinds_{}; /**< [0] encryption restart, [1] pairing. */
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "benchmarks.hpp"
+#include "hid_device.hpp"
+
+/** Feeds synthetic input reports through the whole pipeline, for soak
+ *  testing on the target without a BLE device.
+ *
+ *  A device slot is set up as if a gamepad (32 buttons, 8 axes) had been
+ *  discovered, and reports for it are handed to the transport boundary at
+ *  a fixed rate from the calling task, so everything downstream (fault
+ *  injection, decode, bus, sinks) runs as it would for a real device.
+ */
+class SoakSource {
+public:
+  typedef void (*deliver_fn)(uint16_t conn_handle, uint16_t char_handle, const uint8_t *data, size_t length);
+  typedef void (*tick_fn)();
+
+  struct Config {
+    deliver_fn deliver;
+    uint32_t rate_hz;
+    tick_fn tick; /**< Optional, once per period: other soak work. */
+  };
+
+  /** Connection / value handles of the synthetic device, clear of real ones. */
+  static constexpr uint16_t CONN_HANDLE = 0x0F00;
+  static constexpr uint16_t VALUE_HANDLE = 0x0001;
+  static constexpr size_t REPORT_SIZE = 20;
+
+  explicit SoakSource(const Config &config) : config_(config) {}
+
+  /** Set up the synthetic device. False if there is no free slot. */
+  bool attach(HidDeviceTable &devices) {
+    auto device = devices.claim(CONN_HANDLE);
+    if (!device) return false;
+    static uint8_t map[128];
+    device->report_map.parse(map, benchmarks::buildReportMap(REPORT_SIZE, map));
+    device->addHandle(VALUE_HANDLE, 0, HidDevice::Kind::REPORT);
+    device->timing.setInterval(1000000 / config_.rate_hz);
+    device->ready.store(true, std::memory_order_release);
+    return true;
+  }
+
+  /** Send reports forever. */
+  void run() {
+    uint8_t report[REPORT_SIZE];
+    uint32_t seed = 1;
+    TickType_t last_wake = xTaskGetTickCount();
+    TickType_t period = std::max<TickType_t>(1, pdMS_TO_TICKS(1000 / config_.rate_hz));
+    uint32_t per_tick = std::max<uint32_t>(1, config_.rate_hz * period / configTICK_RATE_HZ);
+    for (;;) {
+      vTaskDelayUntil(&last_wake, period);
+      for (uint32_t i = 0; i < per_tick; i++) {
+        for (auto &b : report) {
+          seed = seed * 1664525u + 1013904223u;
+          b = seed >> 24;
+        }
+        config_.deliver(CONN_HANDLE, VALUE_HANDLE, report, sizeof(report));
+        sent_++;
+      }
+      if (config_.tick) config_.tick();
+    }
+  }
+
+  uint32_t sent() const { return sent_; }
+
+protected:
+  Config config_;
+  uint32_t sent_{0};
+};
+
+/** Synthetic advertisers coming and going, for soak testing an
+ *  AdvertiserCache: reports from a pool of addresses larger than the
+ *  cache, one in eight a HID device, the rest a mix of other services
+ *  with and without flags, at varying RSSI. After each report the
+ *  advertiser must be in the cache, just heard, and the cache within its
+ *  capacity; any report that is not counts as a failed check. */
+template <typename Cache> class AdvertiserChurn {
+public:
+  AdvertiserChurn(Cache &cache, uint32_t pool) : cache_(cache), pool_(pool) {}
+
+  /** Sends n reports, heard at now_ms. */
+  void step(size_t n, uint32_t now_ms) {
+    for (size_t i = 0; i < n; i++) {
+      seed_ = seed_ * 1664525u + 1013904223u;
+      uint32_t id = (seed_ >> 8) % pool_;
+      uint8_t address[6] = {(uint8_t)id, (uint8_t)(id >> 8), (uint8_t)(id >> 16), 0x5A, 0xC0, 0xDE};
+      uint16_t uuid = id % 8 == 0 ? 0x1812 : 0x1800 + id % 0x10;
+      uint8_t payload[] = {2, 0x01, (uint8_t)(id % 3 ? 0x06 : 0x04), 3, 0x03, (uint8_t)uuid, (uint8_t)(uuid >> 8)};
+      cache_.update(address, 0, 0, false, -40 - (int8_t)(id % 60), Cache::LEGACY_PHYS, payload, sizeof(payload),
+                    now_ms);
+      typename Cache::Entry entry;
+      if (!cache_.get(address, 0, entry) || entry.last_seen_ms != now_ms || cache_.size() > Cache::MAX_ENTRIES) {
+        failures_++;
+      }
+      reports_++;
+    }
+  }
+
+  void printStats() {
+    printf("Advertiser churn: %lu reports from %lu advertisers, %lu failed checks\n", (unsigned long)reports_,
+           (unsigned long)pool_, (unsigned long)failures_);
+  }
+
+protected:
+  Cache &cache_;
+  uint32_t pool_;
+  uint32_t seed_{1};
+  uint32_t reports_{0};
+  uint32_t failures_{0};
+};
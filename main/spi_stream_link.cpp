@@ -0,0 +1,56 @@
+#include "sdkconfig.h"
+
+#if CONFIG_HID_HOST_INPUT_STREAM_SPI
+
+#include "input_stream_protocol.hpp"
+#include "spi_stream_link.hpp"
+
+bool SpiStreamLink::start() {
+  if (device_) {
+    return true;
+  }
+  spi_bus_config_t bus_config = {};
+  bus_config.mosi_io_num = config_.mosi_pin;
+  bus_config.miso_io_num = -1;
+  bus_config.sclk_io_num = config_.sclk_pin;
+  bus_config.quadwp_io_num = -1;
+  bus_config.quadhd_io_num = -1;
+  bus_config.max_transfer_sz = input_stream::MAX_FRAME_SIZE;
+  auto host = (spi_host_device_t)config_.host;
+  if (spi_bus_initialize(host, &bus_config, SPI_DMA_CH_AUTO) != ESP_OK) {
+    return false;
+  }
+  spi_device_interface_config_t device_config = {};
+  device_config.mode = 0;
+  device_config.clock_speed_hz = config_.clock_hz;
+  device_config.spics_io_num = config_.cs_pin;
+  device_config.queue_size = 2;
+  if (spi_bus_add_device(host, &device_config, &device_) != ESP_OK) {
+    device_ = nullptr;
+    return false;
+  }
+  return true;
+}
+
+bool SpiStreamLink::send(const uint8_t *frame, size_t length) {
+  if (!device_) {
+    return false;
+  }
+  auto &t = transactions_[next_];
+  t = {};
+  t.length = length * 8;
+  t.tx_buffer = frame;
+  if (spi_device_queue_trans(device_, &t, portMAX_DELAY) != ESP_OK) {
+    return false;
+  }
+  next_ ^= 1;
+  in_flight_++;
+  /** wait for the previous frame, so its buffer can be reused */
+  spi_transaction_t *done;
+  while (in_flight_ > 1 && spi_device_get_trans_result(device_, &done, portMAX_DELAY) == ESP_OK) {
+    in_flight_--;
+  }
+  return true;
+}
+
+#endif // CONFIG_HID_HOST_INPUT_STREAM_SPI
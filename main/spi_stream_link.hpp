@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+
+#include "driver/spi_master.h"
+
+#include "stream_link.hpp"
+
+/** StreamLink over SPI (we are the master), MOSI only, sent by DMA.
+ *
+ *  Each frame is one transaction with CS held low for its length, so the
+ *  receiving MCU can also delimit frames by CS. Up to two transactions are
+ *  queued: send() queues the new frame and then collects the previous one,
+ *  which by then has normally finished, freeing its buffer for refilling.
+ */
+class SpiStreamLink : public StreamLink {
+public:
+  struct Config {
+    int host;  /**< spi_host_device_t, e.g. SPI2_HOST. */
+    int mosi_pin;
+    int sclk_pin;
+    int cs_pin;
+    int clock_hz;
+  };
+
+  explicit SpiStreamLink(const Config &config) : config_(config) {}
+
+  bool start() override;
+  bool send(const uint8_t *frame, size_t length) override;
+
+protected:
+  Config config_;
+  spi_device_handle_t device_{nullptr};
+  spi_transaction_t transactions_[2]{};
+  size_t next_{0};
+  size_t in_flight_{0};
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+/** The most stack each task has used, and what its stack should be.
+ *
+ *  FreeRTOS keeps each task's high-watermark (the least free stack it
+ *  ever had, in bytes on ESP-IDF) but forgets it when the task is deleted,
+ *  and cannot tell how big a stack is. So sample() notes every task's
+ *  watermark, keeping the lowest one per name across tasks that come and
+ *  go, and the stack sizes are given: add() for our own tasks, the IDF
+ *  ones from their Kconfig options. The report suggests a size with a
+ *  margin over the measured peak; the peak is only as good as the paths
+ *  the run went through, hence the stress mode (Kconfig -> Task Stacks).
+ */
+class StackMonitor {
+public:
+  static constexpr size_t MAX_TASKS = 32;
+  /** Stacks are suggested in steps of this many bytes. */
+  static constexpr uint32_t GRANULE = 256;
+  /** Least margin over the peak, however small the peak. */
+  static constexpr uint32_t MIN_MARGIN = 512;
+
+  explicit StackMonitor(uint32_t margin_percent) : margin_percent_(margin_percent) {}
+
+  /** Stack size of a task, and the option that sets it. */
+  void add(const char *name, uint32_t size, const char *option) {
+    std::lock_guard<std::mutex> lk(mutex_);
+    auto entry = find(name);
+    if (!entry) return;
+    entry->size = size;
+    entry->option = option;
+  }
+
+  /** The IDF's own tasks this firmware runs. */
+  void addSystemTasks() {
+    add("main", CONFIG_ESP_MAIN_TASK_STACK_SIZE, "ESP_MAIN_TASK_STACK_SIZE");
+    add("sys_evt", CONFIG_ESP_SYSTEM_EVENT_TASK_STACK_SIZE, "ESP_SYSTEM_EVENT_TASK_STACK_SIZE");
+    add("esp_timer", CONFIG_ESP_TIMER_TASK_STACK_SIZE, "ESP_TIMER_TASK_STACK_SIZE");
+    add("ipc0", CONFIG_ESP_IPC_TASK_STACK_SIZE, "ESP_IPC_TASK_STACK_SIZE");
+#if !CONFIG_FREERTOS_UNICORE
+    add("ipc1", CONFIG_ESP_IPC_TASK_STACK_SIZE, "ESP_IPC_TASK_STACK_SIZE");
+#endif
+    add("Tmr Svc", CONFIG_FREERTOS_TIMER_TASK_STACK_DEPTH, "FREERTOS_TIMER_TASK_STACK_DEPTH");
+#if CONFIG_BT_NIMBLE_ENABLED
+    add("nimble_host", CONFIG_BT_NIMBLE_HOST_TASK_STACK_SIZE, "BT_NIMBLE_HOST_TASK_STACK_SIZE");
+#endif
+  }
+
+  /** Note every task's watermark; call before tasks that exit do. */
+  void sample() {
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+    std::lock_guard<std::mutex> lk(mutex_);
+    size_t n = uxTaskGetSystemState(tasks_.data(), MAX_TASKS, nullptr);
+    for (size_t i = 0; i < n; i++) {
+      auto entry = find(tasks_[i].pcTaskName);
+      if (!entry) continue;
+      entry->min_free = std::min<uint32_t>(entry->min_free, tasks_[i].usStackHighWaterMark);
+      entry->samples++;
+    }
+#endif
+  }
+
+  void print() {
+    std::lock_guard<std::mutex> lk(mutex_);
+    printf("Stacks (bytes; suggested = peak + %lu%%, at least %lu B, in %lu B steps):\n",
+           (unsigned long)margin_percent_, (unsigned long)MIN_MARGIN, (unsigned long)GRANULE);
+    printf("  %-16s %6s %6s %6s %9s\n", "task", "size", "peak", "free", "suggested");
+    for (size_t i = 0; i < num_entries_; i++) {
+      auto &e = entries_[i];
+      if (!e.samples) continue;
+      if (!e.size) {
+        printf("  %-16s %6s %6s %6lu\n", e.name, "?", "?", (unsigned long)e.min_free);
+        continue;
+      }
+      uint32_t peak = e.size > e.min_free ? e.size - e.min_free : 0;
+      uint32_t suggested = suggest(peak);
+      printf("  %-16s %6lu %6lu %6lu %9lu", e.name, (unsigned long)e.size, (unsigned long)peak,
+             (unsigned long)e.min_free, (unsigned long)suggested);
+      if (suggested > e.size) {
+        printf("  under the margin, raise CONFIG_%s", e.option);
+      } else if (e.size - suggested >= 2 * GRANULE) {
+        printf("  %lu B spare (CONFIG_%s)", (unsigned long)(e.size - suggested), e.option);
+      }
+      printf("\n");
+    }
+  }
+
+protected:
+  struct Entry {
+    char name[configMAX_TASK_NAME_LEN];
+    uint32_t size;
+    const char *option;
+    uint32_t min_free;
+    uint32_t samples;
+  };
+
+  uint32_t suggest(uint32_t peak) const {
+    uint32_t margin = std::max<uint32_t>(peak * margin_percent_ / 100, MIN_MARGIN);
+    return (peak + margin + GRANULE - 1) / GRANULE * GRANULE;
+  }
+
+  /** The entry of a task, made if there is room. */
+  Entry *find(const char *name) {
+    for (size_t i = 0; i < num_entries_; i++) {
+      if (!strncmp(entries_[i].name, name, sizeof(entries_[i].name))) return &entries_[i];
+    }
+    if (num_entries_ == MAX_TASKS) return nullptr;
+    auto &e = entries_[num_entries_++];
+    e = {};
+    strncpy(e.name, name, sizeof(e.name) - 1);
+    e.min_free = UINT32_MAX;
+    return &e;
+  }
+
+  uint32_t margin_percent_;
+  std::mutex mutex_;
+  std::array<TaskStatus_t, MAX_TASKS> tasks_;
+  std::array<Entry, MAX_TASKS> entries_;
+  size_t num_entries_{0};
+};
@@ -0,0 +1,40 @@
+#include "sdkconfig.h"
+
+#if CONFIG_HID_HOST_CONSOLE
+
+#include <cstdio>
+
+#include "esp_console.h"
+
+#include "stats_console.hpp"
+
+bool StatsConsole::start(const Command *commands, size_t count, unsigned priority) {
+  esp_console_repl_t *repl = nullptr;
+  esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+  repl_config.prompt = "hid>";
+  repl_config.task_priority = priority;
+  repl_config.max_cmdline_length = 64;
+  repl_config.task_stack_size = CONFIG_HID_HOST_CONSOLE_TASK_STACK_SIZE;
+#if CONFIG_HID_HOST_CONSOLE_USB_SERIAL_JTAG
+  esp_console_dev_usb_serial_jtag_config_t device_config = ESP_CONSOLE_DEV_USB_SERIAL_JTAG_CONFIG_DEFAULT();
+  esp_err_t err = esp_console_new_repl_usb_serial_jtag(&device_config, &repl_config, &repl);
+#else
+  esp_console_dev_uart_config_t device_config = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+  esp_err_t err = esp_console_new_repl_uart(&device_config, &repl_config, &repl);
+#endif
+  if (err != ESP_OK) {
+    printf("Could not create the console: %s\n", esp_err_to_name(err));
+    return false;
+  }
+  esp_console_register_help_command();
+  for (size_t i = 0; i < count; i++) {
+    esp_console_cmd_t cmd = {};
+    cmd.command = commands[i].name;
+    cmd.help = commands[i].help;
+    cmd.func = commands[i].fn;
+    esp_console_cmd_register(&cmd);
+  }
+  return esp_console_start_repl(repl) == ESP_OK;
+}
+
+#endif
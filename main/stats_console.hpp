@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+
+/** Command line on the console port for asking a running device about its
+ *  performance: latency histograms, per connection counters, queue
+ *  watermarks, heap / stack use and so on.
+ *
+ *  A thin wrapper around the esp_console REPL. The REPL task runs at the
+ *  given (low) priority, and commands only print snapshots the report path
+ *  keeps anyway, so querying never holds up a report.
+ */
+class StatsConsole {
+public:
+  struct Command {
+    const char *name;
+    const char *help;
+    int (*fn)(int argc, char **argv);
+  };
+
+  /** Register the commands (and "help") and start the REPL task. */
+  bool start(const Command *commands, size_t count, unsigned priority);
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/** A byte link to another MCU that the input stream sends frames over.
+ *
+ *  send() may return while the frame is still going out (by DMA or from an
+ *  ISR), so the sender double buffers: a buffer passed to send() is not
+ *  touched again until the next send(), with the other buffer, returned.
+ *  Frame buffers are 4 byte aligned and in internal RAM.
+ */
+class StreamLink {
+public:
+  virtual ~StreamLink() = default;
+
+  /** Set up the peripheral. */
+  virtual bool start() = 0;
+
+  /** Start sending one frame. Returns false if it could not be queued. */
+  virtual bool send(const uint8_t *frame, size_t length) = 0;
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+/** Min / avg / max and a log2 histogram of a latency, in microseconds.
+ *  The first bucket ends at bucket_us, each next one at twice the last.
+ *  One task records, any other may print; the counters are atomics
+ *  rather than a mutex so recording never blocks or allocates. */
+class LatencyStats {
+public:
+  static constexpr size_t NUM_BUCKETS = 16;
+
+  explicit LatencyStats(const char *name, uint32_t bucket_us = 2) : name_(name), bucket_us_(bucket_us) {}
+
+  void record(int64_t us) {
+    uint32_t value = us < 0 ? 0 : us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_us_.fetch_add(value, std::memory_order_relaxed);
+    if (value < min_us_.load(std::memory_order_relaxed)) min_us_.store(value, std::memory_order_relaxed);
+    if (value > max_us_.load(std::memory_order_relaxed)) max_us_.store(value, std::memory_order_relaxed);
+    size_t bucket = 0;
+    while (bucket + 1 < NUM_BUCKETS && value >= (bucket_us_ << bucket)) bucket++;
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void print() const {
+    uint32_t count = count_.load(std::memory_order_relaxed);
+    if (!count) return;
+    printf("  %s: %lu samples, min %lu us avg %llu us max %lu us\n    hist:", name_,
+           (unsigned long)count, (unsigned long)min_us_.load(std::memory_order_relaxed),
+           (unsigned long long)(sum_us_.load(std::memory_order_relaxed) / count),
+           (unsigned long)max_us_.load(std::memory_order_relaxed));
+    for (size_t b = 0; b < NUM_BUCKETS; b++) {
+      uint32_t n = buckets_[b].load(std::memory_order_relaxed);
+      if (n) printf(" <%lu:%lu", (unsigned long)bucket_us_ << b, (unsigned long)n);
+    }
+    printf("\n");
+  }
+
+  /** Upper edge of the bucket holding the given percentile (0 - 100), or
+   *  the maximum if that is lower; 0 without samples. */
+  uint32_t percentile(uint32_t percent) const {
+    uint32_t count = count_.load(std::memory_order_relaxed);
+    uint32_t max = max_us_.load(std::memory_order_relaxed);
+    if (!count) return 0;
+    uint64_t rank = ((uint64_t)count * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (size_t b = 0; b + 1 < NUM_BUCKETS; b++) {
+      seen += buckets_[b].load(std::memory_order_relaxed);
+      if (seen >= rank) return std::min(bucket_us_ << b, max);
+    }
+    return max;
+  }
+
+  uint32_t max() const { return max_us_.load(std::memory_order_relaxed); }
+  uint32_t count() const { return count_.load(std::memory_order_relaxed); }
+
+protected:
+  const char *name_;
+  uint32_t bucket_us_;
+  std::atomic<uint32_t> count_{0};
+  std::atomic<uint64_t> sum_us_{0};
+  std::atomic<uint32_t> min_us_{UINT32_MAX};
+  std::atomic<uint32_t> max_us_{0};
+  std::array<std::atomic<uint32_t>, NUM_BUCKETS> buckets_{};
+};
+
+/** Per task CPU use between two calls to print(), from the FreeRTOS run
+ *  time counters (needs CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS), and the
+ *  least free stack each task has had. CPU is given as a percentage of one
+ *  core, so on a dual core chip the tasks add up to 200%. Both the logging
+ *  task and the console print, so print() is serialized. */
+class TaskMonitor {
+public:
+  static constexpr size_t MAX_TASKS = 32;
+
+  void print() {
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS && CONFIG_FREERTOS_USE_TRACE_FACILITY
+    std::lock_guard<std::mutex> lk(mutex_);
+    uint32_t total = 0;
+    size_t n = uxTaskGetSystemState(tasks_.data(), MAX_TASKS, &total);
+    uint32_t elapsed = total - last_total_;
+    printf("Tasks (CPU %% of one core since the last report):\n");
+    for (size_t i = 0; i < n; i++) {
+      auto &t = tasks_[i];
+      uint32_t previous = 0;
+      for (size_t j = 0; j < num_previous_; j++) {
+        if (previous_[j].handle == t.xHandle) {
+          previous = previous_[j].runtime;
+          break;
+        }
+      }
+      uint32_t used = t.ulRunTimeCounter - previous;
+      int core = xTaskGetAffinity(t.xHandle);
+      printf("  %-16s core %-3s prio %2u  %5.1f%%  stack free %5u B\n", t.pcTaskName,
+             core == tskNO_AFFINITY ? "any" : core == 0 ? "0" : "1", (unsigned)t.uxCurrentPriority,
+             elapsed ? used * 100.0f / elapsed : 0.0f, (unsigned)t.usStackHighWaterMark);
+    }
+    num_previous_ = n;
+    for (size_t i = 0; i < n; i++) previous_[i] = {tasks_[i].xHandle, tasks_[i].ulRunTimeCounter};
+    last_total_ = total;
+#else
+    printf("Tasks: enable CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS for per task CPU use\n");
+#endif
+  }
+
+  /** Load of each core since the last call, in per mille, from its idle
+   *  task's run time. Kept apart from print() so the two don't disturb
+   *  each other's deltas. Returns false without run time stats. */
+  bool coreLoad(uint16_t permille[portNUM_PROCESSORS]) {
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS && CONFIG_FREERTOS_USE_TRACE_FACILITY
+    std::lock_guard<std::mutex> lk(mutex_);
+    uint32_t total = portGET_RUN_TIME_COUNTER_VALUE();
+    uint32_t elapsed = total - load_total_;
+    for (BaseType_t core = 0; core < portNUM_PROCESSORS; core++) {
+      TaskStatus_t idle;
+      vTaskGetInfo(xTaskGetIdleTaskHandleForCPU(core), &idle, pdFALSE, eInvalid);
+      uint32_t idle_time = idle.ulRunTimeCounter - load_idle_[core];
+      load_idle_[core] = idle.ulRunTimeCounter;
+      permille[core] = elapsed && idle_time < elapsed ? 1000 - (uint64_t)idle_time * 1000 / elapsed : 0;
+    }
+    load_total_ = total;
+    return true;
+#else
+    return false;
+#endif
+  }
+
+protected:
+  struct Previous {
+    TaskHandle_t handle;
+    uint32_t runtime;
+  };
+
+  std::mutex mutex_;
+  std::array<TaskStatus_t, MAX_TASKS> tasks_;
+  std::array<Previous, MAX_TASKS> previous_;
+  size_t num_previous_{0};
+  uint32_t last_total_{0};
+  uint32_t load_total_{0};
+  std::array<uint32_t, portNUM_PROCESSORS> load_idle_{};
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+#include "stream_link.hpp"
+#include "telemetry_protocol.hpp"
+
+/** Sends telemetry snapshots, see telemetry_protocol.hpp for the format.
+ *
+ *  With a link, frames go out as they are; without one they are printed
+ *  on the console as "@T<hex>" lines, which tools/telemetry picks out of
+ *  the rest of the log. Used from the logging task only.
+ */
+class Telemetry {
+public:
+  explicit Telemetry(StreamLink *link = nullptr) : link_(link) {}
+
+  bool start() { return !link_ || link_->start(); }
+
+  void begin(const telemetry::SystemRecord &system) { writer_.begin(buffers_[back_], system); }
+
+  /** False once the frame holds MAX_CONNECTIONS records. */
+  bool add(const telemetry::ConnectionRecord &connection) { return writer_.add(connection); }
+
+  void send() {
+    size_t length = writer_.finish(sequence_++);
+    auto frame = buffers_[back_];
+    if (!link_) {
+      static constexpr char HEX[] = "0123456789abcdef";
+      for (size_t i = 0; i < length; i++) {
+        line_[2 + 2 * i] = HEX[frame[i] >> 4];
+        line_[3 + 2 * i] = HEX[frame[i] & 0xF];
+      }
+      line_[2 + 2 * length] = 0;
+      printf("%s\n", line_);
+    } else if (!link_->send(frame, length)) {
+      send_errors_++;
+      return;
+    }
+    frames_++;
+    bytes_ += length;
+    /** the link may still be reading this buffer, see StreamLink */
+    back_ ^= 1;
+  }
+
+  void printStats() const {
+    printf("Telemetry: %lu snapshots, %lu B, %lu send errors\n", (unsigned long)frames_,
+           (unsigned long)bytes_, (unsigned long)send_errors_);
+  }
+
+protected:
+  StreamLink *link_;
+  alignas(4) uint8_t buffers_[2][telemetry::MAX_FRAME_SIZE];
+  /** "@T", two hex digits per byte */
+  char line_[2 + 2 * telemetry::MAX_FRAME_SIZE + 1] = {'@', 'T'};
+  size_t back_{0};
+  telemetry::FrameWriter writer_;
+  uint32_t sequence_{0};
+  uint32_t frames_{0};
+  uint32_t bytes_{0};
+  uint32_t send_errors_{0};
+};
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "input_stream_protocol.hpp"
+
+/** Wire format of the telemetry snapshot, shared by the firmware and the
+ *  CSV converter in tools/telemetry.
+ *
+ *  One frame per snapshot period:
+ *
+ *    sync            2 B   0xA5 0x7E
+ *    version         1 B   VERSION
+ *    connections     1 B   number of ConnectionRecords
+ *    schema hash     4 B   SCHEMA_HASH
+ *    sequence        4 B   snapshot counter, a gap means snapshots were lost
+ *    system          SystemRecord
+ *    connections     ConnectionRecord each
+ *    crc             2 B   CRC-16/CCITT-FALSE over version .. last record
+ *
+ *  Everything is little endian. The records' fields are listed once, in
+ *  the X-macros below, which generate the structs, the schema hash and
+ *  the converter's CSV columns; any change to them changes the hash, so a
+ *  reader never misinterprets a snapshot from other firmware. Bump VERSION
+ *  for changes to the framing itself.
+ */
+namespace telemetry {
+
+static constexpr uint8_t SYNC[2] = {0xA5, 0x7E};
+static constexpr uint8_t VERSION = 1;
+static constexpr size_t HEADER_SIZE = 12;
+static constexpr size_t CRC_SIZE = 2;
+static constexpr size_t MAX_CONNECTIONS = 8;
+
+/** Whole-unit figures. Counters count since boot; rates, CPU load and the
+ *  latency percentiles cover the snapshot period or all reports so far. */
+#define TELEMETRY_SYSTEM_FIELDS(X)                                          \
+  X(uint32_t, unit_id)             /* low 32 bits of the base MAC */        \
+  X(uint32_t, uptime_ms)                                                    \
+  X(uint32_t, heap_free)                                                    \
+  X(uint32_t, heap_min_free)                                                \
+  X(uint32_t, heap_largest_block)                                           \
+  X(uint16_t, cpu0_load_permille)  /* over the period */                    \
+  X(uint16_t, cpu1_load_permille)                                           \
+  X(uint32_t, events_published)                                             \
+  X(uint32_t, pipeline_drops)                                               \
+  X(uint16_t, pipeline_queue_max)                                           \
+  X(uint32_t, connect_attempts)                                             \
+  X(uint32_t, connect_failures)                                             \
+  X(uint32_t, disconnects)                                                  \
+  X(uint32_t, report_latency_p50_us) /* receive to pipeline done */         \
+  X(uint32_t, report_latency_p90_us)                                        \
+  X(uint32_t, report_latency_p99_us)                                        \
+  X(uint32_t, report_latency_max_us)                                        \
+  X(uint8_t, scanning)                                                      \
+  X(uint32_t, scan_host_delay_p99_us) /* connections, while scanning */     \
+  X(uint32_t, idle_host_delay_p99_us) /* and while not */                   \
+  X(uint32_t, alloc_violations)
+
+/** One connected device. */
+#define TELEMETRY_CONNECTION_FIELDS(X)                                      \
+  X(uint16_t, conn_handle)                                                  \
+  X(uint64_t, address)             /* 48-bit peer address */                \
+  X(int8_t, rssi)                                                           \
+  X(uint16_t, interval_1250us)                                              \
+  X(uint16_t, peripheral_latency)                                           \
+  X(uint16_t, supervision_timeout_10ms)                                     \
+  X(uint32_t, reports)                                                      \
+  X(uint16_t, report_rate_hz)      /* over the period */                    \
+  X(uint32_t, missed_events)                                                \
+  X(uint16_t, jitter_us)                                                    \
+  X(uint32_t, host_delay_p50_us)                                            \
+  X(uint32_t, host_delay_p99_us)                                            \
+  X(uint32_t, output_sent)                                                  \
+  X(uint32_t, output_failed)                                                \
+  X(uint32_t, first_report_ms)     /* after connecting started */           \
+  X(uint8_t, battery_level)        /* 0xFF = unknown */
+
+#define TELEMETRY_MEMBER(type, name) type name;
+struct __attribute__((packed)) SystemRecord {
+  TELEMETRY_SYSTEM_FIELDS(TELEMETRY_MEMBER)
+};
+struct __attribute__((packed)) ConnectionRecord {
+  TELEMETRY_CONNECTION_FIELDS(TELEMETRY_MEMBER)
+};
+#undef TELEMETRY_MEMBER
+
+static constexpr size_t MAX_FRAME_SIZE =
+  HEADER_SIZE + sizeof(SystemRecord) + MAX_CONNECTIONS * sizeof(ConnectionRecord) + CRC_SIZE;
+
+/** FNV-1a, for the schema hash. */
+static constexpr uint32_t fnv1a(const char *s) {
+  uint32_t hash = 2166136261u;
+  for (; *s; s++) hash = (hash ^ (uint8_t)*s) * 16777619u;
+  return hash;
+}
+
+#define TELEMETRY_SCHEMA_FIELD(type, name) #type " " #name ";"
+static constexpr uint32_t SCHEMA_HASH = fnv1a("system{" TELEMETRY_SYSTEM_FIELDS(TELEMETRY_SCHEMA_FIELD)
+                                              "}connection{" TELEMETRY_CONNECTION_FIELDS(TELEMETRY_SCHEMA_FIELD)
+                                              "}");
+#undef TELEMETRY_SCHEMA_FIELD
+
+/** Builds one frame in a caller provided buffer of MAX_FRAME_SIZE bytes. */
+class FrameWriter {
+public:
+  void begin(uint8_t *buffer, const SystemRecord &system) {
+    buffer_ = buffer;
+    num_connections_ = 0;
+    memcpy(buffer_ + HEADER_SIZE, &system, sizeof(system));
+  }
+
+  /** False once MAX_CONNECTIONS records have been added. */
+  bool add(const ConnectionRecord &connection) {
+    if (num_connections_ == MAX_CONNECTIONS) return false;
+    memcpy(buffer_ + HEADER_SIZE + sizeof(SystemRecord) + num_connections_ * sizeof(ConnectionRecord),
+           &connection, sizeof(connection));
+    num_connections_++;
+    return true;
+  }
+
+  /** Fill in the header and CRC; returns the frame's total size. */
+  size_t finish(uint32_t sequence) {
+    buffer_[0] = SYNC[0];
+    buffer_[1] = SYNC[1];
+    buffer_[2] = VERSION;
+    buffer_[3] = num_connections_;
+    put32(buffer_ + 4, SCHEMA_HASH);
+    put32(buffer_ + 8, sequence);
+    size_t length = frameSize(num_connections_) - CRC_SIZE;
+    uint16_t crc = input_stream::crc16(buffer_ + 2, length - 2);
+    buffer_[length] = crc;
+    buffer_[length + 1] = crc >> 8;
+    return length + CRC_SIZE;
+  }
+
+  static constexpr size_t frameSize(size_t num_connections) {
+    return HEADER_SIZE + sizeof(SystemRecord) + num_connections * sizeof(ConnectionRecord) + CRC_SIZE;
+  }
+
+protected:
+  static void put32(uint8_t *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = v >> (8 * i);
+  }
+
+  uint8_t *buffer_{nullptr};
+  uint8_t num_connections_{0};
+};
+
+} // namespace telemetry
@@ -0,0 +1,106 @@
+#include "sdkconfig.h"
+
+#if CONFIG_HID_HOST_USB_PASSTHROUGH
+
+#include <cstring>
+
+#include "tinyusb.h"
+#include "class/hid/hid_device.h"
+
+#include "tinyusb_hid_endpoint.hpp"
+
+TinyUsbHidEndpoint *TinyUsbHidEndpoint::instance_ = nullptr;
+
+/** Interface, string index, IN endpoint address and size, poll interval (ms) */
+static constexpr uint8_t HID_ITF = 0;
+static constexpr uint8_t HID_STR_IDX = 4;
+static constexpr uint8_t HID_EP_IN = 0x81;
+static constexpr uint8_t HID_EP_SIZE = 64;
+static constexpr uint8_t HID_POLL_MS = 1;
+static constexpr size_t CONFIG_TOTAL_LEN = TUD_CONFIG_DESC_LEN + TUD_HID_DESC_LEN;
+
+static const char language_id[] = {0x09, 0x04};
+static const char* string_descriptor[] = {
+  language_id,          // 0: supported language is English (0x0409)
+  "esp-hid-host",       // 1: manufacturer
+  "BLE HID passthrough", // 2: product
+  "000001",             // 3: serial
+  "HID interface",      // 4: HID
+};
+
+/** Built at start() since it embeds the report descriptor length */
+static uint8_t configuration_descriptor[CONFIG_TOTAL_LEN];
+
+TinyUsbHidEndpoint::TinyUsbHidEndpoint(complete_fn on_complete, output_fn on_output)
+  : on_complete_(on_complete), on_output_(on_output) {
+  instance_ = this;
+}
+
+bool TinyUsbHidEndpoint::start(const uint8_t *report_descriptor, size_t length) {
+  if (started_ || length > MAX_DESCRIPTOR_SIZE) {
+    return false;
+  }
+  memcpy(descriptor_.data(), report_descriptor, length);
+  descriptor_length_ = length;
+
+  const uint8_t config[] = {
+    TUD_CONFIG_DESCRIPTOR(1, 1, 0, CONFIG_TOTAL_LEN, TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP, 100),
+    TUD_HID_DESCRIPTOR(HID_ITF, HID_STR_IDX, false, (uint16_t)length, HID_EP_IN, HID_EP_SIZE, HID_POLL_MS),
+  };
+  static_assert(sizeof(config) == CONFIG_TOTAL_LEN);
+  memcpy(configuration_descriptor, config, sizeof(config));
+
+  tinyusb_config_t tusb_cfg = {};
+  tusb_cfg.device_descriptor = nullptr; // use the default from menuconfig
+  tusb_cfg.string_descriptor = string_descriptor;
+  tusb_cfg.external_phy = false;
+  tusb_cfg.configuration_descriptor = configuration_descriptor;
+  if (tinyusb_driver_install(&tusb_cfg) != ESP_OK) {
+    printf("Could not install the TinyUSB driver\n");
+    return false;
+  }
+  started_ = true;
+  return true;
+}
+
+bool TinyUsbHidEndpoint::ready() {
+  return started_ && tud_mounted() && tud_hid_n_ready(HID_ITF);
+}
+
+bool TinyUsbHidEndpoint::send(uint8_t report_id, const uint8_t *data, size_t length) {
+  if (!ready()) {
+    return false;
+  }
+  return tud_hid_n_report(HID_ITF, report_id, data, length);
+}
+
+/********* TinyUSB HID callbacks *********/
+
+extern "C" uint8_t const *tud_hid_descriptor_report_cb(uint8_t instance) {
+  auto endpoint = TinyUsbHidEndpoint::instance();
+  return endpoint ? endpoint->reportDescriptor() : nullptr;
+}
+
+extern "C" void tud_hid_report_complete_cb(uint8_t instance, uint8_t const *report, uint16_t len) {
+  auto endpoint = TinyUsbHidEndpoint::instance();
+  if (endpoint) endpoint->onReportComplete();
+}
+
+extern "C" uint16_t tud_hid_get_report_cb(uint8_t instance, uint8_t report_id,
+                                          hid_report_type_t report_type,
+                                          uint8_t *buffer, uint16_t reqlen) {
+  /** GET_REPORT is not supported, the host gets input over the interrupt endpoint */
+  return 0;
+}
+
+extern "C" void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id,
+                                      hid_report_type_t report_type,
+                                      uint8_t const *buffer, uint16_t bufsize) {
+  /** There is no OUT endpoint, so output reports arrive here as SET_REPORT;
+   *  feature reports are not forwarded */
+  if (report_type != HID_REPORT_TYPE_OUTPUT) return;
+  auto endpoint = TinyUsbHidEndpoint::instance();
+  if (endpoint) endpoint->onOutputReport(report_id, buffer, bufsize);
+}
+
+#endif // CONFIG_HID_HOST_USB_PASSTHROUGH
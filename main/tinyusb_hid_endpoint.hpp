@@ -0,0 +1,49 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+
+#include "usb_hid_endpoint.hpp"
+
+/** UsbHidEndpoint backed by TinyUSB on the ESP32-S3's native USB port.
+ *
+ *  Presents a single HID interface with one interrupt IN endpoint polled
+ *  every 1 ms. TinyUSB asks for the report descriptor through a C callback,
+ *  so there can only be one instance.
+ */
+class TinyUsbHidEndpoint : public UsbHidEndpoint {
+public:
+  static constexpr size_t MAX_DESCRIPTOR_SIZE = 512;
+
+  /** Called from the TinyUSB task when the IN endpoint becomes free again. */
+  typedef std::function<void()> complete_fn;
+
+  /** Called from the TinyUSB task with each output report (LEDs, rumble, ...)
+   *  the USB host sends, without the report ID byte. */
+  typedef std::function<void(uint8_t report_id, const uint8_t *data, size_t length)> output_fn;
+
+  explicit TinyUsbHidEndpoint(complete_fn on_complete = nullptr, output_fn on_output = nullptr);
+
+  bool start(const uint8_t *report_descriptor, size_t length) override;
+  bool ready() override;
+  bool send(uint8_t report_id, const uint8_t *data, size_t length) override;
+
+  /** The running instance, used by the TinyUSB callbacks. */
+  static TinyUsbHidEndpoint *instance() { return instance_; }
+
+  const uint8_t *reportDescriptor() const { return descriptor_.data(); }
+  void onReportComplete() { if (on_complete_) on_complete_(); }
+  void onOutputReport(uint8_t report_id, const uint8_t *data, size_t length) {
+    if (on_output_) on_output_(report_id, data, length);
+  }
+
+protected:
+  static TinyUsbHidEndpoint *instance_;
+
+  complete_fn on_complete_;
+  output_fn on_output_;
+  bool started_{false};
+  std::array<uint8_t, MAX_DESCRIPTOR_SIZE> descriptor_{};
+  size_t descriptor_length_{0};
+};
@@ -0,0 +1,36 @@
+#include "sdkconfig.h"
+
+#if CONFIG_HID_HOST_INPUT_STREAM_UART || CONFIG_HID_HOST_TELEMETRY_UART
+
+#include "driver/uart.h"
+
+#include "uart_stream_link.hpp"
+
+bool UartStreamLink::start() {
+  if (started_) {
+    return true;
+  }
+  uart_config_t uart_config = {};
+  uart_config.baud_rate = config_.baud_rate;
+  uart_config.data_bits = UART_DATA_8_BITS;
+  uart_config.parity = UART_PARITY_DISABLE;
+  uart_config.stop_bits = UART_STOP_BITS_1;
+  uart_config.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+  uart_config.source_clk = UART_SCLK_DEFAULT;
+  auto port = (uart_port_t)config_.port;
+  /** the RX buffer must be larger than the FIFO even though we never read */
+  if (uart_driver_install(port, SOC_UART_FIFO_LEN * 2, config_.max_frame_size * 2, 0, nullptr, 0) != ESP_OK) {
+    return false;
+  }
+  uart_param_config(port, &uart_config);
+  uart_set_pin(port, config_.tx_pin, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+  started_ = true;
+  return true;
+}
+
+bool UartStreamLink::send(const uint8_t *frame, size_t length) {
+  /** copies into the TX ring buffer, only blocks if the link is saturated */
+  return started_ && uart_write_bytes((uart_port_t)config_.port, frame, length) == (int)length;
+}
+
+#endif // CONFIG_HID_HOST_INPUT_STREAM_UART || CONFIG_HID_HOST_TELEMETRY_UART
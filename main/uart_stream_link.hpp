@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "stream_link.hpp"
+
+/** StreamLink over a UART, TX only.
+ *
+ *  The ESP32 UART driver has no TX DMA; frames are copied into the
+ *  driver's TX ring buffer (two frames deep) and drained into the FIFO by
+ *  its ISR, so send() returns without waiting for the wire.
+ */
+class UartStreamLink : public StreamLink {
+public:
+  struct Config {
+    int port;
+    int tx_pin;
+    int baud_rate;
+    size_t max_frame_size; /**< The TX ring buffer holds two of these. */
+  };
+
+  explicit UartStreamLink(const Config &config) : config_(config) {}
+
+  bool start() override;
+  bool send(const uint8_t *frame, size_t length) override;
+
+protected:
+  Config config_;
+  bool started_{false};
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/** The device side of a USB HID interface, as seen by the passthrough.
+ *
+ *  Kept to the few operations the forwarding path needs so it can be backed
+ *  by TinyUSB on the target or by a fake endpoint that just records what it
+ *  was sent (order, timing) when running off target.
+ */
+class UsbHidEndpoint {
+public:
+  virtual ~UsbHidEndpoint() = default;
+
+  /** Enumerate with the given report descriptor. The endpoint keeps its own
+   *  copy. Can only be done once. */
+  virtual bool start(const uint8_t *report_descriptor, size_t length) = 0;
+
+  /** True once the host has configured us and the IN endpoint is free. */
+  virtual bool ready() = 0;
+
+  /** Queue one input report. report_id 0 means the descriptor declares no
+   *  report IDs. Returns false if the endpoint was busy. */
+  virtual bool send(uint8_t report_id, const uint8_t *data, size_t length) = 0;
+};
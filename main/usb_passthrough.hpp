@@ -0,0 +1,278 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+#include "esp_timer.h"
+
+#include "input_state.hpp"
+#include "usb_hid_endpoint.hpp"
+
+/** Forwards input from one BLE HID device to a USB HID device interface.
+ *
+ *  RAW mode enumerates with the BLE device's own report map and forwards
+ *  each notification payload as is; the only copy is the endpoint's own.
+ *  NORMALIZED mode enumerates as a fixed gamepad and encodes the decoded
+ *  InputState into it, so any controller looks the same to the host.
+ *
+ *  The first device whose report map is read is the one forwarded. A USB
+ *  device cannot change its descriptor without re-enumerating, so in RAW
+ *  mode a later device is only picked up if its report map is identical.
+ *
+ *  If the IN endpoint is still busy with the previous report, the newest
+ *  report of each report ID is kept and sent when the endpoint frees up;
+ *  while any are kept, new reports queue behind them, so the host gets
+ *  them in order. Sending and keeping happen under one lock, which the
+ *  endpoint's completion (onEndpointFree) takes too, so a completion in
+ *  between cannot leave a report stranded. Endpoint sends only queue the
+ *  transfer and complete from the USB task, never from within send().
+ */
+class UsbPassthrough {
+public:
+  enum class Mode : uint8_t {
+    RAW,
+    NORMALIZED,
+  };
+
+  struct Config {
+    UsbHidEndpoint *endpoint;
+    Mode mode{Mode::RAW};
+  };
+
+  static constexpr uint16_t NO_CONNECTION = 0xFFFF;
+  static constexpr size_t MAX_REPORT_SIZE = 64;
+  static constexpr size_t MAX_PENDING = 4;
+
+  /** Layout of the NORMALIZED mode input report. */
+  struct __attribute__((packed)) NormalizedReport {
+    uint32_t buttons;
+    int16_t axes[8];
+    uint8_t hat;
+  };
+
+  explicit UsbPassthrough(const Config &config) : config_(config) {}
+
+  /** A device's report map is known; attach it if nothing is forwarded yet. */
+  void onReportMap(uint16_t conn_handle, const uint8_t *map, size_t length) {
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (conn_handle_ != NO_CONNECTION) return;
+    if (config_.mode == Mode::NORMALIZED) {
+      if (!started_) started_ = config_.endpoint->start(NORMALIZED_DESCRIPTOR, sizeof(NORMALIZED_DESCRIPTOR));
+    } else if (!started_) {
+      started_ = config_.endpoint->start(map, length);
+      descriptor_hash_ = hash(map, length);
+    } else if (hash(map, length) != descriptor_hash_) {
+      printf("USB passthrough: report map of device %d differs from the enumerated one, not forwarding\n",
+             conn_handle);
+      return;
+    }
+    if (started_) {
+      conn_handle_ = conn_handle;
+      last_sequence_ = 0;
+      has_sequence_ = false;
+      printf("USB passthrough: forwarding device %d\n", conn_handle);
+    }
+  }
+
+  void onDisconnect(uint16_t conn_handle) {
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (conn_handle != conn_handle_) return;
+    conn_handle_ = NO_CONNECTION;
+    for (auto &p : pending_) p.in_use = false;
+  }
+
+  /** The device being forwarded, or NO_CONNECTION. */
+  uint16_t connection() {
+    std::lock_guard<std::mutex> lk(mutex_);
+    return conn_handle_;
+  }
+
+  /** RAW mode: forward a notification payload as is. */
+  void forwardRaw(uint16_t conn_handle, uint8_t report_id, const uint8_t *data, size_t length,
+                  uint32_t sequence, int64_t rx_us) {
+    if (config_.mode != Mode::RAW) return;
+    forward(conn_handle, report_id, data, length, sequence, rx_us);
+  }
+
+  /** NORMALIZED mode: encode and forward a decoded state. */
+  void forwardState(const InputState &state) {
+    if (config_.mode != Mode::NORMALIZED) return;
+    NormalizedReport report;
+    report.buttons = state.buttons;
+    memcpy(report.axes, state.axes.data(), sizeof(report.axes));
+    report.hat = state.hats[0];
+    forward(state.device, 0, (const uint8_t *)&report, sizeof(report), state.sequence, state.timestamp_us);
+  }
+
+  /** The endpoint is free again: send the oldest pending report. */
+  void onEndpointFree() {
+    std::lock_guard<std::mutex> lk(mutex_);
+    sendOldest();
+  }
+
+  void printStats() {
+    /** print from a copy, so forwarding never waits for the console */
+    Stats s;
+    {
+      std::lock_guard<std::mutex> lk(mutex_);
+      s = stats_;
+    }
+    printf("USB passthrough (%s): forwarded %lu, coalesced %lu, dropped %lu, out of order %lu",
+           config_.mode == Mode::RAW ? "raw" : "normalized",
+           (unsigned long)s.forwarded, (unsigned long)s.coalesced,
+           (unsigned long)s.dropped, (unsigned long)s.out_of_order);
+    if (s.forwarded) {
+      printf(", rx->usb min %lld us avg %lld us max %lld us",
+             (long long)s.min_us, (long long)(s.sum_us / s.forwarded),
+             (long long)s.max_us);
+    }
+    printf("\n");
+  }
+
+  static constexpr uint8_t NORMALIZED_DESCRIPTOR[] = {
+    0x05, 0x01,       // Usage Page (Generic Desktop)
+    0x09, 0x05,       // Usage (Gamepad)
+    0xA1, 0x01,       // Collection (Application)
+    0x05, 0x09,       //   Usage Page (Button)
+    0x19, 0x01,       //   Usage Minimum (1)
+    0x29, 0x20,       //   Usage Maximum (32)
+    0x15, 0x00,       //   Logical Minimum (0)
+    0x25, 0x01,       //   Logical Maximum (1)
+    0x75, 0x01,       //   Report Size (1)
+    0x95, 0x20,       //   Report Count (32)
+    0x81, 0x02,       //   Input (Data, Var, Abs)
+    0x05, 0x01,       //   Usage Page (Generic Desktop)
+    0x09, 0x30,       //   Usage (X)
+    0x09, 0x31,       //   Usage (Y)
+    0x09, 0x32,       //   Usage (Z)
+    0x09, 0x33,       //   Usage (Rx)
+    0x09, 0x34,       //   Usage (Ry)
+    0x09, 0x35,       //   Usage (Rz)
+    0x09, 0x36,       //   Usage (Slider)
+    0x09, 0x37,       //   Usage (Dial)
+    0x16, 0x00, 0x80, //   Logical Minimum (-32768)
+    0x26, 0xFF, 0x7F, //   Logical Maximum (32767)
+    0x75, 0x10,       //   Report Size (16)
+    0x95, 0x08,       //   Report Count (8)
+    0x81, 0x02,       //   Input (Data, Var, Abs)
+    0x09, 0x39,       //   Usage (Hat Switch)
+    0x15, 0x00,       //   Logical Minimum (0)
+    0x25, 0x07,       //   Logical Maximum (7)
+    0x35, 0x00,       //   Physical Minimum (0)
+    0x46, 0x3B, 0x01, //   Physical Maximum (315)
+    0x65, 0x14,       //   Unit (Degrees)
+    0x75, 0x04,       //   Report Size (4)
+    0x95, 0x01,       //   Report Count (1)
+    0x81, 0x42,       //   Input (Data, Var, Abs, Null State)
+    0x65, 0x00,       //   Unit (None)
+    0x75, 0x04,       //   Report Size (4)
+    0x95, 0x01,       //   Report Count (1)
+    0x81, 0x03,       //   Input (Const) padding
+    0xC0,             // End Collection
+  };
+
+protected:
+  struct Pending {
+    bool in_use{false};
+    uint8_t report_id{0};
+    uint8_t length{0};
+    uint32_t sequence{0};
+    int64_t rx_us{0};
+    uint8_t data[MAX_REPORT_SIZE];
+  };
+
+  struct Stats {
+    uint32_t forwarded{0};
+    uint32_t coalesced{0};
+    uint32_t dropped{0};
+    uint32_t out_of_order{0};
+    int64_t min_us{INT64_MAX};
+    int64_t max_us{0};
+    int64_t sum_us{0};
+  };
+
+  static uint32_t hash(const uint8_t *data, size_t length) {
+    uint32_t h = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < length; i++) h = (h ^ data[i]) * 16777619u;
+    return h;
+  }
+
+  void forward(uint16_t conn_handle, uint8_t report_id, const uint8_t *data, size_t length, uint32_t sequence,
+               int64_t rx_us) {
+    if (length > MAX_REPORT_SIZE) return;
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (conn_handle != conn_handle_) return;
+    bool queued = false;
+    for (auto &p : pending_) queued |= p.in_use;
+    if (!queued && config_.endpoint->ready() && config_.endpoint->send(report_id, data, length)) {
+      record(sequence, rx_us);
+      return;
+    }
+    // endpoint busy or reports waiting: keep only the newest report per
+    // report ID, behind the ones waiting
+    Pending *slot = nullptr;
+    for (auto &p : pending_) {
+      if (p.in_use && p.report_id == report_id) { slot = &p; stats_.coalesced++; break; }
+    }
+    if (!slot) {
+      for (auto &p : pending_) {
+        if (!p.in_use) { slot = &p; break; }
+      }
+    }
+    if (!slot) {
+      stats_.dropped++;
+      return;
+    }
+    slot->in_use = true;
+    slot->report_id = report_id;
+    slot->length = length;
+    slot->sequence = sequence;
+    slot->rx_us = rx_us;
+    memcpy(slot->data, data, length);
+    // the endpoint may have freed up with nothing to send
+    sendOldest();
+  }
+
+  /** Must be called with mutex_ held. */
+  void sendOldest() {
+    Pending *oldest = nullptr;
+    for (auto &candidate : pending_) {
+      if (candidate.in_use && (!oldest || (int32_t)(candidate.sequence - oldest->sequence) < 0)) {
+        oldest = &candidate;
+      }
+    }
+    // a stale completion: another report already took the endpoint
+    if (!oldest || !config_.endpoint->ready()) return;
+    oldest->in_use = false;
+    if (config_.endpoint->send(oldest->report_id, oldest->data, oldest->length)) {
+      record(oldest->sequence, oldest->rx_us);
+    } else {
+      stats_.dropped++;
+    }
+  }
+
+  /** Must be called with mutex_ held. */
+  void record(uint32_t sequence, int64_t rx_us) {
+    auto elapsed = esp_timer_get_time() - rx_us;
+    if (has_sequence_ && (int32_t)(sequence - last_sequence_) < 0) stats_.out_of_order++;
+    last_sequence_ = sequence;
+    has_sequence_ = true;
+    stats_.forwarded++;
+    stats_.sum_us += elapsed;
+    if (elapsed < stats_.min_us) stats_.min_us = elapsed;
+    if (elapsed > stats_.max_us) stats_.max_us = elapsed;
+  }
+
+  Config config_;
+  std::mutex mutex_;
+  bool started_{false};
+  uint32_t descriptor_hash_{0};
+  uint16_t conn_handle_{NO_CONNECTION};
+  uint32_t last_sequence_{0};
+  bool has_sequence_{false};
+  std::array<Pending, MAX_PENDING> pending_;
+  Stats stats_;
+};
@@ -0,0 +1,163 @@
+/** AdvertiserCache against a reference LRU: a pool of advertisers much
+ *  larger than the cache, heard in random order and pruned on a schedule.
+ *  The cache must hold exactly the advertisers the reference does, never
+ *  more than its capacity, and count the same evictions and prunes.
+ *
+ *  Then print(): its output must be most recently heard first, and the BLE
+ *  host's update() must not wait for it. stdout goes to a pipe nobody reads
+ *  yet, so print() blocks halfway through, and an update() from another
+ *  thread must still get through.
+ *
+ *    advertiser_cache_test [reports]
+ */
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "advertiser_cache.hpp"
+#include "host_test.hpp"
+
+using Cache = AdvertiserCache<64>;
+
+static void addressOf(uint32_t id, uint8_t address[6]) {
+  uint8_t a[6] = {(uint8_t)id, (uint8_t)(id >> 8), (uint8_t)(id >> 16), 0x5A, 0xC0, 0xDE};
+  memcpy(address, a, 6);
+}
+
+static void hear(Cache &cache, uint32_t id, uint32_t now_ms) {
+  uint8_t address[6];
+  addressOf(id, address);
+  uint16_t uuid = id % 8 == 0 ? 0x1812 : 0x1800 + id % 0x10;
+  uint8_t payload[] = {2, 0x01, 0x06, 3, 0x03, (uint8_t)uuid, (uint8_t)(uuid >> 8)};
+  cache.update(address, 0, 0, false, -40 - (int8_t)(id % 60), Cache::LEGACY_PHYS, payload, sizeof(payload), now_ms);
+}
+
+static bool holds(Cache &cache, uint32_t id) {
+  uint8_t address[6];
+  addressOf(id, address);
+  Cache::Entry entry;
+  return cache.get(address, 0, entry);
+}
+
+int main(int argc, char **argv) {
+  uint32_t reports = argc >= 2 ? atoi(argv[1]) : 200000;
+  static constexpr uint32_t POOL = 1000;
+  static constexpr uint32_t MAX_AGE_MS = 300;
+  static constexpr uint32_t PRUNE_EVERY = 500;
+
+  {
+    Cache cache;
+    std::map<uint32_t, uint32_t> reference; // id -> last heard
+    uint32_t evictions = 0, pruned = 0;
+    uint32_t seed = 1;
+    size_t mismatches = 0;
+    // one report per ms, so no two advertisers are heard at the same time
+    for (uint32_t now_ms = 1; now_ms <= reports; now_ms++) {
+      seed = seed * 1664525u + 1013904223u;
+      // a few advertisers are heard far more often than the rest, and
+      // every other second only they are, so the rest age out
+      bool quiet = now_ms / 1000 % 2;
+      uint32_t id = (seed >> 8) % (quiet || seed & 0x80 ? 16 : POOL);
+      hear(cache, id, now_ms);
+      if (!reference.count(id) && reference.size() == Cache::MAX_ENTRIES) {
+        auto oldest = std::min_element(reference.begin(), reference.end(),
+                                       [](auto &a, auto &b) { return a.second < b.second; });
+        reference.erase(oldest);
+        evictions++;
+      }
+      reference[id] = now_ms;
+      if (now_ms % PRUNE_EVERY == 0) {
+        size_t expected = std::erase_if(reference, [now_ms](auto &r) { return now_ms - r.second > MAX_AGE_MS; });
+        CHECK(cache.prune(MAX_AGE_MS, now_ms) == expected);
+        pruned += expected;
+      }
+      CHECK(cache.size() == reference.size());
+      if (now_ms % 97 == 0) {
+        for (auto &r : reference) mismatches += !holds(cache, r.first);
+      }
+    }
+    auto stats = cache.stats();
+    cache.printStats();
+    CHECK(mismatches == 0);
+    CHECK(stats.size_max == Cache::MAX_ENTRIES);
+    CHECK(stats.evictions == evictions);
+    CHECK(stats.pruned == pruned);
+    CHECK(stats.inserts - stats.evictions - stats.pruned == cache.size());
+  }
+
+  {
+    using BigCache = AdvertiserCache<255>;
+    static BigCache cache;
+    std::vector<std::string> expected;
+    for (uint32_t id = 0; id < BigCache::MAX_ENTRIES; id++) {
+      // heard in a shuffled order
+      uint32_t heard = (id * 97) % BigCache::MAX_ENTRIES + 1;
+      uint8_t address[6];
+      addressOf(id, address);
+      uint8_t payload[] = {2, 0x01, 0x06};
+      cache.update(address, 0, 0, false, -50, BigCache::LEGACY_PHYS, payload, sizeof(payload), heard);
+    }
+    for (uint32_t heard = BigCache::MAX_ENTRIES; heard >= 1; heard--) {
+      for (uint32_t id = 0; id < BigCache::MAX_ENTRIES; id++) {
+        if ((id * 97) % BigCache::MAX_ENTRIES + 1 != heard) continue;
+        char line[32];
+        snprintf(line, sizeof(line), "  de:c0:5a:%02x:%02x:%02x/0", (id >> 16) & 0xFF, (id >> 8) & 0xFF, id & 0xFF);
+        expected.push_back(line);
+      }
+    }
+
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+    fcntl(fds[1], F_SETPIPE_SZ, 4096);
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    dup2(fds[1], STDOUT_FILENO);
+    std::thread printer([&] {
+      cache.print(1000);
+      fflush(stdout);
+    });
+    // let it fill the pipe and block
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    std::atomic<bool> updated{false};
+    std::thread host([&] {
+      uint8_t address[6];
+      addressOf(1000, address);
+      cache.update(address, 0, 0, false, -50, BigCache::LEGACY_PHYS, nullptr, 0, 1000);
+      updated = true;
+    });
+    for (int i = 0; i < 100 && !updated; i++) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    bool update_waited = !updated;
+
+    std::string output;
+    std::thread reader([&] {
+      char buffer[4096];
+      ssize_t n;
+      while ((n = read(fds[0], buffer, sizeof(buffer))) > 0) output.append(buffer, n);
+    });
+    printer.join();
+    host.join();
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    close(fds[1]);
+    reader.join();
+    close(fds[0]);
+
+    std::vector<std::string> printed;
+    for (size_t start = 0, end; (end = output.find('\n', start)) != std::string::npos; start = end + 1) {
+      std::string line = output.substr(start, end - start);
+      if (line.rfind("  de:", 0) == 0) printed.push_back(line.substr(0, expected[0].size()));
+    }
+    printf("print: %lu of %lu entries, update %s while printing\n", (unsigned long)printed.size(),
+           (unsigned long)expected.size(), update_waited ? "waited" : "went through");
+    CHECK(!update_waited);
+    CHECK(printed == expected);
+  }
+  return host_test::result();
+}
@@ -0,0 +1,275 @@
+/** Soak of the steady state report path under the AllocationGuard, on
+ *  Linux. malloc, calloc and realloc are wrapped here the way the IDF heap
+ *  hooks wrap them on the target (operator new comes through malloc), and
+ *  each thread stands in for a task.
+ *
+ *  Set up as the firmware does, the threads start and the guard is armed:
+ *   - "BLE host": gamepad reports copied into the pipeline queue; also
+ *     allocates now and then, as scanning does. Permitted, as on the target.
+ *   - "pipeline": fault injection (drop, delay, reorder, duplicate, delayed
+ *     reports released as the pipeline task does), decode, axis
+ *     processing, remap, the input bus and the USB passthrough,
+ *   - "subscriber": polls the bus into a key diff and the motion
+ *     accumulator, and drains that,
+ *   - "USB": completes the endpoint's reports,
+ *   - "connect": allocates, as connecting does. Permitted.
+ *  None but the permitted tasks may allocate. Then one allocation each
+ *  through new and malloc from an unpermitted task must show as violations.
+ *  (glibc's other allocators, e.g. posix_memalign, are not wrapped.)
+ *
+ *    allocation_guard_soak [reports]
+ */
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "allocation_guard.hpp"
+#include "axis_processor.hpp"
+#include "fault_injector.hpp"
+#include "hid_report_map.hpp"
+#include "host_test.hpp"
+#include "input_event_bus.hpp"
+#include "input_remapper.hpp"
+#include "key_event_diff.hpp"
+#include "motion_accumulator.hpp"
+#include "usb_passthrough.hpp"
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *p, size_t size);
+
+/** What the task handle is to the guard: one per thread. */
+static const void *currentTask() {
+  static thread_local const char task = 0;
+  return &task;
+}
+
+void *malloc(size_t size) {
+  AllocationGuard::onAllocation(size, __builtin_return_address(0), currentTask());
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+  AllocationGuard::onAllocation(n * size, __builtin_return_address(0), currentTask());
+  return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size) {
+  AllocationGuard::onAllocation(size, __builtin_return_address(0), currentTask());
+  return __libc_realloc(p, size);
+}
+}
+
+/** Report 1: 32 buttons, then X, Y, Z, Rx, Ry and Rz as int16. */
+static constexpr uint8_t MAP[] = {
+  0x05, 0x01, 0x09, 0x05, 0xA1, 0x01, 0x85, 0x01,                                     // Gamepad, report 1
+  0x05, 0x09, 0x19, 0x01, 0x29, 0x20, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x20, 0x81, 0x02, // buttons
+  0x05, 0x01, 0x09, 0x30, 0x09, 0x31, 0x09, 0x32, 0x09, 0x33, 0x09, 0x34, 0x09, 0x35, // axes
+  0x16, 0x00, 0x80, 0x26, 0xFF, 0x7F, 0x75, 0x10, 0x95, 0x06, 0x81, 0x02,
+  0xC0,
+};
+static constexpr size_t REPORT_SIZE = 16;
+static constexpr uint16_t CONN = 1;
+
+/** An IN endpoint that takes one report at a time and keeps none. */
+class NullEndpoint : public UsbHidEndpoint {
+public:
+  bool start(const uint8_t *, size_t) override { return true; }
+  bool ready() override { return !busy_.load(); }
+  bool send(uint8_t, const uint8_t *, size_t) override {
+    bool expected = false;
+    if (!busy_.compare_exchange_strong(expected, true)) return false;
+    sent_++;
+    return true;
+  }
+  bool complete() {
+    bool expected = true;
+    return busy_.compare_exchange_strong(expected, false);
+  }
+  uint32_t sent() const { return sent_.load(); }
+
+protected:
+  std::atomic<bool> busy_{false};
+  std::atomic<uint32_t> sent_{0};
+};
+
+/** The pipeline queue: fixed size, copies in and out. */
+class ReportQueue {
+public:
+  struct Report {
+    uint8_t data[REPORT_SIZE];
+  };
+
+  bool push(const Report &report) {
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (count_ == reports_.size()) return false;
+    reports_[(head_ + count_++) % reports_.size()] = report;
+    return true;
+  }
+
+  bool pop(Report &report) {
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (!count_) return false;
+    report = reports_[head_];
+    head_ = (head_ + 1) % reports_.size();
+    count_--;
+    return true;
+  }
+
+protected:
+  std::mutex mutex_;
+  std::array<Report, 32> reports_;
+  size_t head_{0};
+  size_t count_{0};
+};
+
+int main(int argc, char **argv) {
+  uint32_t reports = argc >= 2 ? atoi(argv[1]) : 1000000;
+
+  // init: everything is set up, and may allocate
+  HidReportMap map;
+  CHECK(map.parse(MAP, sizeof(MAP)));
+  AxisProcessor processor;
+  for (size_t i = 0; i < InputState::NUM_AXES; i++) processor.configureAxis(i, {.deadzone = 1638, .exponent = 1.5f});
+  processor.configureStick(0, {.enabled = true, .x = InputState::X, .y = InputState::Y, .deadzone = 3276});
+  CompiledRemap remap;
+  RemapProfile profile{"soak", nullptr};
+  profile.invert_axes = 1 << InputState::Y;
+  remap.compile(profile);
+  InputEventBus<64> bus;
+  InputEventBus<64>::Subscriber subscriber(bus, "soak");
+  NullEndpoint endpoint;
+  UsbPassthrough passthrough({.endpoint = &endpoint});
+  passthrough.onReportMap(CONN, MAP, sizeof(MAP));
+  KeyEventDiff diff;
+  MotionAccumulator motion;
+  InputState state;
+  uint32_t sequence = 0;
+  FaultInjector injector({.deliver =
+                            [&](uint16_t conn, uint16_t, const uint8_t *data, size_t length) {
+                              map.decode(1, data, length, state);
+                              processor.apply(state.axes);
+                              remap.apply(state);
+                              state.sequence = ++sequence;
+                              bus.publish(state);
+                              passthrough.forwardRaw(conn, 1, data, length, sequence, esp_timer_get_time());
+                            },
+                          .drop_per_mille = 10,
+                          .delay_per_mille = 10,
+                          .delay_ms = 5,
+                          .reorder_per_mille = 10,
+                          .duplicate_per_mille = 10});
+  printf("soaking %lu reports\n", (unsigned long)reports);
+
+  ReportQueue queue;
+  std::atomic<bool> armed{false}, done{false}, produced{false};
+  std::atomic<uint32_t> known_tasks{0};
+  auto waitForArm = [&] {
+    while (!armed) std::this_thread::yield();
+  };
+  std::thread host([&] {
+    known_tasks += AllocationGuard::permitTask(currentTask());
+    waitForArm();
+    ReportQueue::Report report;
+    uint32_t seed = 1;
+    for (uint32_t i = 0; i < reports; i++) {
+      for (auto &b : report.data) {
+        seed = seed * 1664525u + 1013904223u;
+        b = seed >> 24;
+      }
+      // unlike the target's, waits for room: every report goes through
+      while (!queue.push(report)) std::this_thread::yield();
+      if (i % 1000 == 0) {
+        // an advertiser's scan result
+        std::string result(64, 'a');
+        asm volatile("" : : "r"(result.data()) : "memory");
+      }
+      if (i % 16 == 0) std::this_thread::yield();
+    }
+    produced = true;
+  });
+  std::thread pipeline([&] {
+    waitForArm();
+    ReportQueue::Report report;
+    for (;;) {
+      bool received = queue.pop(report);
+      auto next_us = injector.nextReleaseUs();
+      if (next_us >= 0 && next_us <= esp_timer_get_time()) injector.poll();
+      if (received) {
+        host_stub::time_us += 1000;
+        injector.onNotification(CONN, 2, report.data, sizeof(report.data));
+      } else if (produced) {
+        break;
+      } else {
+        std::this_thread::yield();
+      }
+    }
+    // let the last delayed ones out
+    for (int i = 0; i < 100; i++) {
+      host_stub::time_us += 1000;
+      injector.poll();
+    }
+    done = true;
+  });
+  std::thread sink([&] {
+    waitForArm();
+    KeyEvent events[KeyEventDiff::MAX_EVENTS];
+    while (!done) {
+      subscriber.poll([&](const InputState &s) {
+        diff.update(s.keys, events);
+        motion.add(s.motion);
+      });
+      motion.drain(127);
+      std::this_thread::yield();
+    }
+  });
+  std::thread usb([&] {
+    waitForArm();
+    while (!done) {
+      if (endpoint.complete()) passthrough.onEndpointFree();
+      std::this_thread::yield();
+    }
+  });
+  std::thread connect([&] {
+    known_tasks += AllocationGuard::permitTask(currentTask());
+    waitForArm();
+    while (!done) {
+      // a connection's discovery results
+      std::vector<std::string> services{"1812", "180f", "180a"};
+      asm volatile("" : : "r"(services.data()) : "memory");
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  });
+  // the permitted tasks have to be known before arming
+  while (known_tasks < 2) std::this_thread::yield();
+  AllocationGuard::arm();
+  armed = true;
+  host.join();
+  pipeline.join();
+  sink.join();
+  usb.join();
+  connect.join();
+
+  uint32_t violations = AllocationGuard::violations();
+  AllocationGuard::printStats();
+  printf("%lu reports published, %lu sent to USB\n", (unsigned long)bus.published(), (unsigned long)endpoint.sent());
+  CHECK(bus.published() > reports / 2);
+  CHECK(endpoint.sent() > 0);
+  CHECK(AllocationGuard::permittedAllocations() > 0);
+  CHECK(violations == 0);
+
+  // and the guard does see what it should: main is not a permitted task
+  int *p = new int(1);
+  asm volatile("" : : "r"(p) : "memory");
+  delete p;
+  void *m = malloc(8);
+  asm volatile("" : : "r"(m) : "memory");
+  free(m);
+  CHECK(AllocationGuard::violations() == violations + 2);
+  return host_test::result();
+}
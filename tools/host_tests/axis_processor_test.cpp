@@ -0,0 +1,206 @@
+/** AxisProcessor against a floating point reference of what it should
+ *  compute: calibration, axial deadzone and response curve of every input
+ *  value for a range of configurations, the radial deadzone of a stick,
+ *  and inversion by the remap that follows it. Inside a deadzone the
+ *  output must be exactly 0. Then a reader thread against back to back
+ *  reconfigurations, and the cost of a report.
+ *
+ *    axis_processor_test [reports]
+ */
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <thread>
+
+#include "axis_processor.hpp"
+#include "host_test.hpp"
+#include "input_remapper.hpp"
+
+using AxisConfig = AxisProcessor::AxisConfig;
+static constexpr double FULL_SCALE = AxisProcessor::FULL_SCALE;
+
+/** The axis transfer function, as AxisConfig describes it. */
+static double referenceAxis(int32_t raw, const AxisConfig &config) {
+  double n;
+  if (raw >= config.center) {
+    n = config.max > config.center ? (raw - config.center) / (double)(config.max - config.center) : 0;
+  } else {
+    n = config.center > config.min ? (raw - config.center) / (double)(config.center - config.min) : 0;
+  }
+  double deadzone = config.deadzone / FULL_SCALE;
+  double magnitude = std::min(std::fabs(n), 1.0);
+  if (magnitude <= deadzone) return 0;
+  magnitude = std::pow((magnitude - deadzone) / (1.0 - deadzone), config.exponent);
+  return std::copysign(magnitude, n) * FULL_SCALE;
+}
+
+static int16_t processAxis(AxisProcessor &processor, int16_t raw) {
+  std::array<int16_t, InputState::NUM_AXES> axes{};
+  axes[InputState::X] = raw;
+  processor.apply(axes);
+  return axes[InputState::X];
+}
+
+/** Every input value of one configuration; returns the largest error. */
+static double checkAxis(const AxisConfig &config, double tolerance) {
+  AxisProcessor processor;
+  processor.configureAxis(InputState::X, config);
+  double worst = 0;
+  for (int32_t raw = -32768; raw <= 32767; raw++) {
+    double expected = referenceAxis(raw, config);
+    int16_t out = processAxis(processor, raw);
+    if (expected == 0) {
+      if (out != 0) {
+        fprintf(stderr, "  raw %d inside the deadzone gave %d\n", raw, out);
+        host_test::failures++;
+        return worst;
+      }
+      continue;
+    }
+    worst = std::max(worst, std::fabs(out - expected));
+  }
+  printf("  center %6d range %6d..%-6d deadzone %5u exponent %.1f: max error %.1f\n", config.center, config.min,
+         config.max, config.deadzone, config.exponent, worst);
+  CHECK(worst <= tolerance);
+  return worst;
+}
+
+/** The stick's radial deadzone, as StickConfig describes it. */
+static void referenceStick(int32_t x, int32_t y, double deadzone, double &out_x, double &out_y) {
+  double r = std::sqrt((double)x * x + (double)y * y);
+  if (r <= deadzone) {
+    out_x = out_y = 0;
+    return;
+  }
+  double scaled = std::min((r - deadzone) / (FULL_SCALE - deadzone), 1.0) * FULL_SCALE;
+  out_x = x * scaled / r;
+  out_y = y * scaled / r;
+}
+
+int main(int argc, char **argv) {
+  uint32_t reports = argc >= 2 ? atoi(argv[1]) : 1000000;
+
+  printf("axes (error in counts of 32767):\n");
+  for (float exponent : {1.0f, 1.5f, 2.0f, 3.0f}) {
+    for (uint16_t deadzone : {0, 328, 3276, 8192}) {
+      // the curve table's interpolation error, largest where the curve
+      // bends most: x^1.5 near 0
+      checkAxis({.deadzone = deadzone, .exponent = exponent}, 12);
+      // off center and asymmetric, as a worn stick or a trigger calibrates
+      checkAxis({.min = -20000, .center = 1500, .max = 30000, .deadzone = deadzone, .exponent = exponent}, 12);
+    }
+  }
+  // a trigger resting at one end: nothing below center
+  checkAxis({.min = -32768, .center = -32768, .max = 32767, .deadzone = 1638}, 8);
+
+  printf("sticks:\n");
+  for (uint16_t deadzone : {0, 3276, 8192}) {
+    AxisProcessor processor;
+    processor.configureStick(0, {.enabled = true, .x = InputState::X, .y = InputState::Y, .deadzone = deadzone});
+    double worst = 0, worst_past_edge = 0;
+    for (int32_t x = -32768; x <= 32767; x += 97) {
+      for (int32_t y = -32768; y <= 32767; y += 89) {
+        std::array<int16_t, InputState::NUM_AXES> axes{};
+        axes[InputState::X] = x;
+        axes[InputState::Y] = y;
+        processor.apply(axes);
+        double ex, ey;
+        referenceStick(x, y, deadzone, ex, ey);
+        if (ex == 0 && ey == 0) {
+          CHECK(axes[InputState::X] == 0 && axes[InputState::Y] == 0);
+          continue;
+        }
+        double error = std::max(std::fabs(axes[InputState::X] - ex), std::fabs(axes[InputState::Y] - ey));
+        // the gain table interpolates between its 1024 count steps, and
+        // the step the deadzone edge falls in starts from a 0 gain
+        double r = std::sqrt((double)x * x + (double)y * y);
+        if (deadzone && r < (deadzone / 1024 + 1) * 1024) {
+          worst_past_edge = std::max(worst_past_edge, error);
+        } else {
+          worst = std::max(worst, error);
+        }
+      }
+    }
+    printf("  deadzone %5u: max error %.1f, %.1f in the step past the deadzone edge\n", deadzone, worst,
+           worst_past_edge);
+    CHECK(worst <= 48);
+    CHECK(worst_past_edge <= 256);
+  }
+
+  printf("inversion:\n");
+  {
+    // the remap that follows axis processing inverts with ~x
+    AxisConfig config{.center = 1500, .deadzone = 3276, .exponent = 2.0f};
+    AxisProcessor processor;
+    processor.configureAxis(InputState::Y, config);
+    CompiledRemap remap;
+    RemapProfile profile{"invert y", nullptr};
+    profile.invert_axes = 1 << InputState::Y;
+    remap.compile(profile);
+    double worst = 0;
+    for (int32_t raw = -32768; raw <= 32767; raw++) {
+      InputState state;
+      state.axes[InputState::Y] = raw;
+      processor.apply(state.axes);
+      remap.apply(state);
+      double expected = -referenceAxis(raw, config) - 1;
+      worst = std::max(worst, std::fabs(state.axes[InputState::Y] - expected));
+    }
+    printf("  inverted Y: max error %.1f\n", worst);
+    CHECK(worst <= 8);
+  }
+
+  printf("reconfiguring under a reader:\n");
+  {
+    // the two configurations map 16000 to different values; a reader
+    // must only ever see one or the other
+    AxisConfig a{.deadzone = 3276, .exponent = 1.0f};
+    AxisConfig b{.deadzone = 8192, .exponent = 3.0f};
+    AxisProcessor processor;
+    processor.configureAxis(InputState::X, a);
+    int16_t out_a = processAxis(processor, 16000);
+    processor.configureAxis(InputState::X, b);
+    int16_t out_b = processAxis(processor, 16000);
+    CHECK(out_a != out_b);
+    std::atomic<bool> done{false};
+    std::atomic<uint32_t> seen{0}, other{0};
+    std::thread reader([&] {
+      while (!done) {
+        int16_t out = processAxis(processor, 16000);
+        if (out != out_a && out != out_b) other++;
+        seen++;
+      }
+    });
+    for (int i = 0; i < 2000; i++) {
+      processor.configureAxis(InputState::X, i & 1 ? a : b);
+      std::this_thread::yield();
+    }
+    done = true;
+    reader.join();
+    printf("  %lu reads, %lu of neither configuration\n", (unsigned long)seen.load(), (unsigned long)other.load());
+    CHECK(other == 0);
+  }
+
+  {
+    AxisProcessor processor;
+    AxisConfig axis{.center = 512, .deadzone = 3276, .exponent = 2.0f};
+    for (size_t i = 0; i < InputState::NUM_AXES; i++) processor.configureAxis(i, axis);
+    processor.configureStick(0, {.enabled = true, .x = InputState::X, .y = InputState::Y, .deadzone = 3276});
+    processor.configureStick(1, {.enabled = true, .x = InputState::Z, .y = InputState::RZ, .deadzone = 3276});
+    std::array<int16_t, InputState::NUM_AXES> axes{};
+    uint32_t seed = 1;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < reports; i++) {
+      for (auto &a : axes) {
+        seed = seed * 1664525u + 1013904223u;
+        a = seed >> 16;
+      }
+      processor.apply(axes);
+      asm volatile("" : : "r"(axes.data()) : "memory");
+    }
+    auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    printf("%.1f ns per report (%d axes, %d sticks, input generation included)\n", ns / reports,
+           (int)InputState::NUM_AXES, (int)AxisProcessor::NUM_STICKS);
+  }
+  return host_test::result();
+}
@@ -0,0 +1,158 @@
+/** ConnectionTiming on synthetic receive times: connection events on a
+ *  fixed grid, each report received after the earliest a host delay that
+ *  the test knows. The per report host delay must be that delay and the
+ *  missed events the events skipped, with events skipped at random, with
+ *  the peripheral's clock drifting from ours either way, and across an
+ *  interval change through setInterval(). Jitter must be 0 for a constant
+ *  host delay and follow the delay's variation otherwise.
+ *
+ *    connection_timing_test [reports]
+ */
+#include <cstdlib>
+
+#include "connection_timing.hpp"
+#include "host_test.hpp"
+
+/** One connection's reports: event k of the peripheral is at
+ *  start + k * interval on its clock, scaled by the drift on ours. */
+struct Link {
+  int64_t start_us;
+  uint32_t interval_us;
+  int32_t drift_ppm;
+
+  int64_t eventUs(uint64_t k) const {
+    return start_us + (int64_t)((double)k * interval_us * (1.0 + drift_ppm * 1e-6));
+  }
+};
+
+struct Run {
+  size_t reports{0};
+  size_t host_mismatches{0};
+  size_t missed_mismatches{0};
+  int64_t host_max_error_us{0};
+  uint64_t missed{0};
+  uint64_t next_event{0};
+};
+
+/** Feeds reports of a link into timing: each at a random number of events
+ *  after the last (1 + up to max_skip skipped), delayed by 0 - max_delay
+ *  us, and 0 at least every 16 reports as the host is sometimes idle. The
+ *  host delay must come out within tolerance_us of the real one. */
+static void feed(ConnectionTiming &timing, const Link &link, Run &run, size_t reports, uint32_t max_skip,
+                 int64_t max_delay_us, int64_t tolerance_us, uint32_t &seed) {
+  for (size_t i = 0; i < reports; i++) {
+    seed = seed * 1664525u + 1013904223u;
+    uint32_t skip = max_skip ? (seed >> 8) % (max_skip + 1) : 0;
+    // mostly none, so missed events stay the exception they are
+    if ((seed >> 4) % 4) skip = 0;
+    uint64_t k = run.next_event + (run.reports ? skip : 0);
+    int64_t delay = i % 16 == 0 ? 0 : (seed >> 16) % (max_delay_us + 1);
+    auto sample = timing.onReport(link.eventUs(k) + delay);
+    int64_t error = std::llabs(sample.host_us - delay);
+    run.host_mismatches += error > tolerance_us;
+    run.host_max_error_us = std::max(run.host_max_error_us, error);
+    run.missed_mismatches += sample.missed_events != (run.reports ? skip : 0);
+    run.missed += run.reports ? skip : 0;
+    run.next_event = k + 1;
+    run.reports++;
+  }
+}
+
+int main(int argc, char **argv) {
+  size_t reports = argc >= 2 ? atoi(argv[1]) : 200000;
+  uint32_t seed = 1;
+
+  {
+    // nothing to go by before the interval is known
+    ConnectionTiming timing;
+    auto sample = timing.onReport(1000);
+    CHECK(sample.host_us < 0 && sample.missed_events == 0);
+    CHECK(timing.summary().reports == 0);
+  }
+  {
+    // a constant host delay is no delay at all, and no jitter
+    ConnectionTiming timing;
+    timing.setInterval(7500);
+    Link link{1000000, 7500, 0};
+    size_t mismatches = 0;
+    for (uint64_t k = 0; k < 1000; k++) {
+      auto sample = timing.onReport(link.eventUs(k) + 400);
+      mismatches += sample.host_us != 0 || sample.missed_events != 0;
+    }
+    CHECK(mismatches == 0);
+    auto summary = timing.summary();
+    CHECK(summary.jitter_us == 0 && summary.missed_events == 0 && summary.reports == 1000);
+  }
+  {
+    // a varying host delay, every event: exact, and jitter follows it
+    ConnectionTiming timing;
+    timing.setInterval(7500);
+    Run run;
+    feed(timing, {1000000, 7500, 0}, run, reports, 0, 200, 0, seed);
+    auto summary = timing.summary();
+    printf("varying delay: host max error %lld us, jitter %lu us, host p50 %lu us p99 %lu us\n",
+           (long long)run.host_max_error_us, (unsigned long)summary.jitter_us,
+           (unsigned long)summary.host_p50_us, (unsigned long)summary.host_p99_us);
+    CHECK(run.host_mismatches == 0 && run.missed_mismatches == 0);
+    CHECK(summary.missed_events == 0);
+    // the mean difference of two uniform delays is a third of their range
+    CHECK(summary.jitter_us > 40 && summary.jitter_us < 100);
+    CHECK(summary.host_p99_us <= 200);
+  }
+  {
+    // events without a report, up to 3 in a row: counted, delays still exact
+    ConnectionTiming timing;
+    timing.setInterval(7500);
+    Run run;
+    feed(timing, {1000000, 7500, 0}, run, reports, 3, 200, 0, seed);
+    auto summary = timing.summary();
+    printf("skipped events: %llu skipped, %lu counted missed\n", (unsigned long long)run.missed,
+           (unsigned long)summary.missed_events);
+    CHECK(run.host_mismatches == 0 && run.missed_mismatches == 0);
+    CHECK(run.missed > 0 && summary.missed_events == run.missed);
+  }
+  for (int32_t ppm : {100, -100}) {
+    // the peripheral's clock drifts by many intervals over the run; the
+    // grid has to follow, and is at most a window's drift behind (a window
+    // of reports spans up to 4 events each, with 3 skipped)
+    ConnectionTiming timing;
+    timing.setInterval(7500);
+    Run run;
+    int64_t window_drift_us = ConnectionTiming::WINDOW * 4 * 7500 * std::abs(ppm) / 1000000;
+    feed(timing, {1000000, 7500, ppm}, run, reports, 3, 200, window_drift_us, seed);
+    auto drift_us = Link{0, 7500, ppm}.eventUs(run.next_event) - (int64_t)run.next_event * 7500;
+    printf("drift %+d ppm (%lld us over the run): host max error %lld us, %lu missed of %llu\n", (int)ppm,
+           (long long)drift_us, (long long)run.host_max_error_us,
+           (unsigned long)timing.summary().missed_events, (unsigned long long)run.missed);
+    CHECK(std::llabs(drift_us) > 7500);
+    CHECK(run.host_mismatches == 0 && run.missed_mismatches == 0);
+  }
+  {
+    // 7.5 ms to 15 ms: the first new event is one new interval after the
+    // last old one, and whatever its delay, a window later the grid is
+    // exact again
+    ConnectionTiming timing;
+    timing.setInterval(7500);
+    Run before;
+    Link old_link{1000000, 7500, 0};
+    feed(timing, old_link, before, 1000, 0, 200, 0, seed);
+    timing.setInterval(15000);
+    Link new_link{old_link.eventUs(before.next_event - 1) + 15000, 15000, 0};
+    auto first = timing.onReport(new_link.eventUs(0) + 150);
+    CHECK(first.missed_events == 0);
+    Run settling, after;
+    settling.reports = after.reports = 1;
+    settling.next_event = 1;
+    feed(timing, new_link, settling, ConnectionTiming::WINDOW - 1, 0, 200, 150, seed);
+    after.next_event = settling.next_event;
+    feed(timing, new_link, after, 1000, 2, 200, 0, seed);
+    auto summary = timing.summary();
+    printf("interval change: host max error %lld us settling, %lld us after\n",
+           (long long)settling.host_max_error_us, (long long)after.host_max_error_us);
+    CHECK(settling.host_mismatches == 0 && settling.missed_mismatches == 0);
+    CHECK(after.host_mismatches == 0 && after.missed_mismatches == 0);
+    CHECK(summary.interval_us == 15000);
+    CHECK(summary.missed_events == after.missed);
+  }
+  return host_test::result();
+}
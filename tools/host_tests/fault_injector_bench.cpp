@@ -0,0 +1,202 @@
+/** Fault injection benchmark: a 1 kHz report stream through the
+ *  FaultInjector with one fault type at a time, on a simulated clock.
+ *  Prints the time-to-recover distribution of each and checks it against
+ *  what the fault does: a delayed report recovers after the delay, a
+ *  reordered one when the report that overtook it is through, a drop with
+ *  the next report, a failed connect or a disconnect at any bring-up phase
+ *  with the first report of the next connection; and no report is lost or
+ *  delivered twice that should not be.
+ *
+ *    fault_injector_bench [seconds]
+ */
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "fault_injector.hpp"
+#include "host_test.hpp"
+
+static constexpr int64_t TICK_US = 1000;
+
+class TestInjector : public FaultInjector {
+public:
+  using FaultInjector::FaultInjector;
+  const Stats &stats(Fault fault) const { return stats_[(size_t)fault]; }
+};
+
+struct Run {
+  std::vector<uint32_t> delivered;
+  uint32_t sent{0};
+};
+
+/** What the pipeline task does between reports: poll only once the next
+ *  delayed report is due. */
+static void release(TestInjector &injector) {
+  auto next_us = injector.nextReleaseUs();
+  if (next_us >= 0 && next_us <= esp_timer_get_time()) injector.poll();
+}
+
+/** Sends seconds worth of reports, each carrying its number, then lets
+ *  the delayed ones out. */
+static void stream(TestInjector &injector, Run &run, double seconds) {
+  auto start = std::chrono::steady_clock::now();
+  uint32_t count = seconds * 1000000 / TICK_US;
+  for (; run.sent < count; run.sent++) {
+    host_stub::time_us += TICK_US;
+    injector.onNotification(1, 2, (const uint8_t *)&run.sent, sizeof(run.sent));
+    release(injector);
+  }
+  for (int i = 0; i < 1000; i++) {
+    host_stub::time_us += TICK_US;
+    release(injector);
+  }
+  auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  printf("  %.0f ns per report (with poll)\n", ns / count);
+}
+
+static TestInjector makeInjector(Run &run, FaultInjector::Config config) {
+  config.deliver = [&run](uint16_t, uint16_t, const uint8_t *data, size_t length) {
+    uint32_t n;
+    if (length == sizeof(n)) {
+      memcpy(&n, data, sizeof(n));
+      run.delivered.push_back(n);
+    }
+  };
+  return TestInjector(config);
+}
+
+int main(int argc, char **argv) {
+  double seconds = argc >= 2 ? atof(argv[1]) : 10.0;
+  using Fault = FaultInjector::Fault;
+
+  {
+    printf("drop 50/1000:\n");
+    Run run;
+    auto injector = makeInjector(run, {.deliver = nullptr, .drop_per_mille = 50});
+    stream(injector, run, seconds);
+    injector.printStats();
+    auto &s = injector.stats(Fault::DROP);
+    CHECK(s.injected > 0);
+    CHECK(run.delivered.size() + s.injected == run.sent);
+    // back to back drops are one outage, ended by the next report
+    CHECK(s.recovered > 0 && s.recovered <= s.injected);
+    CHECK(s.min_us == TICK_US);
+  }
+  {
+    printf("delay 50/1000 by 50 ms:\n");
+    Run run;
+    auto injector = makeInjector(run, {.deliver = nullptr, .delay_per_mille = 50, .delay_ms = 50});
+    stream(injector, run, seconds);
+    injector.printStats();
+    auto &s = injector.stats(Fault::DELAY);
+    CHECK(s.injected > 0);
+    CHECK(run.delivered.size() == run.sent);
+    CHECK(s.recovered == s.injected);
+    // released by the first poll at or after the delay
+    CHECK(s.min_us >= 50000 && s.max_us < 50000 + TICK_US);
+  }
+  {
+    printf("reorder 50/1000:\n");
+    Run run;
+    auto injector = makeInjector(run, {.deliver = nullptr, .reorder_per_mille = 50});
+    stream(injector, run, seconds);
+    injector.printStats();
+    auto &s = injector.stats(Fault::REORDER);
+    CHECK(s.injected > 0);
+    CHECK(run.delivered.size() == run.sent);
+    CHECK(s.recovered == s.injected);
+    // the held report goes out right after the next one, a tick later
+    CHECK(s.min_us == TICK_US && s.max_us == TICK_US);
+    size_t swapped = 0;
+    for (size_t i = 1; i < run.delivered.size(); i++) {
+      if (run.delivered[i] < run.delivered[i - 1]) {
+        swapped++;
+        CHECK(run.delivered[i] + 1 == run.delivered[i - 1]);
+      }
+    }
+    CHECK(swapped == s.injected);
+  }
+  {
+    printf("duplicate 50/1000:\n");
+    Run run;
+    auto injector = makeInjector(run, {.deliver = nullptr, .duplicate_per_mille = 50});
+    stream(injector, run, seconds);
+    injector.printStats();
+    auto &s = injector.stats(Fault::DUPLICATE);
+    CHECK(s.injected > 0);
+    CHECK(run.delivered.size() == run.sent + s.injected);
+    CHECK(s.recovered > 0);
+    CHECK(s.max_us == 0);
+  }
+  {
+    printf("connect fail 500/1000, a connect attempt every 100 ms:\n");
+    Run run;
+    auto injector = makeInjector(run, {.deliver = nullptr, .connect_fail_per_mille = 500});
+    uint32_t connected = 0, sent = 0;
+    while (connected < 100) {
+      host_stub::time_us += 100 * TICK_US;
+      if (injector.shouldFailConnect()) continue;
+      connected++;
+      injector.onNotification(1, 2, (const uint8_t *)&sent, sizeof(sent));
+      sent++;
+    }
+    injector.printStats();
+    auto &s = injector.stats(Fault::CONNECT_FAIL);
+    CHECK(s.injected > 0);
+    CHECK(s.recovered > 0 && s.min_us >= 100 * TICK_US);
+  }
+  // a bring-up: connect in 100 ms, discover in 200 ms, subscribe in 50 ms,
+  // then the first report; a disconnect at any phase starts it over
+  using Phase = FaultInjector::Phase;
+  struct PhaseRun {
+    const char *name;
+    Phase phase;
+    Fault fault;
+    FaultInjector::Config config;
+  };
+  for (auto &p : {
+         PhaseRun{"after connect", Phase::AFTER_CONNECT, Fault::DISCONNECT_AFTER_CONNECT,
+                  {.deliver = nullptr, .disconnect_after_connect_per_mille = 500}},
+         PhaseRun{"during discovery", Phase::DURING_DISCOVERY, Fault::DISCONNECT_DURING_DISCOVERY,
+                  {.deliver = nullptr, .disconnect_during_discovery_per_mille = 500}},
+         PhaseRun{"after subscribe", Phase::AFTER_SUBSCRIBE, Fault::DISCONNECT_AFTER_SUBSCRIBE,
+                  {.deliver = nullptr, .disconnect_after_subscribe_per_mille = 500}},
+       }) {
+    printf("disconnect %s 500/1000:\n", p.name);
+    Run run;
+    auto injector = makeInjector(run, p.config);
+    uint32_t connected = 0, sent = 0;
+    uint32_t dropped_at[3] = {};
+    while (connected < 100) {
+      host_stub::time_us += 100 * TICK_US;
+      if (injector.shouldDisconnect(Phase::AFTER_CONNECT)) {
+        dropped_at[(size_t)Phase::AFTER_CONNECT]++;
+        continue;
+      }
+      host_stub::time_us += 200 * TICK_US;
+      if (injector.shouldDisconnect(Phase::DURING_DISCOVERY)) {
+        dropped_at[(size_t)Phase::DURING_DISCOVERY]++;
+        continue;
+      }
+      host_stub::time_us += 50 * TICK_US;
+      if (injector.shouldDisconnect(Phase::AFTER_SUBSCRIBE)) {
+        dropped_at[(size_t)Phase::AFTER_SUBSCRIBE]++;
+        continue;
+      }
+      connected++;
+      injector.onNotification(1, 2, (const uint8_t *)&sent, sizeof(sent));
+      sent++;
+    }
+    injector.printStats();
+    auto &s = injector.stats(p.fault);
+    CHECK(s.injected > 0 && s.injected == dropped_at[(size_t)p.phase]);
+    // only the configured phase drops the link
+    CHECK(dropped_at[0] + dropped_at[1] + dropped_at[2] == s.injected);
+    // back to back drops are one outage; the next report ends it, a whole
+    // bring-up after the last drop
+    CHECK(s.recovered > 0 && s.recovered <= s.injected);
+    CHECK(s.min_us >= 350 * TICK_US);
+  }
+  return host_test::result();
+}
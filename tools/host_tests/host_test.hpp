@@ -0,0 +1,22 @@
+#pragma once
+
+/** The little the host tests share: CHECK() counts failures instead of
+ *  stopping, and result() prints OK / FAILED and gives the exit code. */
+#include <cstdio>
+
+namespace host_test {
+inline int failures = 0;
+
+inline int result() {
+  printf("%s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
+} // namespace host_test
+
+#define CHECK(cond)                                                                                \
+  do {                                                                                             \
+    if (!(cond)) {                                                                                 \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);                     \
+      host_test::failures++;                                                                       \
+    }                                                                                              \
+  } while (0)
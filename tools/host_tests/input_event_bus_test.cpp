@@ -0,0 +1,109 @@
+/** InputEventBus with the publisher overwriting what subscribers read.
+ *  Every published state has all its fields set from one counter, so a
+ *  state that mixes two events shows; none may reach a subscriber, and
+ *  what does arrive must be in order and add up with the drops to what was
+ *  published.
+ *
+ *  First deterministically, with a sink that publishes a ring's worth of
+ *  events while it holds the state it was given; then with a publisher
+ *  thread and subscribers polling as fast as they can (one a few events at
+ *  a time, to get lapped), which takes more than one core to race.
+ *
+ *    input_event_bus_test [events]
+ */
+#include <atomic>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "host_test.hpp"
+#include "input_event_bus.hpp"
+
+using Bus = InputEventBus<16>;
+
+static void fill(InputState &state, uint32_t n) {
+  state.sequence = n;
+  state.timestamp_us = n;
+  state.buttons = n;
+  for (auto &a : state.axes) a = (int16_t)n;
+  for (auto &k : state.keys) k = n;
+}
+
+static bool consistent(const InputState &state) {
+  uint32_t n = state.sequence;
+  if (state.timestamp_us != n || state.buttons != n) return false;
+  for (auto a : state.axes) {
+    if (a != (int16_t)n) return false;
+  }
+  for (auto k : state.keys) {
+    if (k != n) return false;
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  uint32_t events = argc >= 2 ? atoi(argv[1]) : 2000000;
+  Bus bus;
+  {
+    Bus overwritten;
+    Bus::Subscriber sub(overwritten, "sink");
+    InputState state;
+    fill(state, 0);
+    overwritten.publish(state);
+    bool changed = false;
+    sub.poll([&](const InputState &s) {
+      uint32_t n = s.sequence;
+      for (uint32_t i = 1; i <= 16; i++) {
+        overwritten.publish(state, [i](InputState &next) { fill(next, 100 + i); });
+      }
+      changed = s.sequence != n || !consistent(s);
+    });
+    CHECK(!changed);
+    CHECK(sub.delivered() == 1);
+  }
+
+  std::atomic<bool> done{false};
+  std::atomic<uint32_t> torn{0}, out_of_order{0};
+
+  auto reader = [&](const char *name, bool slow, std::atomic<uint64_t> &total) {
+    Bus::Subscriber sub(bus, name);
+    int64_t last = -1;
+    auto check = [&](const InputState &state) {
+      if (!consistent(state)) torn++;
+      if ((int64_t)state.sequence <= last) out_of_order++;
+      last = state.sequence;
+    };
+    while (!done) {
+      sub.poll(check, slow ? 4 : 16);
+    }
+    sub.poll(check);
+    sub.printStats();
+    total = sub.delivered() + sub.dropped();
+  };
+
+  std::atomic<uint64_t> fast_total{0}, slow_total{0};
+  std::thread fast([&] { reader("fast", false, fast_total); });
+  std::thread slow([&] { reader("slow", true, slow_total); });
+  // let the subscribers take their cursors at the start
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  InputState state;
+  for (uint32_t n = 0; n < events; n++) {
+    bus.publish(state, [n](InputState &s) { fill(s, n); });
+    // about the pace at which the subscribers keep up, so they are often
+    // reading the slot being written
+    for (int spin = 0; spin < 50; spin++) {
+      asm volatile("");
+    }
+  }
+  done = true;
+  fast.join();
+  slow.join();
+
+  printf("published %lu, torn %lu, out of order %lu\n", (unsigned long)bus.published(),
+         (unsigned long)torn.load(), (unsigned long)out_of_order.load());
+  CHECK(torn == 0);
+  CHECK(out_of_order == 0);
+  CHECK(fast_total == bus.published());
+  CHECK(slow_total == bus.published());
+  return host_test::result();
+}
@@ -0,0 +1,167 @@
+/** CompiledRemap against a bit by bit reference: random button
+ *  permutations (with dropped buttons) through the nibble tables, axis
+ *  inversion over every value, axis swaps, turbo phases and toggle latches,
+ *  report by report. Then the cost of apply() for reports with 8, 16 and
+ *  32 buttons, under the identity and under a profile using everything;
+ *  it should not depend on either.
+ *
+ *    input_remapper_test [reports]
+ */
+#include <chrono>
+#include <cstdlib>
+
+#include "host_test.hpp"
+#include "input_remapper.hpp"
+
+/** Where each source button ends up, one at a time. */
+static uint32_t referenceButtons(const RemapProfile &profile, uint32_t buttons) {
+  uint32_t out = 0;
+  for (size_t src = 0; src < 32; src++) {
+    if (!(buttons >> src & 1)) continue;
+    uint8_t dst = profile.identity_buttons ? src : profile.buttons[src];
+    if (dst < 32) out |= 1u << dst;
+  }
+  return out;
+}
+
+int main(int argc, char **argv) {
+  uint32_t reports = argc >= 2 ? atoi(argv[1]) : 2000000;
+  uint32_t seed = 1;
+  auto next = [&seed] {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+  };
+
+  {
+    // random permutations, some buttons dropped, random button states
+    size_t mismatches = 0;
+    for (int p = 0; p < 1000; p++) {
+      RemapProfile profile{"random", nullptr};
+      profile.identity_buttons = false;
+      for (size_t i = 0; i < 32; i++) profile.buttons[i] = i;
+      for (size_t i = 31; i > 0; i--) std::swap(profile.buttons[i], profile.buttons[next() % (i + 1)]);
+      for (auto &b : profile.buttons) {
+        if (next() % 8 == 0) b = RemapProfile::DROP;
+      }
+      CompiledRemap remap;
+      remap.compile(profile);
+      for (int r = 0; r < 100; r++) {
+        InputState state;
+        state.buttons = next();
+        uint32_t expected = referenceButtons(profile, state.buttons);
+        remap.apply(state);
+        mismatches += state.buttons != expected;
+      }
+    }
+    CHECK(mismatches == 0);
+    // and the default is the identity
+    CompiledRemap identity;
+    InputState state;
+    state.buttons = 0xDEADBEEF;
+    state.axes[InputState::X] = -32768;
+    identity.apply(state);
+    CHECK(state.buttons == 0xDEADBEEF && state.axes[InputState::X] == -32768);
+  }
+  {
+    // inversion is ~x: the full range maps onto itself, -32768 to 32767
+    RemapProfile profile{"invert", nullptr};
+    profile.invert_axes = 1 << InputState::Y;
+    CompiledRemap remap;
+    remap.compile(profile);
+    size_t mismatches = 0;
+    for (int32_t value = INT16_MIN; value <= INT16_MAX; value++) {
+      InputState state;
+      state.axes[InputState::X] = value;
+      state.axes[InputState::Y] = value;
+      remap.apply(state);
+      mismatches += state.axes[InputState::X] != value || state.axes[InputState::Y] != -value - 1;
+    }
+    CHECK(mismatches == 0);
+  }
+  {
+    // swap X and Y, invert the new Y; a source out of range keeps its axis
+    RemapProfile profile{"swap", nullptr};
+    profile.axes[InputState::X] = InputState::Y;
+    profile.axes[InputState::Y] = InputState::X;
+    profile.axes[InputState::Z] = 0xFF;
+    profile.invert_axes = 1 << InputState::Y;
+    CompiledRemap remap;
+    remap.compile(profile);
+    InputState state;
+    for (size_t i = 0; i < InputState::NUM_AXES; i++) state.axes[i] = 100 * (i + 1);
+    remap.apply(state);
+    CHECK(state.axes[InputState::X] == 200 && state.axes[InputState::Y] == ~100);
+    CHECK(state.axes[InputState::Z] == 300 && state.axes[InputState::BRAKE] == 1000);
+  }
+  {
+    // turbo on button 0 held down, toggle on button 1 pressed now and then,
+    // button 2 plain, all after moving source 3 onto button 1
+    RemapProfile profile{"turbo-toggle", nullptr};
+    profile.identity_buttons = false;
+    for (size_t i = 0; i < 32; i++) profile.buttons[i] = i;
+    profile.buttons[1] = RemapProfile::DROP;
+    profile.buttons[3] = 1;
+    profile.turbo = 1 << 0;
+    profile.turbo_shift = 2;
+    profile.toggle = 1 << 1;
+    CompiledRemap remap;
+    remap.compile(profile);
+    bool latched = false, was_pressed = false;
+    size_t mismatches = 0, toggles = 0;
+    for (uint32_t r = 0; r < 1000; r++) {
+      bool pressed = r % 10 < 3; // 3 reports down, 7 up
+      InputState state;
+      state.buttons = 1 << 0 | 1 << 2 | (pressed ? 1 << 3 : 0) | 1 << 1;
+      if (pressed && !was_pressed) {
+        latched = !latched;
+        toggles++;
+      }
+      was_pressed = pressed;
+      // four reports on, four off
+      bool turbo_on = (r >> 2) % 2 == 0;
+      uint32_t expected = (turbo_on ? 1 << 0 : 0) | (latched ? 1 << 1 : 0) | 1 << 2;
+      remap.apply(state);
+      mismatches += state.buttons != expected;
+    }
+    CHECK(mismatches == 0);
+    CHECK(toggles == 100);
+    // a reconnect starts unlatched, and turbo on
+    remap.reset();
+    InputState state;
+    state.buttons = 1 << 0;
+    remap.apply(state);
+    CHECK(state.buttons == 1 << 0);
+  }
+  {
+    RemapProfile everything{"everything", nullptr};
+    everything.identity_buttons = false;
+    for (size_t i = 0; i < 32; i++) everything.buttons[i] = 31 - i;
+    for (size_t i = 0; i < InputState::NUM_AXES; i++) everything.axes[i] = InputState::NUM_AXES - 1 - i;
+    everything.invert_axes = 0x155;
+    everything.turbo = 0x0000000F;
+    everything.toggle = 0x000000F0;
+    RemapProfile identity{"identity", nullptr};
+    for (auto profile : {&identity, &everything}) {
+      CompiledRemap remap;
+      remap.compile(*profile);
+      printf("%-10s", profile->name);
+      for (size_t num_buttons : {8, 16, 32}) {
+        uint32_t mask = num_buttons == 32 ? ~0u : (1u << num_buttons) - 1;
+        InputState state;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < reports; i++) {
+          state.buttons = (i * 2654435761u) & mask;
+          state.axes[i % InputState::NUM_AXES] = i;
+          remap.apply(state);
+          asm volatile("" : : "r"(&state) : "memory");
+        }
+        auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        printf("  %2lu buttons %.1f ns", (unsigned long)num_buttons, ns / reports);
+      }
+      printf(" per report\n");
+    }
+  }
+  return host_test::result();
+}
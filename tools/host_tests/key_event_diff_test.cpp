@@ -0,0 +1,142 @@
+/** KeyEventDiff against a key by key reference diff, on random bitmaps and
+ *  on boot and NKRO keyboard reports decoded the way the firmware decodes
+ *  them; then the worst case throughput, full rollover of all 256 keys on
+ *  every report.
+ *
+ *    key_event_diff_test [reports]
+ */
+#include <chrono>
+#include <cstdlib>
+#include <vector>
+
+#include "hid_report_map.hpp"
+#include "host_test.hpp"
+#include "key_event_diff.hpp"
+
+using Bitmap = KeyEventDiff::Bitmap;
+
+static bool isDown(const Bitmap &keys, size_t usage) { return (keys[usage >> 6] >> (usage & 63)) & 1; }
+
+/** Ups then downs, each in usage order, by looking at every key. */
+static std::vector<std::pair<uint8_t, bool>> referenceDiff(const Bitmap &prev, const Bitmap &keys) {
+  std::vector<std::pair<uint8_t, bool>> events;
+  for (size_t usage = 0; usage < 256; usage++) {
+    if (isDown(prev, usage) && !isDown(keys, usage)) events.push_back({usage, false});
+  }
+  for (size_t usage = 0; usage < 256; usage++) {
+    if (!isDown(prev, usage) && isDown(keys, usage)) events.push_back({usage, true});
+  }
+  return events;
+}
+
+/** Diffs keys and checks the events against the reference. */
+static size_t checkUpdate(KeyEventDiff &diff, const Bitmap &keys) {
+  static KeyEvent events[KeyEventDiff::MAX_EVENTS];
+  auto expected = referenceDiff(diff.keys(), keys);
+  size_t n = diff.update(keys, events);
+  bool same = n == expected.size();
+  for (size_t i = 0; same && i < n; i++) {
+    same = events[i].usage == expected[i].first && events[i].down == expected[i].second;
+  }
+  CHECK(same);
+  CHECK(diff.keys() == keys);
+  return n;
+}
+
+static Bitmap bootKeys(uint8_t modifiers, std::initializer_list<uint8_t> keys) {
+  uint8_t report[8] = {modifiers};
+  size_t i = 2;
+  for (auto k : keys) report[i++] = k;
+  InputState state;
+  HidReportMap::decodeBootKeyboard(report, sizeof(report), state);
+  return state.keys;
+}
+
+int main(int argc, char **argv) {
+  uint32_t reports = argc >= 2 ? atoi(argv[1]) : 1000000;
+
+  {
+    // random bitmaps, from a few keys changing to most of them
+    KeyEventDiff diff;
+    uint64_t seed = 1;
+    auto next = [&seed] {
+      seed ^= seed << 13;
+      seed ^= seed >> 7;
+      seed ^= seed << 17;
+      return seed;
+    };
+    Bitmap keys{};
+    size_t events = 0;
+    for (int i = 0; i < 20000; i++) {
+      // flip a sparse or a dense set of keys
+      for (auto &word : keys) word ^= i % 4 ? next() & next() & next() : next();
+      events += checkUpdate(diff, keys);
+    }
+    printf("random bitmaps: %lu events checked\n", (unsigned long)events);
+  }
+  {
+    // boot protocol: A, then A + B with left shift, then B alone, then none
+    KeyEventDiff diff;
+    KeyEvent events[KeyEventDiff::MAX_EVENTS];
+    CHECK(diff.update(bootKeys(0, {0x04}), events) == 1 && events[0].usage == 0x04 && events[0].down);
+    size_t n = diff.update(bootKeys(0x02, {0x04, 0x05}), events);
+    CHECK(n == 2 && events[0].usage == 0x05 && events[0].down && events[1].usage == 0xE1 && events[1].down);
+    n = diff.update(bootKeys(0x00, {0x05}), events);
+    CHECK(n == 2 && events[0].usage == 0x04 && !events[0].down && events[1].usage == 0xE1 && !events[1].down);
+    n = diff.update(bootKeys(0, {}), events);
+    CHECK(n == 1 && events[0].usage == 0x05 && !events[0].down);
+    // rollover error (0x01) reports no keys
+    CHECK(diff.update(bootKeys(0, {0x01, 0x01, 0x01, 0x01, 0x01, 0x01}), events) == 0);
+  }
+  {
+    // NKRO: modifiers and a 0x00 - 0x7F key bitmap, as report 1
+    static constexpr uint8_t MAP[] = {
+      0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x85, 0x01, // Keyboard, report 1
+      0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+      0x19, 0x00, 0x29, 0x7F, 0x75, 0x01, 0x95, 0x80, 0x81, 0x02,
+      0xC0,
+    };
+    HidReportMap map;
+    CHECK(map.parse(MAP, sizeof(MAP)));
+    KeyEventDiff diff;
+    uint64_t seed = 7;
+    size_t events = 0;
+    for (int i = 0; i < 2000; i++) {
+      uint8_t report[17];
+      for (auto &b : report) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        b = seed >> 56;
+      }
+      InputState state;
+      map.decode(1, report, sizeof(report), state);
+      // what the report says, bit by bit; usages 1 - 3 are error codes
+      Bitmap expected{};
+      for (size_t bit = 0; bit < 8; bit++) {
+        if (report[0] >> bit & 1) expected[(0xE0 + bit) >> 6] |= 1ull << ((0xE0 + bit) & 63);
+      }
+      for (size_t usage = 4; usage < 128; usage++) {
+        if (report[1 + usage / 8] >> (usage % 8) & 1) expected[usage >> 6] |= 1ull << (usage & 63);
+      }
+      CHECK(state.keys == expected);
+      events += checkUpdate(diff, state.keys);
+    }
+    printf("NKRO reports: %lu events checked\n", (unsigned long)events);
+  }
+  {
+    KeyEventDiff diff;
+    static KeyEvent events[KeyEventDiff::MAX_EVENTS];
+    static constexpr Bitmap ALL_DOWN = {~0ull, ~0ull, ~0ull, ~0ull};
+    static constexpr Bitmap ALL_UP = {};
+    size_t num_events = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < reports; i++) {
+      num_events += diff.update(i & 1 ? ALL_UP : ALL_DOWN, events);
+      asm volatile("" : : "r"(events) : "memory");
+    }
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("full rollover: %lu events, %.1f ns per report, %.0f M events/s\n", (unsigned long)num_events,
+           s * 1e9 / reports, num_events / s / 1e6);
+    CHECK(num_events == (size_t)reports * 256);
+  }
+  return host_test::result();
+}
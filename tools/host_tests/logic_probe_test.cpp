@@ -0,0 +1,134 @@
+/** LogicProbe on MockProbePins: every ID mode code must decode back to the
+ *  device, stage and report ID it was encoded from, and nothing but an ID
+ *  train may decode. mark() must send a single pulse in PULSE mode and an
+ *  ID train in ID mode, on the stage's own pin, and skip (and count) marks
+ *  while the pin is busy. Then two threads mark their own stages at once,
+ *  as the BLE host and the pipeline do, and no mark may go uncounted.
+ *
+ *    logic_probe_test [marks]
+ */
+#include <cstdlib>
+#include <thread>
+
+#include "host_test.hpp"
+#include "logic_probe.hpp"
+#include "mock_probe_pin.hpp"
+
+using Stage = LogicProbe::Stage;
+using Pulse = ProbePin::Pulse;
+
+static bool same(const Pulse &a, const Pulse &b) { return a.high == b.high && a.low == b.low; }
+
+/** How long a train keeps the pin, in us. */
+static double trainUs(const std::vector<Pulse> &pulses) {
+  uint32_t ticks = 0;
+  for (auto &p : pulses) ticks += p.high + p.low;
+  return ticks * 1e6 / LogicProbe::TICK_HZ;
+}
+
+int main(int argc, char **argv) {
+  uint32_t marks = argc >= 2 ? atoi(argv[1]) : 200000;
+
+  {
+    // every code there is, through encode() and back
+    Pulse pulses[LogicProbe::MAX_PULSES];
+    size_t mismatches = 0;
+    for (uint8_t device = 0; device < 32; device++) {
+      for (uint8_t stage = 0; stage < (uint8_t)Stage::COUNT; stage++) {
+        for (uint16_t report_id = 0; report_id < 256; report_id++) {
+          LogicProbe::Code code{device, (Stage)stage, (uint8_t)report_id}, decoded{};
+          size_t count = LogicProbe::encode(LogicProbe::Mode::ID, code, pulses);
+          bool ok = count == LogicProbe::MAX_PULSES && LogicProbe::decode(pulses, count, decoded);
+          mismatches += !ok || decoded.device != device || decoded.stage != (Stage)stage ||
+                        decoded.report_id != report_id;
+        }
+      }
+    }
+    CHECK(mismatches == 0);
+    // a PULSE mark, a cut off train or a second start pulse are not codes
+    LogicProbe::Code decoded;
+    size_t count = LogicProbe::encode(LogicProbe::Mode::PULSE, {1, Stage::RECEIVED, 1}, pulses);
+    CHECK(count == 1 && same(pulses[0], LogicProbe::MARK));
+    CHECK(!LogicProbe::decode(pulses, count, decoded));
+    count = LogicProbe::encode(LogicProbe::Mode::ID, {1, Stage::RECEIVED, 1}, pulses);
+    CHECK(!LogicProbe::decode(pulses, count - 1, decoded));
+    pulses[5] = LogicProbe::START;
+    CHECK(!LogicProbe::decode(pulses, count, decoded));
+  }
+  {
+    // PULSE mode: one short pulse on the stage's pin, the others idle
+    MockProbePin received, published;
+    LogicProbe probe(LogicProbe::Mode::PULSE);
+    probe.attach(Stage::RECEIVED, &received);
+    probe.attach(Stage::PUBLISHED, &published);
+    probe.mark(Stage::RECEIVED, 3, 7);
+    probe.mark(Stage::FORWARDED, 3, 7); // no pin: nothing, and not counted
+    CHECK(received.transmissions().size() == 1 && published.transmissions().empty());
+    auto &pulses = received.transmissions()[0].pulses;
+    CHECK(pulses.size() == 1 && same(pulses[0], LogicProbe::MARK));
+    CHECK(probe.marks() == 1 && probe.busy() == 0);
+    printf("pulse mark: %.1f us\n", trainUs(pulses));
+  }
+  {
+    // ID mode: the train says which device, stage and report it was; the
+    // device is cut to 5 bits
+    MockProbePin published;
+    LogicProbe probe(LogicProbe::Mode::ID);
+    probe.attach(Stage::PUBLISHED, &published);
+    probe.mark(Stage::PUBLISHED, 2, 0x42);
+    probe.mark(Stage::PUBLISHED, 33, 0xFF);
+    CHECK(published.transmissions().size() == 2);
+    LogicProbe::Code code{};
+    auto &first = published.transmissions()[0].pulses;
+    CHECK(LogicProbe::decode(first.data(), first.size(), code));
+    CHECK(code.device == 2 && code.stage == Stage::PUBLISHED && code.report_id == 0x42);
+    auto &second = published.transmissions()[1].pulses;
+    CHECK(LogicProbe::decode(second.data(), second.size(), code));
+    CHECK(code.device == 1 && code.stage == Stage::PUBLISHED && code.report_id == 0xFF);
+    printf("id mark: %.1f us\n", trainUs(first));
+  }
+  {
+    // a busy pin skips the mark instead of waiting, and counts it
+    MockProbePin received;
+    LogicProbe probe(LogicProbe::Mode::ID);
+    probe.attach(Stage::RECEIVED, &received);
+    probe.mark(Stage::RECEIVED, 1, 1);
+    received.setBusy(true);
+    probe.mark(Stage::RECEIVED, 1, 2);
+    probe.mark(Stage::RECEIVED, 1, 3);
+    received.setBusy(false);
+    probe.mark(Stage::RECEIVED, 1, 4);
+    CHECK(probe.marks() == 2 && probe.busy() == 2);
+    LogicProbe::Code code{};
+    auto &last = received.transmissions().back().pulses;
+    CHECK(received.transmissions().size() == 2);
+    CHECK(LogicProbe::decode(last.data(), last.size(), code) && code.report_id == 4);
+  }
+  {
+    // two tasks marking their own stages at once; the counts are shared
+    MockProbePin received, published;
+    LogicProbe probe(LogicProbe::Mode::PULSE);
+    probe.attach(Stage::RECEIVED, &received);
+    probe.attach(Stage::PUBLISHED, &published);
+    auto marker = [&](Stage stage, MockProbePin &pin) {
+      for (uint32_t i = 0; i < marks; i++) {
+        // every fourth one finds its pin busy
+        pin.setBusy(i % 4 == 3);
+        probe.mark(stage, 1, i);
+        if (i % 64 == 0) {
+          pin.clear();
+          std::this_thread::yield();
+        }
+      }
+    };
+    std::thread host(marker, Stage::RECEIVED, std::ref(received));
+    std::thread pipeline(marker, Stage::PUBLISHED, std::ref(published));
+    host.join();
+    pipeline.join();
+    printf("concurrent: %lu marks, %lu skipped while busy\n", (unsigned long)probe.marks(),
+           (unsigned long)probe.busy());
+    CHECK(probe.marks() + probe.busy() == 2 * marks);
+    CHECK(probe.busy() == 2 * (marks / 4));
+  }
+  return host_test::result();
+}
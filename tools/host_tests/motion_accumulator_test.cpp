@@ -0,0 +1,129 @@
+/** MotionAccumulator: the sub-count carry, the per-drain cap and
+ *  saturation, step by step; then a producer thread adding random motion
+ *  while the consumer drains at most a boot mouse report's worth at a time,
+ *  and no motion may be lost or counted twice. Then the cost of an add.
+ *
+ *    motion_accumulator_test [reports]
+ */
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+#include "host_test.hpp"
+#include "motion_accumulator.hpp"
+
+using Motion = std::array<int16_t, InputState::NUM_MOTION>;
+static constexpr int32_t ONE = MotionAccumulator::ONE;
+
+static Motion motion(int16_t dx, int16_t dy = 0, int16_t wheel = 0) {
+  Motion m{};
+  m[InputState::DX] = dx;
+  m[InputState::DY] = dy;
+  m[InputState::WHEEL] = wheel;
+  return m;
+}
+
+/** Whole counts of sent scaled, rounded down as the accumulator does. */
+static int64_t floorCounts(int64_t sent, int32_t scale_q8) {
+  int64_t scaled = sent * scale_q8;
+  return scaled >= 0 ? scaled / ONE : -((-scaled + ONE - 1) / ONE);
+}
+
+int main(int argc, char **argv) {
+  uint32_t reports = argc >= 2 ? atoi(argv[1]) : 2000000;
+
+  {
+    // 1.5 counts per count: the half count carries into the next drain
+    MotionAccumulator accumulator;
+    accumulator.setScale(ONE * 3 / 2);
+    accumulator.add(motion(1));
+    CHECK(accumulator.drain()[InputState::DX] == 1);
+    accumulator.add(motion(1));
+    CHECK(accumulator.drain()[InputState::DX] == 2);
+    // negative motion rounds down too, and the carry makes it up
+    accumulator.add(motion(-1));
+    CHECK(accumulator.drain()[InputState::DX] == -2);
+    CHECK(accumulator.drain()[InputState::DX] == 0);
+    accumulator.add(motion(-1));
+    CHECK(accumulator.drain()[InputState::DX] == -1);
+    CHECK(accumulator.pending(InputState::DX) == 0);
+  }
+  {
+    // what a drain cannot take waits for the next one, per axis
+    MotionAccumulator accumulator;
+    accumulator.add(motion(300, -200, 1));
+    auto m = accumulator.drain(127);
+    CHECK(m[InputState::DX] == 127 && m[InputState::DY] == -127 && m[InputState::WHEEL] == 1);
+    m = accumulator.drain(127);
+    CHECK(m[InputState::DX] == 127 && m[InputState::DY] == -73 && m[InputState::WHEEL] == 0);
+    m = accumulator.drain(127);
+    CHECK(m[InputState::DX] == 46 && m[InputState::DY] == 0);
+  }
+  {
+    // nobody draining: it stops at the limit instead of wrapping
+    MotionAccumulator accumulator;
+    accumulator.setScale(ONE * 64);
+    for (int i = 0; i < 1000; i++) accumulator.add(motion(INT16_MAX, INT16_MIN));
+    CHECK(accumulator.pending(InputState::DX) == MotionAccumulator::LIMIT / ONE);
+    CHECK(accumulator.pending(InputState::DY) == -MotionAccumulator::LIMIT / ONE - 1);
+    accumulator.add(motion(-1));
+    CHECK(accumulator.pending(InputState::DX) < MotionAccumulator::LIMIT / ONE);
+  }
+  {
+    // a producer against a consumer draining whenever it gets a turn
+    static constexpr int32_t SCALE = ONE * 3 / 2;
+    MotionAccumulator accumulator;
+    accumulator.setScale(SCALE);
+    std::atomic<bool> producing{true};
+    int64_t sent[InputState::NUM_MOTION] = {};
+    int64_t received[InputState::NUM_MOTION] = {};
+    uint32_t drains = 0;
+    std::thread producer([&] {
+      uint32_t seed = 1;
+      for (uint32_t i = 0; i < reports; i++) {
+        Motion m;
+        for (size_t a = 0; a < InputState::NUM_MOTION; a++) {
+          seed = seed * 1664525u + 1013904223u;
+          m[a] = (int16_t)(seed >> 16) >> 6; // +-512 counts
+          sent[a] += m[a];
+        }
+        accumulator.add(m);
+        // give the consumer a turn on a single core too
+        if (i % 64 == 0) std::this_thread::yield();
+      }
+      producing = false;
+    });
+    auto drainInto = [&] {
+      auto m = accumulator.drain(127);
+      for (size_t a = 0; a < InputState::NUM_MOTION; a++) received[a] += m[a];
+      drains++;
+    };
+    while (producing) {
+      drainInto();
+      std::this_thread::yield();
+    }
+    producer.join();
+    // empty it; what is left after that is the sub-count carry
+    for (bool pending = true; pending;) {
+      drainInto();
+      pending = false;
+      for (size_t a = 0; a < InputState::NUM_MOTION; a++) pending |= accumulator.pending(a) != 0;
+    }
+    printf("concurrent: %lu reports, %lu drains\n", (unsigned long)reports, (unsigned long)drains);
+    for (size_t a = 0; a < InputState::NUM_MOTION; a++) {
+      printf("  axis %d: sent %lld, received %lld\n", (int)a, (long long)sent[a], (long long)received[a]);
+      CHECK(received[a] == floorCounts(sent[a], SCALE));
+    }
+  }
+  {
+    MotionAccumulator accumulator;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < reports; i++) {
+      accumulator.add(motion(i & 0xFF, -(int16_t)(i & 0x7F), i & 1));
+      if ((i & 0xF) == 0) accumulator.drain(127);
+    }
+    auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    printf("%.1f ns per add (a drain every 16 included)\n", ns / reports);
+  }
+  return host_test::result();
+}
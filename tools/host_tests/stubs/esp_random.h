@@ -0,0 +1,16 @@
+#pragma once
+
+/** Host stand-in for esp_random: a seedable xorshift, so runs repeat. */
+#include <cstdint>
+
+namespace host_stub {
+inline uint32_t random_state = 2463534242u;
+} // namespace host_stub
+
+static inline uint32_t esp_random() {
+  auto &x = host_stub::random_state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return x;
+}
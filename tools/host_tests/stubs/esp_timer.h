@@ -0,0 +1,11 @@
+#pragma once
+
+/** Host stand-in for esp_timer: a clock the tests set and advance. */
+#include <atomic>
+#include <cstdint>
+
+namespace host_stub {
+inline std::atomic<int64_t> time_us{0};
+} // namespace host_stub
+
+static inline int64_t esp_timer_get_time() { return host_stub::time_us.load(std::memory_order_relaxed); }
@@ -0,0 +1,10 @@
+#pragma once
+
+/** Host stand-in for FreeRTOS.h: only the types and constants that the
+ *  headers under test name outside their CONFIG_ blocks. */
+#include <cstdint>
+
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+
+#define portNUM_PROCESSORS 2
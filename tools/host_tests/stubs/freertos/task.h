@@ -0,0 +1,12 @@
+#pragma once
+
+/** Host stand-in for FreeRTOS task.h: the types only. */
+#include "freertos/FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+
+typedef struct {
+  TaskHandle_t xHandle;
+  const char *pcTaskName;
+  uint32_t ulRunTimeCounter;
+} TaskStatus_t;
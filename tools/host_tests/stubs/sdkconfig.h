@@ -0,0 +1,4 @@
+#pragma once
+
+/** Host stand-in for the generated sdkconfig.h: no options are set, so
+ *  what the headers put under #if CONFIG_... is left out. */
@@ -0,0 +1,145 @@
+/** UsbPassthrough against FakeUsbHidEndpoint: the newest report of each
+ *  report ID wins while the endpoint is busy, reports reach the USB host in
+ *  the order they were received, and none is left behind when the
+ *  endpoint completes concurrently with forwarding. Then the forwarding
+ *  overhead with an endpoint that is always free.
+ *
+ *    usb_passthrough_test [reports]
+ */
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include "fake_usb_hid_endpoint.hpp"
+#include "host_test.hpp"
+#include "usb_passthrough.hpp"
+
+static constexpr uint16_t CONN = 1;
+static constexpr uint8_t MAP[] = {0x05, 0x01, 0x09, 0x05, 0xA1, 0x01, 0xC0};
+
+class TestPassthrough : public UsbPassthrough {
+public:
+  using UsbPassthrough::UsbPassthrough;
+  Stats stats() {
+    std::lock_guard<std::mutex> lk(mutex_);
+    return stats_;
+  }
+};
+
+static void forward(UsbPassthrough &passthrough, uint8_t report_id, uint32_t sequence, uint16_t conn = CONN) {
+  passthrough.forwardRaw(conn, report_id, (const uint8_t *)&sequence, sizeof(sequence), sequence,
+                         esp_timer_get_time());
+}
+
+static uint32_t sequenceOf(const FakeUsbHidEndpoint::Report &report) {
+  uint32_t sequence;
+  memcpy(&sequence, report.data.data(), sizeof(sequence));
+  return sequence;
+}
+
+static bool inOrder(const std::vector<FakeUsbHidEndpoint::Report> &reports) {
+  for (size_t i = 1; i < reports.size(); i++) {
+    if (sequenceOf(reports[i]) <= sequenceOf(reports[i - 1])) return false;
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  uint32_t count = argc >= 2 ? atoi(argv[1]) : 200000;
+
+  {
+    // latest wins per report ID, and the waiting ones go out oldest first
+    FakeUsbHidEndpoint endpoint;
+    TestPassthrough passthrough({.endpoint = &endpoint});
+    endpoint.setCompletion([&] { passthrough.onEndpointFree(); });
+    passthrough.onReportMap(CONN, MAP, sizeof(MAP));
+    CHECK(passthrough.connection() == CONN);
+    forward(passthrough, 1, 1); // sent
+    forward(passthrough, 1, 2); // waits
+    forward(passthrough, 2, 3); // waits
+    forward(passthrough, 1, 4); // replaces 2, so goes out after 3
+    forward(passthrough, 1, 5, 2); // not the forwarded device
+    while (endpoint.complete()) {
+    }
+    auto reports = endpoint.reports();
+    CHECK(reports.size() == 3);
+    CHECK(reports.size() == 3 && sequenceOf(reports[0]) == 1 && sequenceOf(reports[1]) == 3 &&
+          sequenceOf(reports[2]) == 4);
+    CHECK(reports.size() == 3 && reports[1].report_id == 2);
+    CHECK(passthrough.stats().coalesced == 1);
+  }
+  {
+    // the endpoint is free but its completion has not reached the
+    // passthrough yet: a new report must not overtake the waiting one
+    FakeUsbHidEndpoint endpoint;
+    TestPassthrough passthrough({.endpoint = &endpoint});
+    passthrough.onReportMap(CONN, MAP, sizeof(MAP));
+    forward(passthrough, 1, 1);
+    forward(passthrough, 2, 2);
+    endpoint.complete(); // no completion callback
+    forward(passthrough, 1, 3);
+    passthrough.onEndpointFree();
+    endpoint.complete();
+    passthrough.onEndpointFree();
+    auto reports = endpoint.reports();
+    CHECK(reports.size() == 3);
+    CHECK(inOrder(reports));
+    CHECK(passthrough.stats().out_of_order == 0);
+  }
+  {
+    // forwarding against a USB thread that completes as fast as it can
+    FakeUsbHidEndpoint endpoint;
+    TestPassthrough passthrough({.endpoint = &endpoint});
+    endpoint.setCompletion([&] { passthrough.onEndpointFree(); });
+    passthrough.onReportMap(CONN, MAP, sizeof(MAP));
+    std::atomic<bool> done{false};
+    std::thread usb([&] {
+      while (!done) {
+        if (!endpoint.complete()) std::this_thread::yield();
+      }
+    });
+    uint32_t last[3] = {};
+    for (uint32_t sequence = 1; sequence <= count; sequence++) {
+      uint8_t report_id = 1 + sequence % 3;
+      last[report_id - 1] = sequence;
+      forward(passthrough, report_id, sequence);
+      // give the USB thread a turn on a single core too
+      if (sequence % 16 == 0) std::this_thread::yield();
+    }
+    done = true;
+    usb.join();
+    while (endpoint.complete()) {
+    }
+    auto reports = endpoint.reports();
+    auto stats = passthrough.stats();
+    printf("concurrent: %lu reports, %lu sent, %lu coalesced, %lu dropped, %lu out of order\n",
+           (unsigned long)count, (unsigned long)reports.size(), (unsigned long)stats.coalesced,
+           (unsigned long)stats.dropped, (unsigned long)stats.out_of_order);
+    CHECK(inOrder(reports));
+    CHECK(stats.out_of_order == 0);
+    CHECK(stats.dropped == 0);
+    CHECK(stats.forwarded == reports.size());
+    CHECK(stats.forwarded + stats.coalesced == count);
+    // the newest report of every ID got out
+    for (uint8_t id = 1; id <= 3; id++) {
+      bool found = false;
+      for (auto &r : reports) found |= r.report_id == id && sequenceOf(r) == last[id - 1];
+      CHECK(found);
+    }
+  }
+  {
+    FakeUsbHidEndpoint endpoint;
+    TestPassthrough passthrough({.endpoint = &endpoint});
+    passthrough.onReportMap(CONN, MAP, sizeof(MAP));
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t sequence = 1; sequence <= count; sequence++) {
+      forward(passthrough, 1, sequence);
+      endpoint.complete();
+    }
+    auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    printf("forwarding to a free endpoint: %.0f ns per report (fake endpoint included)\n", ns / count);
+    CHECK(passthrough.stats().forwarded == count);
+  }
+  return host_test::result();
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "input_stream_protocol.hpp"
+
+/** Linux side of the binary input stream: a byte-at-a-time frame parser
+ *  that resynchronizes on sync bytes and checks length, CRC and frame
+ *  sequence, plus a helper to open a serial port raw.
+ */
+namespace input_stream {
+
+/** Header fields of a received frame. */
+struct FrameInfo {
+  uint16_t sequence;
+  uint32_t timestamp_us;
+  size_t num_records;
+};
+
+class FrameParser {
+public:
+  /** Called for every record of a good frame; keys is nullptr unless the
+   *  record has HAS_KEYS. */
+  typedef std::function<void(const FrameInfo &frame, const Record &record, const uint8_t *keys)> record_fn;
+
+  struct Stats {
+    uint64_t bytes{0};
+    uint64_t frames{0};
+    uint64_t records{0};
+    uint64_t lost_frames{0};   /**< From gaps in the frame sequence. */
+    uint64_t crc_errors{0};
+    uint64_t bad_frames{0};    /**< Impossible length or truncated record. */
+    uint64_t skipped_bytes{0}; /**< Bytes discarded while looking for sync. */
+  };
+
+  explicit FrameParser(record_fn on_record = nullptr) : on_record_(on_record) {}
+
+  void feed(const uint8_t *data, size_t length) {
+    stats_.bytes += length;
+    while (length) {
+      size_t n = std::min(length, sizeof(buffer_) - fill_);
+      memcpy(buffer_ + fill_, data, n);
+      fill_ += n;
+      data += n;
+      length -= n;
+      parse();
+    }
+  }
+
+  const Stats &stats() const { return stats_; }
+
+protected:
+  void parse() {
+    size_t pos = 0;
+    for (;;) {
+      // find sync
+      while (pos < fill_ && !(buffer_[pos] == SYNC[0] && (pos + 1 == fill_ || buffer_[pos + 1] == SYNC[1]))) {
+        pos++;
+        stats_.skipped_bytes++;
+      }
+      if (fill_ - pos < HEADER_SIZE) break;
+      const uint8_t *frame = buffer_ + pos;
+      size_t payload = get16(frame + 2);
+      if (payload > MAX_PAYLOAD) {
+        // not a real sync, look again one byte further on
+        stats_.bad_frames++;
+        pos++;
+        continue;
+      }
+      size_t size = HEADER_SIZE + payload + CRC_SIZE;
+      if (fill_ - pos < size) break;
+      if (crc16(frame + 2, HEADER_SIZE - 2 + payload) != get16(frame + HEADER_SIZE + payload)) {
+        stats_.crc_errors++;
+        pos++;
+        continue;
+      }
+      onFrame(frame, payload);
+      pos += size;
+    }
+    memmove(buffer_, buffer_ + pos, fill_ - pos);
+    fill_ -= pos;
+  }
+
+  void onFrame(const uint8_t *frame, size_t payload) {
+    FrameInfo info{get16(frame + 4), get32(frame + 6), 0};
+    if (has_sequence_) stats_.lost_frames += (uint16_t)(info.sequence - expected_sequence_);
+    expected_sequence_ = info.sequence + 1;
+    has_sequence_ = true;
+    stats_.frames++;
+
+    const uint8_t *p = frame + HEADER_SIZE;
+    const uint8_t *end = p + payload;
+    // count first so the callback sees the frame's record count
+    for (const uint8_t *q = p; q + sizeof(Record) <= end; info.num_records++) {
+      q += sizeof(Record) + ((q[offsetof(Record, flags)] & HAS_KEYS) ? KEYS_SIZE : 0);
+    }
+    while (p < end) {
+      Record record;
+      if (end - p < (ptrdiff_t)sizeof(Record)) {
+        stats_.bad_frames++;
+        return;
+      }
+      memcpy(&record, p, sizeof(Record));
+      p += sizeof(Record);
+      const uint8_t *keys = nullptr;
+      if (record.flags & HAS_KEYS) {
+        if (end - p < (ptrdiff_t)KEYS_SIZE) {
+          stats_.bad_frames++;
+          return;
+        }
+        keys = p;
+        p += KEYS_SIZE;
+      }
+      stats_.records++;
+      if (on_record_) on_record_(info, record, keys);
+    }
+  }
+
+  static uint16_t get16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+  static uint32_t get32(const uint8_t *p) { return get16(p) | ((uint32_t)get16(p + 2) << 16); }
+
+  record_fn on_record_;
+  uint8_t buffer_[MAX_FRAME_SIZE * 2];
+  size_t fill_{0};
+  uint16_t expected_sequence_{0};
+  bool has_sequence_{false};
+  Stats stats_;
+};
+
+/** Open a serial port (or pty) raw, 8N1, at the given baud rate. Returns
+ *  the file descriptor or -1. */
+static inline int openSerial(const char *path, speed_t baud) {
+  int fd = open(path, O_RDWR | O_NOCTTY);
+  if (fd < 0) return -1;
+  termios tio;
+  if (tcgetattr(fd, &tio) == 0) {
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, baud);
+    cfsetospeed(&tio, baud);
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+    tcsetattr(fd, TCSANOW, &tio);
+  }
+  return fd;
+}
+
+} // namespace input_stream
@@ -0,0 +1,175 @@
+/** Receives the binary input stream on Linux.
+ *
+ *    input_stream_tool <serial device> [baud] [-v]
+ *        print link statistics every second, and every record with -v
+ *    input_stream_tool --loopback [seconds] [events per frame]
+ *        send frames through a pseudo-terminal pair at full speed and
+ *        report throughput and frame loss, to check the framing and the
+ *        receiver without hardware
+ */
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include <poll.h>
+#include <stdlib.h>
+
+#include "input_stream_receiver.hpp"
+
+using namespace input_stream;
+using Clock = std::chrono::steady_clock;
+
+static speed_t toSpeed(long baud) {
+  switch (baud) {
+  case 115200: return B115200;
+  case 230400: return B230400;
+  case 460800: return B460800;
+  case 921600: return B921600;
+  case 1000000: return B1000000;
+  case 1500000: return B1500000;
+  case 2000000: return B2000000;
+  case 3000000: return B3000000;
+  case 4000000: return B4000000;
+  default: return 0;
+  }
+}
+
+static void printStats(const FrameParser::Stats &stats, double seconds) {
+  printf("%.1f s: %llu frames (%.0f/s), %llu records (%.0f/s), %.1f kB/s, "
+         "lost %llu, crc errors %llu, bad %llu, skipped %llu B\n",
+         seconds, (unsigned long long)stats.frames, stats.frames / seconds,
+         (unsigned long long)stats.records, stats.records / seconds, stats.bytes / seconds / 1000,
+         (unsigned long long)stats.lost_frames, (unsigned long long)stats.crc_errors,
+         (unsigned long long)stats.bad_frames, (unsigned long long)stats.skipped_bytes);
+}
+
+static int receive(const char *path, long baud, bool verbose) {
+  speed_t speed = toSpeed(baud);
+  if (!speed) {
+    fprintf(stderr, "unsupported baud rate %ld\n", baud);
+    return 1;
+  }
+  int fd = openSerial(path, speed);
+  if (fd < 0) {
+    perror(path);
+    return 1;
+  }
+  FrameParser parser([verbose](const FrameInfo &frame, const Record &r, const uint8_t *keys) {
+    if (!verbose) return;
+    printf("frame %u: device %u #%u (report %u) buttons %08x axes %d %d %d %d hats %x %x motion %d %d %d%s\n",
+           frame.sequence, r.device, r.sequence, r.report_id, r.buttons, r.axes[0], r.axes[1],
+           r.axes[2], r.axes[5], r.hats[0], r.hats[1], r.motion[0], r.motion[1], r.motion[2],
+           keys ? " +keys" : "");
+  });
+  auto start = Clock::now();
+  auto last = start;
+  uint8_t buffer[4096];
+  for (;;) {
+    ssize_t n = read(fd, buffer, sizeof(buffer));
+    if (n <= 0) break;
+    parser.feed(buffer, n);
+    auto now = Clock::now();
+    if (now - last >= std::chrono::seconds(1)) {
+      last = now;
+      printStats(parser.stats(), std::chrono::duration<double>(now - start).count());
+    }
+  }
+  close(fd);
+  return 0;
+}
+
+static int loopback(double seconds, size_t events_per_frame) {
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) || unlockpt(master)) {
+    perror("posix_openpt");
+    return 1;
+  }
+  int slave = openSerial(ptsname(master), B4000000);
+  if (slave < 0) {
+    perror("ptsname");
+    return 1;
+  }
+  termios tio;
+  tcgetattr(master, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(master, TCSANOW, &tio);
+
+  std::atomic<bool> done{false};
+  uint64_t sent_frames = 0, sent_records = 0;
+  std::thread sender([&] {
+    static uint8_t frame[MAX_FRAME_SIZE];
+    FrameWriter writer;
+    uint32_t event = 0;
+    uint16_t sequence = 0;
+    auto end = Clock::now() + std::chrono::duration<double>(seconds);
+    while (Clock::now() < end) {
+      writer.begin(frame);
+      for (size_t i = 0; i < events_per_frame; i++, event++) {
+        Record r{};
+        r.device = 1;
+        r.sequence = event;
+        r.buttons = event * 2654435761u;
+        for (size_t a = 0; a < NUM_AXES; a++) r.axes[a] = event + a;
+        // every 8th event is a keyboard event, to exercise HAS_KEYS
+        uint8_t keys[KEYS_SIZE] = {};
+        keys[event % KEYS_SIZE] = 1;
+        if (!writer.add(r, event % 8 == 0 ? keys : nullptr)) break;
+      }
+      size_t length = writer.finish(sequence++, event);
+      for (size_t off = 0; off < length;) {
+        ssize_t n = write(master, frame + off, length - off);
+        if (n <= 0) { done = true; return; }
+        off += n;
+      }
+      sent_frames++;
+      sent_records += writer.numRecords();
+    }
+    done = true;
+  });
+
+  FrameParser parser;
+  auto start = Clock::now();
+  uint8_t buffer[4096];
+  for (;;) {
+    pollfd pfd = {slave, POLLIN, 0};
+    if (poll(&pfd, 1, 100) <= 0) {
+      if (done) break;
+      continue;
+    }
+    ssize_t n = read(slave, buffer, sizeof(buffer));
+    if (n <= 0) break;
+    parser.feed(buffer, n);
+  }
+  sender.join();
+  close(slave);
+  close(master);
+
+  auto &stats = parser.stats();
+  printStats(stats, std::chrono::duration<double>(Clock::now() - start).count());
+  printf("sent %llu frames / %llu records, received %llu / %llu\n", (unsigned long long)sent_frames,
+         (unsigned long long)sent_records, (unsigned long long)stats.frames,
+         (unsigned long long)stats.records);
+  bool ok = stats.frames == sent_frames && stats.records == sent_records && !stats.lost_frames &&
+            !stats.crc_errors;
+  printf("%s\n", ok ? "OK" : "FRAME LOSS");
+  return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+  if (argc >= 2 && !strcmp(argv[1], "--loopback")) {
+    double seconds = argc >= 3 ? atof(argv[2]) : 2.0;
+    size_t events = argc >= 4 ? atoi(argv[3]) : 8;
+    return loopback(seconds, events);
+  }
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <serial device> [baud] [-v]\n"
+                    "       %s --loopback [seconds] [events per frame]\n", argv[0], argv[0]);
+    return 1;
+  }
+  long baud = argc >= 3 && argv[2][0] != '-' ? atol(argv[2]) : 2000000;
+  bool verbose = !strcmp(argv[argc - 1], "-v");
+  return receive(argv[1], baud, verbose);
+}
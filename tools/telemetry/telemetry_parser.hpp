@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+
+#include "telemetry_protocol.hpp"
+
+/** Linux side of the telemetry snapshots: a frame parser for the raw
+ *  binary stream (UART sink) that resynchronizes on sync bytes, and a
+ *  decoder for the "@T<hex>" lines of the console log sink. Both check
+ *  version, schema hash, CRC and the snapshot sequence.
+ */
+namespace telemetry {
+
+/** Header fields of a received snapshot. */
+struct SnapshotInfo {
+  uint32_t sequence;
+  size_t num_connections;
+};
+
+class SnapshotParser {
+public:
+  /** Called once per good snapshot. */
+  typedef std::function<void(const SnapshotInfo &info, const SystemRecord &system,
+                             const ConnectionRecord *connections)> snapshot_fn;
+
+  struct Stats {
+    uint64_t bytes{0};
+    uint64_t snapshots{0};
+    uint64_t lost_snapshots{0};   /**< From gaps in the sequence. */
+    uint64_t crc_errors{0};
+    uint64_t bad_frames{0};       /**< Other version, impossible size, bad hex. */
+    uint64_t schema_mismatches{0}; /**< Good frames from firmware with other fields. */
+    uint64_t skipped_bytes{0};    /**< Bytes discarded while looking for sync. */
+  };
+
+  explicit SnapshotParser(snapshot_fn on_snapshot = nullptr) : on_snapshot_(on_snapshot) {}
+
+  /** Raw binary stream. */
+  void feed(const uint8_t *data, size_t length) {
+    stats_.bytes += length;
+    while (length) {
+      size_t n = std::min(length, sizeof(buffer_) - fill_);
+      memcpy(buffer_ + fill_, data, n);
+      fill_ += n;
+      data += n;
+      length -= n;
+      parse();
+    }
+  }
+
+  /** One console log line; lines that are not snapshots are ignored.
+   *  Returns true if the line was a snapshot, good or not. */
+  bool feedLine(const char *line) {
+    const char *start = strstr(line, "@T");
+    if (!start) return false;
+    start += 2;
+    uint8_t frame[MAX_FRAME_SIZE];
+    size_t length = 0;
+    for (const char *p = start; isHex(p[0]) && isHex(p[1]); p += 2) {
+      if (length == sizeof(frame)) break;
+      frame[length++] = hexValue(p[0]) << 4 | hexValue(p[1]);
+    }
+    stats_.bytes += length;
+    size_t size = frameSize(frame, length);
+    if (!size || size != length) {
+      stats_.bad_frames++;
+      return true;
+    }
+    check(frame, size);
+    return true;
+  }
+
+  const Stats &stats() const { return stats_; }
+
+protected:
+  void parse() {
+    size_t pos = 0;
+    for (;;) {
+      // find sync
+      while (pos < fill_ && !(buffer_[pos] == SYNC[0] && (pos + 1 == fill_ || buffer_[pos + 1] == SYNC[1]))) {
+        pos++;
+        stats_.skipped_bytes++;
+      }
+      if (fill_ - pos < HEADER_SIZE) break;
+      const uint8_t *frame = buffer_ + pos;
+      size_t size = frameSize(frame, fill_ - pos);
+      if (!size) {
+        // not a real sync, look again one byte further on
+        stats_.bad_frames++;
+        pos++;
+        continue;
+      }
+      if (fill_ - pos < size) break;
+      if (!check(frame, size)) {
+        pos++;
+        continue;
+      }
+      pos += size;
+    }
+    memmove(buffer_, buffer_ + pos, fill_ - pos);
+    fill_ -= pos;
+  }
+
+  /** Size the header promises, or 0 if it cannot be a frame of ours. */
+  static size_t frameSize(const uint8_t *frame, size_t available) {
+    if (available < HEADER_SIZE || frame[0] != SYNC[0] || frame[1] != SYNC[1] || frame[2] != VERSION ||
+        frame[3] > MAX_CONNECTIONS) {
+      return 0;
+    }
+    return FrameWriter::frameSize(frame[3]);
+  }
+
+  /** CRC and schema checks; false if the CRC is wrong. */
+  bool check(const uint8_t *frame, size_t size) {
+    if (input_stream::crc16(frame + 2, size - CRC_SIZE - 2) != get16(frame + size - CRC_SIZE)) {
+      stats_.crc_errors++;
+      return false;
+    }
+    if (get32(frame + 4) != SCHEMA_HASH) {
+      stats_.schema_mismatches++;
+      return true;
+    }
+    SnapshotInfo info{get32(frame + 8), frame[3]};
+    if (has_sequence_) stats_.lost_snapshots += info.sequence - expected_sequence_;
+    expected_sequence_ = info.sequence + 1;
+    has_sequence_ = true;
+    stats_.snapshots++;
+    SystemRecord system;
+    ConnectionRecord connections[MAX_CONNECTIONS];
+    memcpy(&system, frame + HEADER_SIZE, sizeof(system));
+    memcpy(connections, frame + HEADER_SIZE + sizeof(system), info.num_connections * sizeof(ConnectionRecord));
+    if (on_snapshot_) on_snapshot_(info, system, connections);
+    return true;
+  }
+
+  static bool isHex(char c) { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'); }
+  static uint8_t hexValue(char c) { return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10; }
+  static uint16_t get16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+  static uint32_t get32(const uint8_t *p) { return get16(p) | ((uint32_t)get16(p + 2) << 16); }
+
+  snapshot_fn on_snapshot_;
+  uint8_t buffer_[MAX_FRAME_SIZE * 2];
+  size_t fill_{0};
+  uint32_t expected_sequence_{0};
+  bool has_sequence_{false};
+  Stats stats_;
+};
+
+} // namespace telemetry
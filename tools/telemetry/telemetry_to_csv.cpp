@@ -0,0 +1,217 @@
+/** Converts telemetry snapshots to CSV on Linux.
+ *
+ *    telemetry_to_csv [--log] [file]
+ *        read raw snapshot frames (UART sink), or with --log a console log
+ *        with "@T" lines (log sink), from file or stdin; write one CSV row
+ *        per connection and snapshot (one row with empty connection
+ *        columns for snapshots without any) to stdout and a summary of
+ *        good, lost and bad snapshots to stderr
+ *    telemetry_to_csv --self-test
+ *        round trip generated snapshots through both input formats, with
+ *        corrupt and foreign frames mixed in
+ *
+ *  The columns come from the same field lists as the firmware's records,
+ *  so a rebuilt converter always matches firmware of the same schema.
+ */
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "telemetry_parser.hpp"
+
+using namespace telemetry;
+
+static void printValue(FILE *out, uint64_t v) { fprintf(out, "%" PRIu64, v); }
+static void printValue(FILE *out, uint32_t v) { fprintf(out, "%" PRIu32, v); }
+static void printValue(FILE *out, uint16_t v) { fprintf(out, "%u", (unsigned)v); }
+static void printValue(FILE *out, uint8_t v) { fprintf(out, "%u", (unsigned)v); }
+static void printValue(FILE *out, int8_t v) { fprintf(out, "%d", (int)v); }
+
+static void printHeader(FILE *out) {
+  fprintf(out, "sequence");
+#define TELEMETRY_COLUMN(type, name) fprintf(out, "," #name);
+  TELEMETRY_SYSTEM_FIELDS(TELEMETRY_COLUMN)
+#undef TELEMETRY_COLUMN
+#define TELEMETRY_COLUMN(type, name) fprintf(out, ",conn_" #name);
+  TELEMETRY_CONNECTION_FIELDS(TELEMETRY_COLUMN)
+#undef TELEMETRY_COLUMN
+  fprintf(out, "\n");
+}
+
+static void printRow(FILE *out, const SnapshotInfo &info, const SystemRecord &system,
+                     const ConnectionRecord *connection) {
+  fprintf(out, "%" PRIu32, info.sequence);
+  /** copies, since the records are packed */
+#define TELEMETRY_VALUE(type, name)                                                                \
+  fputc(',', out);                                                                                 \
+  printValue(out, (type)system.name);
+  TELEMETRY_SYSTEM_FIELDS(TELEMETRY_VALUE)
+#undef TELEMETRY_VALUE
+#define TELEMETRY_VALUE(type, name)                                                                \
+  fputc(',', out);                                                                                 \
+  if (connection) printValue(out, (type)connection->name);
+  TELEMETRY_CONNECTION_FIELDS(TELEMETRY_VALUE)
+#undef TELEMETRY_VALUE
+  fprintf(out, "\n");
+}
+
+static void writeCsv(FILE *out, const SnapshotInfo &info, const SystemRecord &system,
+                     const ConnectionRecord *connections) {
+  if (!info.num_connections) printRow(out, info, system, nullptr);
+  for (size_t i = 0; i < info.num_connections; i++) printRow(out, info, system, &connections[i]);
+}
+
+static void printSummary(const SnapshotParser::Stats &stats) {
+  fprintf(stderr, "%llu snapshots, lost %llu, crc errors %llu, bad %llu, other schema %llu, skipped %llu B\n",
+          (unsigned long long)stats.snapshots, (unsigned long long)stats.lost_snapshots,
+          (unsigned long long)stats.crc_errors, (unsigned long long)stats.bad_frames,
+          (unsigned long long)stats.schema_mismatches, (unsigned long long)stats.skipped_bytes);
+  if (stats.schema_mismatches) {
+    fprintf(stderr, "some snapshots have another schema (this converter: %08x); rebuild it from the "
+                    "firmware's sources\n", (unsigned)SCHEMA_HASH);
+  }
+}
+
+static int convert(FILE *in, bool log) {
+  printHeader(stdout);
+  SnapshotParser parser([](const SnapshotInfo &info, const SystemRecord &system, const ConnectionRecord *c) {
+    writeCsv(stdout, info, system, c);
+  });
+  if (log) {
+    std::string line;
+    char chunk[512];
+    while (fgets(chunk, sizeof(chunk), in)) {
+      line += chunk;
+      if (line.back() != '\n' && !feof(in)) continue;
+      parser.feedLine(line.c_str());
+      line.clear();
+    }
+  } else {
+    uint8_t buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0) parser.feed(buffer, n);
+  }
+  printSummary(parser.stats());
+  return 0;
+}
+
+/** A snapshot whose every field depends on seed and the connection index */
+static size_t makeFrame(uint8_t *frame, uint32_t sequence, uint32_t seed, size_t num_connections) {
+  SystemRecord system;
+  uint32_t v = seed;
+#define TELEMETRY_FILL(type, name) system.name = (type)(v = v * 1664525u + 1013904223u);
+  TELEMETRY_SYSTEM_FIELDS(TELEMETRY_FILL)
+#undef TELEMETRY_FILL
+  FrameWriter writer;
+  writer.begin(frame, system);
+  for (size_t i = 0; i < num_connections; i++) {
+    ConnectionRecord c;
+#define TELEMETRY_FILL(type, name) c.name = (type)(v = v * 1664525u + 1013904223u);
+    TELEMETRY_CONNECTION_FIELDS(TELEMETRY_FILL)
+#undef TELEMETRY_FILL
+    writer.add(c);
+  }
+  return writer.finish(sequence);
+}
+
+static int selfTest() {
+  static constexpr uint32_t SNAPSHOTS = 201;
+  std::string raw, log;
+  char *expected_buffer = nullptr;
+  size_t expected_size = 0;
+  FILE *expected = open_memstream(&expected_buffer, &expected_size);
+  uint8_t frame[MAX_FRAME_SIZE];
+  for (uint32_t s = 0; s < SNAPSHOTS; s++) {
+    size_t num_connections = s % (MAX_CONNECTIONS + 1);
+    size_t length = makeFrame(frame, s, s * 7919, num_connections);
+    // every 10th snapshot is lost on the way; every 25th arrives corrupt
+    if (s % 10 == 9) continue;
+    if (s % 25 == 23) {
+      frame[length / 2] ^= 0x40;
+    } else {
+      SnapshotInfo info{s, num_connections};
+      SystemRecord system;
+      ConnectionRecord connections[MAX_CONNECTIONS];
+      memcpy(&system, frame + HEADER_SIZE, sizeof(system));
+      memcpy(connections, frame + HEADER_SIZE + sizeof(system), num_connections * sizeof(ConnectionRecord));
+      writeCsv(expected, info, system, connections);
+    }
+    raw += "noise\xA5";
+    raw.append((const char *)frame, length);
+    log += "I (1234) other log output\n@T";
+    for (size_t i = 0; i < length; i++) {
+      char hex[3];
+      snprintf(hex, sizeof(hex), "%02x", frame[i]);
+      log += hex;
+    }
+    log += "\n";
+  }
+  // a good frame of firmware with another schema
+  size_t length = makeFrame(frame, SNAPSHOTS, 1, 1);
+  frame[4] ^= 1;
+  uint16_t crc = input_stream::crc16(frame + 2, length - CRC_SIZE - 2);
+  frame[length - 2] = crc;
+  frame[length - 1] = crc >> 8;
+  raw.append((const char *)frame, length);
+  fclose(expected);
+
+  bool ok = true;
+  for (int pass = 0; pass < 2; pass++) {
+    char *csv_buffer = nullptr;
+    size_t csv_size = 0;
+    FILE *csv = open_memstream(&csv_buffer, &csv_size);
+    SnapshotParser parser([csv](const SnapshotInfo &info, const SystemRecord &system, const ConnectionRecord *c) {
+      writeCsv(csv, info, system, c);
+    });
+    if (pass == 0) {
+      // odd chunk sizes, to split frames anywhere
+      for (size_t pos = 0; pos < raw.size(); pos += 37) {
+        parser.feed((const uint8_t *)raw.data() + pos, std::min<size_t>(37, raw.size() - pos));
+      }
+    } else {
+      size_t start = 0, end;
+      while ((end = log.find('\n', start)) != std::string::npos) {
+        parser.feedLine(log.substr(start, end - start).c_str());
+        start = end + 1;
+      }
+    }
+    fclose(csv);
+    auto &stats = parser.stats();
+    uint64_t lost = SNAPSHOTS / 10, corrupt = SNAPSHOTS / 25;
+    bool pass_ok = csv_size == expected_size && !memcmp(csv_buffer, expected_buffer, csv_size) &&
+                   stats.snapshots == SNAPSHOTS - lost - corrupt && stats.lost_snapshots == lost + corrupt &&
+                   (pass == 1 || stats.schema_mismatches == 1) &&
+                   (pass == 0 ? stats.crc_errors >= corrupt : stats.bad_frames + stats.crc_errors == corrupt);
+    printf("%s: %s\n", pass == 0 ? "binary" : "log", pass_ok ? "ok" : "FAILED");
+    printSummary(stats);
+    ok &= pass_ok;
+    free(csv_buffer);
+  }
+  free(expected_buffer);
+  printf("schema hash %08x, snapshot %zu B + %zu B per connection\n", (unsigned)SCHEMA_HASH,
+         FrameWriter::frameSize(0), sizeof(ConnectionRecord));
+  return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+  bool log = false;
+  const char *path = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--self-test")) return selfTest();
+    if (!strcmp(argv[i], "--log")) {
+      log = true;
+    } else {
+      path = argv[i];
+    }
+  }
+  FILE *in = path ? fopen(path, "rb") : stdin;
+  if (!in) {
+    perror(path);
+    return 1;
+  }
+  int result = convert(in, log);
+  if (in != stdin) fclose(in);
+  return result;
+}